@@ -0,0 +1,447 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+
+static u32 hash_key(AtlasKey key)
+{
+    u32 result = key.glyph_index;
+    result = result*31 + key.pixel_size;
+    result = result*31 + key.phase;
+    result ^= result >> 15;
+    result *= 0x2C1B3C6D;
+    result ^= result >> 12;
+    return result;
+}
+
+static i32 keys_equal(AtlasKey a, AtlasKey b)
+{
+    return a.glyph_index == b.glyph_index && a.pixel_size == b.pixel_size && a.phase == b.phase;
+}
+
+static void reset_page(Atlas *atlas, AtlasPage *page)
+{
+    memset(page->pixels, 0, atlas->page_width*atlas->page_height);
+    page->skyline[0].x = 0;
+    page->skyline[0].y = 0;
+    page->skyline[0].width = atlas->page_width;
+    page->skyline_count = 1;
+    page->first_entry = ATLAS_NIL;
+}
+
+Atlas atlas_create(i32 page_width, i32 page_height, i32 max_pages, i32 entry_capacity, RasterMode mode,
+                   i32 x_phases, i32 y_phases)
+{
+    Atlas result = {};
+    result.page_width = page_width;
+    result.page_height = page_height;
+    result.max_pages = max_pages;
+    result.mode = mode;
+    result.x_phases = CLAMP(x_phases, 1, ATLAS_MAX_PHASES);
+    result.y_phases = CLAMP(y_phases, 1, ATLAS_MAX_PHASES);
+
+    result.pages = (AtlasPage *)font_alloc(max_pages*sizeof(AtlasPage));
+
+    result.entry_capacity = entry_capacity;
+    result.entries = (AtlasEntry *)font_alloc(entry_capacity*sizeof(AtlasEntry));
+    for(i32 i = 0; i < entry_capacity; ++i)
+    {
+        result.entries[i].hash_next = (i + 1 < entry_capacity) ? i + 1 : ATLAS_NIL;
+    }
+    result.first_free_entry = 0;
+
+    result.hash_size = 1;
+    while(result.hash_size < entry_capacity*2)
+    {
+        result.hash_size <<= 1;
+    }
+    result.hash = (i32 *)font_alloc(result.hash_size*sizeof(i32));
+    for(i32 i = 0; i < result.hash_size; ++i)
+    {
+        result.hash[i] = ATLAS_NIL;
+    }
+
+    result.lru_head = ATLAS_NIL;
+    result.lru_tail = ATLAS_NIL;
+    return result;
+}
+
+void atlas_destroy(Atlas *atlas)
+{
+    for(i32 i = 0; i < atlas->page_count; ++i)
+    {
+        font_free(atlas->pages[i].pixels);
+        font_free(atlas->pages[i].skyline);
+    }
+    font_free(atlas->pages);
+    font_free(atlas->entries);
+    font_free(atlas->hash);
+    Atlas zero = {};
+    *atlas = zero;
+}
+
+static void lru_unlink(Atlas *atlas, i32 index)
+{
+    AtlasEntry *entry = atlas->entries + index;
+    if(entry->lru_prev != ATLAS_NIL) atlas->entries[entry->lru_prev].lru_next = entry->lru_next;
+    else atlas->lru_head = entry->lru_next;
+    if(entry->lru_next != ATLAS_NIL) atlas->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    else atlas->lru_tail = entry->lru_prev;
+}
+
+static void lru_push_front(Atlas *atlas, i32 index)
+{
+    AtlasEntry *entry = atlas->entries + index;
+    entry->lru_prev = ATLAS_NIL;
+    entry->lru_next = atlas->lru_head;
+    if(atlas->lru_head != ATLAS_NIL) atlas->entries[atlas->lru_head].lru_prev = index;
+    atlas->lru_head = index;
+    if(atlas->lru_tail == ATLAS_NIL) atlas->lru_tail = index;
+}
+
+AtlasEntry *atlas_find(Atlas *atlas, AtlasKey key)
+{
+    u32 bucket = hash_key(key) & (atlas->hash_size - 1);
+    for(i32 index = atlas->hash[bucket]; index != ATLAS_NIL; index = atlas->entries[index].hash_next)
+    {
+        AtlasEntry *entry = atlas->entries + index;
+        if(keys_equal(entry->key, key))
+        {
+            if(atlas->lru_head != index)
+            {
+                lru_unlink(atlas, index);
+                lru_push_front(atlas, index);
+            }
+            ++atlas->hits;
+            STAT_ADD(STAT_ATLAS_HITS, 1);
+            return entry;
+        }
+    }
+    ++atlas->misses;
+    STAT_ADD(STAT_ATLAS_MISSES, 1);
+    return 0;
+}
+
+static void remove_entry(Atlas *atlas, i32 index)
+{
+    AtlasEntry *entry = atlas->entries + index;
+    u32 bucket = hash_key(entry->key) & (atlas->hash_size - 1);
+    i32 *link = atlas->hash + bucket;
+    while(*link != index)
+    {
+        link = &atlas->entries[*link].hash_next;
+    }
+    *link = entry->hash_next;
+
+    lru_unlink(atlas, index);
+
+    entry->hash_next = atlas->first_free_entry;
+    atlas->first_free_entry = index;
+    --atlas->entry_count;
+    atlas->glyph_pixels -= (u64)entry->width*entry->height;
+}
+
+static void evict_page(Atlas *atlas, i32 page_index)
+{
+    AtlasPage *page = atlas->pages + page_index;
+    i32 index = page->first_entry;
+    while(index != ATLAS_NIL)
+    {
+        i32 next = atlas->entries[index].page_next;
+        remove_entry(atlas, index);
+        index = next;
+    }
+    reset_page(atlas, page);
+    ++atlas->evicted_pages;
+}
+
+// NOTE: Evicts whatever holds the least recently used glyph. Glyphs without
+// pixels own no page and are removed on their own
+static void evict_least_recently_used(Atlas *atlas)
+{
+    i32 index = atlas->lru_tail;
+    if(index == ATLAS_NIL) return;
+    if(atlas->entries[index].page == ATLAS_NIL)
+    {
+        remove_entry(atlas, index);
+    }
+    else
+    {
+        evict_page(atlas, atlas->entries[index].page);
+    }
+}
+
+// NOTE: Bottom-left skyline placement. Returns the y where a rect of this
+// width sits if its left edge is on top of node index, or -1 if it does not fit
+static i32 skyline_fit(Atlas *atlas, AtlasPage *page, i32 index, i32 width, i32 height)
+{
+    i32 x = page->skyline[index].x;
+    if(x + width > atlas->page_width) return -1;
+
+    i32 y = 0;
+    i32 width_left = width;
+    while(width_left > 0)
+    {
+        y = MAX(y, page->skyline[index].y);
+        if(y + height > atlas->page_height) return -1;
+        width_left -= page->skyline[index].width;
+        ++index;
+    }
+    return y;
+}
+
+static i32 skyline_pack(Atlas *atlas, AtlasPage *page, i32 width, i32 height, i32 *out_x, i32 *out_y)
+{
+    i32 best_index = -1;
+    i32 best_y = atlas->page_height;
+    i32 best_width = atlas->page_width + 1;
+    for(i32 i = 0; i < page->skyline_count; ++i)
+    {
+        i32 y = skyline_fit(atlas, page, i, width, height);
+        if(y < 0) continue;
+        if(y < best_y || (y == best_y && page->skyline[i].width < best_width))
+        {
+            best_index = i;
+            best_y = y;
+            best_width = page->skyline[i].width;
+        }
+    }
+    if(best_index < 0) return 0;
+
+    i32 x = page->skyline[best_index].x;
+
+    // NOTE: Insert the new top segment and cut the ones it now covers
+    memmove(page->skyline + best_index + 1, page->skyline + best_index,
+            (page->skyline_count - best_index)*sizeof(SkylineNode));
+    page->skyline[best_index].x = x;
+    page->skyline[best_index].y = best_y + height;
+    page->skyline[best_index].width = width;
+    ++page->skyline_count;
+
+    for(i32 i = best_index + 1; i < page->skyline_count; ++i)
+    {
+        SkylineNode *node = page->skyline + i;
+        SkylineNode *prev = page->skyline + i - 1;
+        i32 prev_end = prev->x + prev->width;
+        if(node->x >= prev_end) break;
+
+        i32 shrink = prev_end - node->x;
+        node->x += shrink;
+        node->width -= shrink;
+        if(node->width > 0) break;
+
+        memmove(node, node + 1, (page->skyline_count - i - 1)*sizeof(SkylineNode));
+        --page->skyline_count;
+        --i;
+    }
+
+    for(i32 i = 0; i + 1 < page->skyline_count; ++i)
+    {
+        if(page->skyline[i].y == page->skyline[i + 1].y)
+        {
+            page->skyline[i].width += page->skyline[i + 1].width;
+            memmove(page->skyline + i + 1, page->skyline + i + 2,
+                    (page->skyline_count - i - 2)*sizeof(SkylineNode));
+            --page->skyline_count;
+            --i;
+        }
+    }
+
+    *out_x = x;
+    *out_y = best_y;
+    return 1;
+}
+
+static i32 allocate_rect(Atlas *atlas, i32 width, i32 height, i32 *out_x, i32 *out_y)
+{
+    for(i32 i = 0; i < atlas->page_count; ++i)
+    {
+        if(skyline_pack(atlas, atlas->pages + i, width, height, out_x, out_y)) return i;
+    }
+
+    if(atlas->page_count < atlas->max_pages)
+    {
+        AtlasPage *page = atlas->pages + atlas->page_count;
+        page->pixels = (u8 *)font_alloc(atlas->page_width*atlas->page_height);
+        page->skyline = (SkylineNode *)font_alloc((atlas->page_width + 1)*sizeof(SkylineNode));
+        reset_page(atlas, page);
+        if(skyline_pack(atlas, page, width, height, out_x, out_y)) return atlas->page_count++;
+        return ATLAS_NIL;
+    }
+
+    // NOTE: Every page is full, flush the least recently used one and retry
+    // there. The flushed page is empty so this only fails for huge glyphs
+    while(atlas->lru_tail != ATLAS_NIL)
+    {
+        i32 page_index = atlas->entries[atlas->lru_tail].page;
+        evict_least_recently_used(atlas);
+        if(page_index != ATLAS_NIL)
+        {
+            if(skyline_pack(atlas, atlas->pages + page_index, width, height, out_x, out_y)) return page_index;
+            return ATLAS_NIL;
+        }
+    }
+    return ATLAS_NIL;
+}
+
+AtlasEntry *atlas_insert(Atlas *atlas, AtlasKey key, u8 *bitmap, i32 width, i32 height)
+{
+    // NOTE: Free the entry slot before packing, evicting after the rect is
+    // allocated could flush the page we just wrote to
+    if(atlas->first_free_entry == ATLAS_NIL)
+    {
+        evict_least_recently_used(atlas);
+    }
+
+    i32 page_index = ATLAS_NIL;
+    i32 x = 0;
+    i32 y = 0;
+    if(width > 0 && height > 0)
+    {
+        page_index = allocate_rect(atlas, width + ATLAS_PADDING, height + ATLAS_PADDING, &x, &y);
+        if(page_index == ATLAS_NIL) return 0;
+
+        AtlasPage *page = atlas->pages + page_index;
+        for(i32 row = 0; row < height; ++row)
+        {
+            memcpy(page->pixels + (y + row)*atlas->page_width + x, bitmap + row*width, width);
+        }
+    }
+
+    i32 index = atlas->first_free_entry;
+    AtlasEntry *entry = atlas->entries + index;
+    atlas->first_free_entry = entry->hash_next;
+    ++atlas->entry_count;
+    atlas->glyph_pixels += (u64)width*height;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->key = key;
+    entry->page = page_index;
+    entry->x = x;
+    entry->y = y;
+    entry->width = width;
+    entry->height = height;
+    entry->u0 = (f32)x / atlas->page_width;
+    entry->v0 = (f32)y / atlas->page_height;
+    entry->u1 = (f32)(x + width) / atlas->page_width;
+    entry->v1 = (f32)(y + height) / atlas->page_height;
+
+    u32 bucket = hash_key(key) & (atlas->hash_size - 1);
+    entry->hash_next = atlas->hash[bucket];
+    atlas->hash[bucket] = index;
+
+    entry->page_next = ATLAS_NIL;
+    if(page_index != ATLAS_NIL)
+    {
+        entry->page_next = atlas->pages[page_index].first_entry;
+        atlas->pages[page_index].first_entry = index;
+    }
+
+    lru_push_front(atlas, index);
+    return entry;
+}
+
+AtlasEntry *atlas_get(Atlas *atlas, Font *font, AtlasKey key)
+{
+    AtlasEntry *result = atlas_find(atlas, key);
+    if(result)
+    {
+        return result;
+    }
+
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    DiskCacheKey disk_key = {};
+    if(atlas->disk_cache)
+    {
+        disk_key.font_hash = atlas->font_hash;
+        disk_key.glyph_index = key.glyph_index;
+        disk_key.pixel_size = key.pixel_size;
+        disk_key.mode = (u8)atlas->mode;
+        disk_key.phase = key.phase;
+        disk_key.x_phases = (u8)atlas->x_phases;
+        disk_key.y_phases = (u8)atlas->y_phases;
+        DiskCacheGlyph cached = {};
+        if(disk_cache_find(atlas->disk_cache, scratch, disk_key, &cached))
+        {
+            result = atlas_insert(atlas, key, cached.pixels, cached.width, cached.height);
+            if(result)
+            {
+                result->bearing_x = cached.bearing_x;
+                result->bearing_y = cached.bearing_y;
+                result->advance = cached.advance;
+            }
+            arena_end_temp(temp);
+            return result;
+        }
+    }
+
+    f32 scale = scale_pixel_height(*get_font_hhea(font), key.pixel_size);
+    Glyph glyph = get_font_glyph(scratch, font, key.glyph_index);
+
+    // NOTE: The bitmap starts at the whole pixel under the left (bottom) of
+    // the outline, the rest of the bearing plus the phase is rendered in
+    f32 left = (f32)(key.phase & 0xF)/atlas->x_phases + scale*glyph.x_min;
+    f32 bottom = (f32)(key.phase >> 4)/atlas->y_phases + scale*glyph.y_min;
+    v2f origin = { floorf(left), floorf(bottom) };
+    v2f offset = { left - origin.x, bottom - origin.y };
+    v2i bitmap_size = {};
+    u8 *bitmap = render_glyph_offset(scratch, glyph, scale, offset, atlas->mode, &bitmap_size);
+
+    result = atlas_insert(atlas, key, bitmap, bitmap_size.x, bitmap_size.y);
+    if(result)
+    {
+        LongHorMetric metric = get_glyph_h_metric(*get_font_hmtx(font), key.glyph_index);
+        result->bearing_x = origin.x;
+        result->bearing_y = origin.y;
+        result->advance = scale*metric.advance_width;
+        if(atlas->disk_cache)
+        {
+            DiskCacheGlyph cached = {};
+            cached.width = (u16)bitmap_size.x;
+            cached.height = (u16)bitmap_size.y;
+            cached.bearing_x = result->bearing_x;
+            cached.bearing_y = result->bearing_y;
+            cached.advance = result->advance;
+            cached.pixels = bitmap;
+            disk_cache_insert(atlas->disk_cache, disk_key, &cached);
+        }
+    }
+
+    arena_end_temp(temp);
+    return result;
+}
+
+void atlas_set_disk_cache(Atlas *atlas, DiskCache *cache, u64 font_hash)
+{
+    atlas->disk_cache = cache;
+    atlas->font_hash = font_hash;
+}
+
+AtlasKey atlas_key(Atlas *atlas, u16 glyph_index, u16 pixel_size, v2f pen, v2i *pixel)
+{
+    f32 x = floorf(pen.x);
+    f32 y = floorf(pen.y);
+    i32 x_phase = (i32)((pen.x - x)*atlas->x_phases + 0.5f);
+    i32 y_phase = (i32)((pen.y - y)*atlas->y_phases + 0.5f);
+    pixel->x = (i32)x;
+    pixel->y = (i32)y;
+    if(x_phase >= atlas->x_phases)
+    {
+        x_phase = 0;
+        ++pixel->x;
+    }
+    if(y_phase >= atlas->y_phases)
+    {
+        y_phase = 0;
+        ++pixel->y;
+    }
+
+    AtlasKey result = {};
+    result.glyph_index = glyph_index;
+    result.pixel_size = pixel_size;
+    result.phase = (u8)(x_phase | (y_phase << 4));
+    return result;
+}
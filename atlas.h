@@ -0,0 +1,124 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "font.h"
+#include "diskcache.h"
+
+// NOTE: Glyph atlas. Rasterized glyphs are packed into fixed size 8-bit
+// pages with a skyline packer and looked up by (glyph index, pixel size,
+// subpixel phase). When there is no room left the page that holds the least
+// recently used glyph is flushed and reused
+//
+// Glyphs placed at fractional pen positions are rendered once per subpixel
+// phase: the fraction of the pen is rounded to one of x_phases (y_phases)
+// steps and every phase is its own entry. One phase is whole pixel
+// positioning, 4 keeps the placement error under 1/8 of a pixel
+
+#define ATLAS_NIL -1
+// NOTE: Empty pixels kept around every glyph so bilinear sampling does not
+// bleed the neighbours in
+#define ATLAS_PADDING 1
+// NOTE: Phases are packed into the 4 bit halves of AtlasKey.phase
+#define ATLAS_MAX_PHASES 16
+
+typedef struct
+{
+    u16 glyph_index;
+    u16 pixel_size;
+    // NOTE: x phase in the low 4 bits, y phase in the high 4 bits
+    u8 phase;
+} AtlasKey;
+
+typedef struct
+{
+    AtlasKey key;
+
+    i32 page;
+    i32 x, y;
+    i32 width, height;
+    f32 u0, v0, u1, v1;
+
+    // NOTE: Whole pixel offset from the snapped pen position to the bitmap
+    // origin (bottom left, y up) and the horizontal advance at this size. The
+    // fraction of the bearing and the phase are already in the bitmap
+    f32 bearing_x;
+    f32 bearing_y;
+    f32 advance;
+
+    i32 lru_prev;
+    i32 lru_next;
+    i32 hash_next;
+    i32 page_next;
+} AtlasEntry;
+
+typedef struct
+{
+    i32 x, y;
+    i32 width;
+} SkylineNode;
+
+typedef struct
+{
+    u8 *pixels;
+    SkylineNode *skyline;
+    i32 skyline_count;
+    i32 first_entry;
+} AtlasPage;
+
+typedef struct
+{
+    i32 page_width;
+    i32 page_height;
+    i32 max_pages;
+    RasterMode mode;
+    i32 x_phases;
+    i32 y_phases;
+
+    AtlasPage *pages;
+    i32 page_count;
+
+    AtlasEntry *entries;
+    i32 entry_capacity;
+    i32 entry_count;
+    i32 first_free_entry;
+
+    i32 *hash;
+    i32 hash_size;
+
+    i32 lru_head;
+    i32 lru_tail;
+
+    u64 hits;
+    u64 misses;
+    u64 evicted_pages;
+    // NOTE: Bitmap pixels of the entries in the atlas, padding not included
+    u64 glyph_pixels;
+
+    // NOTE: Misses look here before rasterizing, see atlas_set_disk_cache
+    DiskCache *disk_cache;
+    u64 font_hash;
+} Atlas;
+
+// NOTE: x_phases and y_phases are clamped to [1, ATLAS_MAX_PHASES]
+Atlas atlas_create(i32 page_width, i32 page_height, i32 max_pages, i32 entry_capacity, RasterMode mode,
+                   i32 x_phases, i32 y_phases);
+void atlas_destroy(Atlas *atlas);
+
+// NOTE: Returns the cached entry or 0, marks it as recently used
+AtlasEntry *atlas_find(Atlas *atlas, AtlasKey key);
+// NOTE: Copies a bitmap into the atlas, evicting pages if needed. Returns 0
+// if the bitmap does not fit in an empty page
+AtlasEntry *atlas_insert(Atlas *atlas, AtlasKey key, u8 *bitmap, i32 width, i32 height);
+// NOTE: Cache lookup, on a miss decodes and rasterizes the glyph and inserts
+// it. Hits never touch get_glyph or the rasterizer
+AtlasEntry *atlas_get(Atlas *atlas, Font *font, AtlasKey key);
+// NOTE: Misses of atlas_get are looked up in the disk cache first and the
+// glyphs it rasterizes are written to it. font_hash is hash_font_file of the
+// font the atlas is used with, 0 cache turns it off
+void atlas_set_disk_cache(Atlas *atlas, DiskCache *cache, u64 font_hash);
+// NOTE: Key of a glyph drawn with its pen at pen. The pen is split into the
+// whole pixel the entry bearing is added to and the phase of the remaining
+// fraction, a fraction that rounds up to the next pixel moves pixel instead
+AtlasKey atlas_key(Atlas *atlas, u16 glyph_index, u16 pixel_size, v2f pen, v2i *pixel);
+
+#endif // ATLAS_H
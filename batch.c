@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "batch.h"
+
+// NOTE: The jobs a worker still owns, begin in the low 32 bits and end in
+// the high 32 bits. The owner takes jobs from the front and thieves take the
+// back half, both with a compare and swap of the whole range
+#define RANGE(begin, end) (((u64)(end) << 32) | (u64)(begin))
+#define RANGE_BEGIN(range) ((u32)((range) & 0xFFFFFFFF))
+#define RANGE_END(range) ((u32)((range) >> 32))
+
+typedef struct
+{
+    u64 range;
+    BatchPool *pool;
+    i32 index;
+    pthread_t thread;
+    // NOTE: Bitmaps of the jobs this worker rendered, reset every batch
+    Arena output;
+    u64 jobs_stolen;
+    // NOTE: Keep the ranges of two workers out of the same cache line
+    u8 padding[64];
+} BatchWorker;
+
+struct BatchPool
+{
+    BatchWorker *workers;
+    i32 thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    u64 generation;
+    i32 running;
+    i32 quit;
+
+    // NOTE: Current batch, only written while the workers are waiting
+    Font *font;
+    Hhead hhea;
+    RasterMode mode;
+    BatchJob *jobs;
+    BatchResult *results;
+    // NOTE: Set for a distance field batch, where job i is row i of the field
+    SdfShape *shape;
+    u8 *sdf_output;
+};
+
+static i32 pop_job(BatchWorker *worker)
+{
+    u64 range = __atomic_load_n(&worker->range, __ATOMIC_ACQUIRE);
+    for(;;)
+    {
+        u32 begin = RANGE_BEGIN(range);
+        u32 end = RANGE_END(range);
+        if(begin >= end)
+        {
+            return -1;
+        }
+        if(__atomic_compare_exchange_n(&worker->range, &range, RANGE(begin + 1, end), 1,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return (i32)begin;
+        }
+    }
+}
+
+static i32 steal_jobs(BatchWorker *worker)
+{
+    BatchPool *pool = worker->pool;
+    for(i32 i = 1; i < pool->thread_count; ++i)
+    {
+        BatchWorker *victim = pool->workers + (worker->index + i) % pool->thread_count;
+        u64 range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        for(;;)
+        {
+            u32 begin = RANGE_BEGIN(range);
+            u32 end = RANGE_END(range);
+            if(begin >= end)
+            {
+                break;
+            }
+            u32 middle = begin + (end - begin)/2;
+            if(__atomic_compare_exchange_n(&victim->range, &range, RANGE(begin, middle), 1,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                // NOTE: Our own range is empty so nobody else is touching it
+                __atomic_store_n(&worker->range, RANGE(middle, end), __ATOMIC_RELEASE);
+                worker->jobs_stolen += end - middle;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void render_job(BatchPool *pool, BatchWorker *worker, i32 index)
+{
+    if(pool->shape)
+    {
+        generate_sdf_rows(pool->shape, pool->sdf_output, index, index + 1);
+        return;
+    }
+
+    BatchJob job = pool->jobs[index];
+    BatchResult *result = pool->results + index;
+
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    f32 scale = scale_pixel_height(pool->hhea, job.pixel_size);
+    Glyph glyph = {};
+    if(pool->font->loaded & FONT_LOADED_OUTLINES)
+    {
+        glyph = get_outline_store_glyph(&pool->font->outlines, job.glyph_index);
+    }
+    else
+    {
+        glyph = get_glyph_by_index(scratch, pool->font->font_dir, job.glyph_index);
+    }
+    v2i bitmap_size = {};
+    result->bitmap = render_glyph(&worker->output, glyph, scale, pool->mode, &bitmap_size);
+    result->width = bitmap_size.x;
+    result->height = bitmap_size.y;
+
+    arena_end_temp(temp);
+}
+
+static void run_jobs(BatchWorker *worker)
+{
+    for(;;)
+    {
+        i32 index = pop_job(worker);
+        if(index < 0)
+        {
+            if(!steal_jobs(worker))
+            {
+                break;
+            }
+            continue;
+        }
+        render_job(worker->pool, worker, index);
+    }
+}
+
+static void *worker_main(void *data)
+{
+    BatchWorker *worker = (BatchWorker *)data;
+    BatchPool *pool = worker->pool;
+    u64 generation = 0;
+    for(;;)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->generation == generation && !pool->quit)
+        {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if(pool->quit)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_jobs(worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->running == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    free_scratch_arena();
+    return 0;
+}
+
+BatchPool *batch_create(i32 thread_count)
+{
+    if(thread_count <= 0)
+    {
+        thread_count = (i32)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    thread_count = CLAMP(thread_count, 1, BATCH_MAX_THREADS);
+
+    BatchPool *pool = (BatchPool *)font_alloc(sizeof(BatchPool));
+    memset(pool, 0, sizeof(BatchPool));
+    pool->thread_count = thread_count;
+    pool->workers = (BatchWorker *)font_alloc(thread_count*sizeof(BatchWorker));
+    memset(pool->workers, 0, thread_count*sizeof(BatchWorker));
+    pthread_mutex_init(&pool->mutex, 0);
+    pthread_cond_init(&pool->start, 0);
+    pthread_cond_init(&pool->done, 0);
+
+    // NOTE: Worker 0 is the thread that calls batch_render
+    for(i32 i = 0; i < thread_count; ++i)
+    {
+        BatchWorker *worker = pool->workers + i;
+        worker->pool = pool;
+        worker->index = i;
+        if(i > 0 && pthread_create(&worker->thread, 0, worker_main, worker) != 0)
+        {
+            pool->thread_count = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void batch_destroy(BatchPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(i32 i = 0; i < pool->thread_count; ++i)
+    {
+        if(i > 0)
+        {
+            pthread_join(pool->workers[i].thread, 0);
+        }
+        arena_free(&pool->workers[i].output);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    font_free(pool->workers);
+    font_free(pool);
+}
+
+i32 batch_thread_count(BatchPool *pool)
+{
+    return pool->thread_count;
+}
+
+u64 batch_stolen_jobs(BatchPool *pool)
+{
+    u64 result = 0;
+    for(i32 i = 0; i < pool->thread_count; ++i)
+    {
+        result += pool->workers[i].jobs_stolen;
+    }
+    return result;
+}
+
+// NOTE: Hands out jobs 0..job_count to the workers and waits for them, the
+// batch itself is already in the pool
+static void run_batch(BatchPool *pool, i32 job_count)
+{
+    // NOTE: Neighbour jobs are usually the same size and close glyph indices,
+    // contiguous slices keep them on the same worker
+    i32 thread_count = pool->thread_count;
+    for(i32 i = 0; i < thread_count; ++i)
+    {
+        BatchWorker *worker = pool->workers + i;
+        arena_reset(&worker->output);
+        u32 begin = (u32)(((u64)job_count*i)/thread_count);
+        u32 end = (u32)(((u64)job_count*(i + 1))/thread_count);
+        __atomic_store_n(&worker->range, RANGE(begin, end), __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->running = thread_count - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_jobs(pool->workers);
+
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->running > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void batch_render(BatchPool *pool, Font *font, RasterMode mode, BatchJob *jobs, i32 job_count, BatchResult *results)
+{
+    if(job_count <= 0)
+    {
+        return;
+    }
+
+    pool->font = font;
+    pool->hhea = *get_font_hhea(font);
+    pool->mode = mode;
+    pool->jobs = jobs;
+    pool->results = results;
+    pool->shape = 0;
+    run_batch(pool, job_count);
+}
+
+void batch_render_sdf(BatchPool *pool, SdfShape *shape, u8 *output)
+{
+    if(shape->height <= 0)
+    {
+        return;
+    }
+
+    pool->shape = shape;
+    pool->sdf_output = output;
+    run_batch(pool, shape->height);
+    pool->shape = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "font.h"
+
+// NOTE: Batch rasterizer. A list of (glyph index, pixel size) jobs is split
+// between a fixed set of worker threads, every worker starts with a
+// contiguous slice of the list and steals half of the remaining slice of
+// another worker when it runs out. Workers decode and rasterize with their
+// own thread local scratch arena and write the bitmaps into their own
+// output arena, result i always belongs to job i. Threads are pthreads, the
+// Win32 demo does not build this file
+
+#define BATCH_MAX_THREADS 256
+
+typedef struct
+{
+    u16 glyph_index;
+    f32 pixel_size;
+} BatchJob;
+
+typedef struct
+{
+    // NOTE: 0 for glyphs without outline, owned by the pool until the next
+    // batch_render call
+    u8 *bitmap;
+    i32 width;
+    i32 height;
+} BatchResult;
+
+typedef struct BatchPool BatchPool;
+
+// NOTE: thread_count counts the calling thread, which works on every batch
+// too. 0 uses one thread per online cpu
+BatchPool *batch_create(i32 thread_count);
+void batch_destroy(BatchPool *pool);
+i32 batch_thread_count(BatchPool *pool);
+// NOTE: Jobs that ran on another worker than the one they were given to,
+// since the pool was created
+u64 batch_stolen_jobs(BatchPool *pool);
+
+// NOTE: Blocks until every job is done. Workers only read the font, the hhea
+// table is loaded here before they start. With the font outlines loaded the
+// workers read the outline store, otherwise composite glyphs are decoded
+// without the font component cache, which is not shared between threads
+void batch_render(BatchPool *pool, Font *font, RasterMode mode, BatchJob *jobs, i32 job_count, BatchResult *results);
+// NOTE: Generates the rows of one distance field in parallel, output is
+// shape->width*shape->height bytes. Blocks until the field is done
+void batch_render_sdf(BatchPool *pool, SdfShape *shape, u8 *output);
+
+#endif // BATCH_H
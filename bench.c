@@ -0,0 +1,1615 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "atlas.h"
+#include "batch.h"
+#include "pack.h"
+#include "composite.h"
+
+// NOTE: Per stage microbenchmark of the glyph pipeline. Walks every
+// codepoint of the font cmap and times each stage on its own so we can see
+// which one dominates at every pixel size
+
+#define MAX_SIZES 16
+
+// NOTE: The cheap lookups are timed in groups so the clock overhead does
+// not hide the cost of the call
+#define LOOKUP_REPEAT 64
+#define RUN_REPEAT 64
+// NOTE: Pixel size of the one distance field every glyph gets
+#define SDF_BENCH_SIZE 48.0f
+#define SDF_BENCH_SPREAD 4.0f
+#define PACK_BENCH_PATH "font_bench.pack"
+#define DISK_CACHE_BENCH_PATH "font_bench.cache"
+#define DISK_CACHE_BENCH_CAPACITY (256ull << 20)
+// NOTE: Ring small enough that the glyphs of every size wrap it
+#define DISK_CACHE_BENCH_SMALL_CAPACITY (1ull << 20)
+// NOTE: Poster sizes for the banded raster, one glyph each
+#define BAND_BENCH_ROWS 64
+#define BAND_BENCH_CODE_POINT '@'
+// NOTE: Image the text runs are composited into
+#define COMPOSITE_BENCH_WIDTH 1920
+#define COMPOSITE_BENCH_HEIGHT 1080
+#define COMPOSITE_BENCH_REPEAT 8
+
+typedef struct
+{
+    const char *name;
+    u64 *samples;
+    i32 sample_count;
+    u64 total_ns;
+    u64 allocations;
+    u64 bytes;
+} Stage;
+
+static volatile u32 bench_sink;
+
+static void begin_stage(Stage *stage, const char *name, i32 capacity)
+{
+    memset(stage, 0, sizeof(*stage));
+    stage->name = name;
+    stage->samples = (u64 *)malloc(capacity*sizeof(u64));
+}
+
+static void add_sample(Stage *stage, u64 ns)
+{
+    stage->samples[stage->sample_count++] = ns;
+    stage->total_ns += ns;
+}
+
+// NOTE: Clock and allocation counters at the start of one sample
+typedef struct
+{
+    u64 allocations;
+    u64 bytes;
+    u64 start;
+} Sample;
+
+static Sample begin_sample(void)
+{
+    Sample result;
+    result.allocations = font_allocation_count;
+    result.bytes = font_allocated_bytes;
+    result.start = get_time_ns();
+    return result;
+}
+
+// NOTE: repeat is the number of calls timed together, the time of one goes
+// to the stage and the allocations of all of them
+static void end_sample(Stage *stage, Sample sample, i32 repeat)
+{
+    u64 ns = get_time_ns() - sample.start;
+    add_sample(stage, ns / repeat);
+    stage->allocations += font_allocation_count - sample.allocations;
+    stage->bytes += font_allocated_bytes - sample.bytes;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_stage(Stage *stage)
+{
+    if(!stage->sample_count) return;
+    qsort(stage->samples, stage->sample_count, sizeof(u64), compare_u64);
+    u64 p50 = stage->samples[stage->sample_count/2];
+    u64 p99 = stage->samples[(stage->sample_count*99)/100];
+    fprintf(stdout, "  %-22s %10.1f %10llu %10llu %12.2f %12.1f\n",
+            stage->name,
+            (f64)stage->total_ns / stage->sample_count, p50, p99,
+            (f64)stage->allocations / stage->sample_count,
+            (f64)stage->bytes / stage->sample_count);
+    free(stage->samples);
+}
+
+static void print_header(const char *title)
+{
+    fprintf(stdout, "%s\n", title);
+    fprintf(stdout, "  %-22s %10s %10s %10s %12s %12s\n",
+            "stage", "ns/glyph", "p50", "p99", "allocs/glyph", "bytes/glyph");
+}
+
+// NOTE: Checks every band against the full bitmap of the same glyph
+typedef struct
+{
+    u8 *reference;
+    i32 max_difference;
+    i32 band_count;
+} BandCheck;
+
+static void check_band(void *user_data, u8 *rows, i32 row_begin, i32 row_count, i32 width)
+{
+    BandCheck *check = (BandCheck *)user_data;
+    u8 *reference = check->reference + (u64)row_begin*width;
+    for(i32 i = 0; i < row_count*width; ++i)
+    {
+        check->max_difference = MAX(check->max_difference, abs((i32)rows[i] - (i32)reference[i]));
+    }
+    ++check->band_count;
+}
+
+static void skip_band(void *user_data, u8 *rows, i32 row_begin, i32 row_count, i32 width)
+{
+    (void)user_data; (void)row_begin; (void)width;
+    bench_sink += rows[0] + row_count;
+}
+
+// NOTE: Pages of BENCH_ATLAS_PAGE_SIZE for an atlas that holds every glyph of
+// the list at every phase without evicting a page. Sized from the glyph info,
+// a phase can make the bitmap one pixel wider, and a third more for the
+// space the skyline packer leaves empty
+#define BENCH_ATLAS_PAGE_SIZE 1024
+
+static i32 get_bench_atlas_pages(Font *font, u16 *glyph_indices, i32 glyph_count, f32 pixel_size, i32 phases)
+{
+    f32 scale = scale_pixel_height(*get_font_hhea(font), pixel_size);
+    v2f offset = {};
+    u64 area = 0;
+    for(i32 i = 0; i < glyph_count; ++i)
+    {
+        v2i size = get_glyph_info_bitmap_size(get_font_glyph_info(font, glyph_indices[i]), scale, offset);
+        area += (u64)(size.x + 1 + 2*ATLAS_PADDING)*(size.y + 2*ATLAS_PADDING)*phases;
+    }
+    u64 page_area = (u64)BENCH_ATLAS_PAGE_SIZE*BENCH_ATLAS_PAGE_SIZE;
+    return (i32)((area + area/3 + page_area - 1) / page_area) + 1;
+}
+
+typedef struct
+{
+    f32 x;
+    i32 winding;
+} SampleCrossing;
+
+// NOTE: Reference anti-aliasing: 4x4 samples at the centres of the
+// sub-pixels with nonzero winding, box filtered. Every sample row crosses
+// every line, slow but without the bias of the binary rasterizer (which
+// samples on whole scanlines and truncates x)
+static void supersample_glyph(Arena *arena, Line *lines, i32 line_count, i32 width, i32 height, u8 *output)
+{
+    ArenaTemp temp = arena_begin_temp(arena);
+    SampleCrossing *crossings = ARENA_PUSH_ARRAY(arena, SampleCrossing, MAX(line_count, 1));
+    u32 *counts = ARENA_PUSH_ARRAY(arena, u32, MAX(width, 1));
+    for(i32 y = 0; y < height; ++y)
+    {
+        memset(counts, 0, width*sizeof(u32));
+        for(i32 sy = 0; sy < 4; ++sy)
+        {
+            f32 sample_y = y + (sy + 0.5f)*0.25f;
+            i32 crossing_count = 0;
+            for(i32 i = 0; i < line_count; ++i)
+            {
+                v2f p0 = lines[i].p0;
+                v2f p1 = lines[i].p1;
+                if(p0.y == p1.y || sample_y < MIN(p0.y, p1.y) || sample_y >= MAX(p0.y, p1.y)) continue;
+                SampleCrossing crossing = { p0.x + (sample_y - p0.y)*(p1.x - p0.x)/(p1.y - p0.y), p1.y > p0.y ? 1 : -1 };
+                i32 j = crossing_count++;
+                while(j > 0 && crossings[j - 1].x > crossing.x)
+                {
+                    crossings[j] = crossings[j - 1];
+                    --j;
+                }
+                crossings[j] = crossing;
+            }
+
+            i32 next = 0;
+            i32 winding = 0;
+            for(i32 x = 0; x < width; ++x)
+            {
+                for(i32 sx = 0; sx < 4; ++sx)
+                {
+                    f32 sample_x = x + (sx + 0.5f)*0.25f;
+                    while(next < crossing_count && crossings[next].x < sample_x)
+                    {
+                        winding += crossings[next++].winding;
+                    }
+                    counts[x] += winding != 0;
+                }
+            }
+        }
+        for(i32 x = 0; x < width; ++x)
+        {
+            output[y*width + x] = (u8)((counts[x]*255 + 8) / 16);
+        }
+    }
+    arena_end_temp(temp);
+}
+
+// NOTE: What every section reads: the font, every codepoint of its cmap with
+// the glyph index and decoded outline, and the pixel sizes. Checks that have
+// to hold exactly count in failures, the bench exits with 1 when one fails so
+// a script running it sees it
+typedef struct
+{
+    Font *font;
+    const char *font_path;
+    Format4 format;
+    Hhead hhea;
+    u16 *code_points;
+    u16 *glyph_indices;
+    Glyph *glyphs;
+    i32 code_point_count;
+    f32 *sizes;
+    i32 size_count;
+    i32 failures;
+} Bench;
+
+static const char *bench_run_text = "The quick brown fox jumps over the lazy dog. AVATAR To Wa 0123456789";
+
+static i32 collect_code_points(Format4 format, u16 *code_points)
+{
+    i32 count = 0;
+    for(i32 i = 0; i < format.seg_count_x2/2; ++i)
+    {
+        for(u32 code = format.start_code[i]; code <= format.end_code[i] && code != 0xFFFF; ++code)
+        {
+            if(get_glyph_index(format, (u16)code))
+            {
+                code_points[count++] = (u16)code;
+            }
+        }
+    }
+    return count;
+}
+
+// NOTE: Size independent lookups, fills in the glyph index of every codepoint
+static void bench_lookup(Bench *bench)
+{
+    Font *font = bench->font;
+    u16 *code_points = bench->code_points;
+    u16 *glyph_indices = bench->glyph_indices;
+    i32 code_point_count = bench->code_point_count;
+    Stage stage;
+
+    begin_stage(&stage, "get_glyph_index", code_point_count);
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        u32 sum = 0;
+        Sample sample = begin_sample();
+        for(i32 r = 0; r < LOOKUP_REPEAT; ++r)
+        {
+            sum += get_glyph_index(bench->format, code_points[i]);
+        }
+        end_sample(&stage, sample, LOOKUP_REPEAT);
+        glyph_indices[i] = (u16)(sum / LOOKUP_REPEAT);
+    }
+    print_stage(&stage);
+
+    CharMap *char_map = get_font_char_map(font);
+    begin_stage(&stage, "char_map_lookup", code_point_count);
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        u32 sum = 0;
+        Sample sample = begin_sample();
+        for(i32 r = 0; r < LOOKUP_REPEAT; ++r)
+        {
+            sum += char_map_lookup(char_map, code_points[i]);
+        }
+        end_sample(&stage, sample, LOOKUP_REPEAT);
+        if(sum / LOOKUP_REPEAT != glyph_indices[i])
+        {
+            fprintf(stderr, "char_map_lookup mismatch for U+%04X\n", code_points[i]);
+            ++bench->failures;
+        }
+    }
+    print_stage(&stage);
+
+    // NOTE: Every face of a collection shares one mapping, opening a face
+    // only reads its directory and finds the tables in it
+    FontCollection collection = {};
+    if(open_font_collection(bench->font_path, &collection))
+    {
+        begin_stage(&stage, "open_collection_face", code_point_count);
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            Font face = {};
+            Sample sample = begin_sample();
+            for(i32 r = 0; r < LOOKUP_REPEAT; ++r)
+            {
+                open_collection_face(&collection, (u32)i % collection.face_count, &face);
+                bench_sink += face.font_dir.offset_sub.num_tables;
+            }
+            end_sample(&stage, sample, LOOKUP_REPEAT);
+            stage.bytes += sizeof(Font);
+            close_font(&face);
+        }
+        print_stage(&stage);
+        close_font_collection(&collection);
+    }
+
+    begin_stage(&stage, "get_glyph_offset", code_point_count);
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        u32 sum = 0;
+        Sample sample = begin_sample();
+        for(i32 r = 0; r < LOOKUP_REPEAT; ++r)
+        {
+            sum += get_glyph_offset(font->font_dir, glyph_indices[i]);
+        }
+        end_sample(&stage, sample, LOOKUP_REPEAT);
+        bench_sink += sum;
+    }
+    print_stage(&stage);
+}
+
+// NOTE: Decodes every glyph into glyph_arena, where they stay for the whole
+// run, then loads the outline store everything after this reads from
+static void bench_decode(Bench *bench, Arena *glyph_arena)
+{
+    Font *font = bench->font;
+    i32 code_point_count = bench->code_point_count;
+    Arena *scratch = get_scratch_arena();
+    Stage stage;
+
+    begin_stage(&stage, "get_glyph", code_point_count);
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        Sample sample = begin_sample();
+        bench->glyphs[i] = get_glyph(glyph_arena, font->font_dir, bench->format, bench->code_points[i]);
+        end_sample(&stage, sample, 1);
+    }
+    print_stage(&stage);
+
+    // NOTE: Composite glyphs through the font component cache, the decoded
+    // outline goes to the scratch arena
+    CharMap *char_map = get_font_char_map(font);
+    begin_stage(&stage, "get_font_glyph", code_point_count);
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        u16 glyph_index = char_map_lookup(char_map, bench->code_points[i]);
+        Sample sample = begin_sample();
+        Glyph glyph = get_font_glyph(scratch, font, glyph_index);
+        end_sample(&stage, sample, 1);
+        (void)glyph;
+        arena_reset(scratch);
+    }
+    print_stage(&stage);
+    fprintf(stdout, "  component cache: %llu hits, %llu misses\n",
+            font->component_cache.hits, font->component_cache.misses);
+
+    u64 store_bytes = font_allocated_bytes;
+    u64 store_start = get_time_ns();
+    load_font_outlines(font);
+    u64 store_ns = get_time_ns() - store_start;
+    begin_stage(&stage, "get_font_glyph (store)", code_point_count);
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        Sample sample = begin_sample();
+        Glyph glyph = get_font_glyph(scratch, font, bench->glyph_indices[i]);
+        end_sample(&stage, sample, 1);
+        bench_sink += glyph.number_of_contours;
+    }
+    print_stage(&stage);
+    fprintf(stdout, "  outline store: %u glyphs, %u points, %u contours, decoded in %.3f ms (%llu bytes)\n",
+            font->outlines.glyph_count, font->outlines.point_count, font->outlines.contour_count,
+            (f64)store_ns / 1000000.0, font_allocated_bytes - store_bytes);
+}
+
+// NOTE: Every glyph of the font through the SSSE3 coordinate decoder and the
+// scalar one, what the vector decoder does has to match exactly
+static void bench_coordinate_decoders(Bench *bench)
+{
+    FontDirectory font_dir = bench->font->font_dir;
+    u16 glyph_count = get_glyph_count(font_dir);
+    i64 vector_points = 0;
+    i64 decode_mismatch = 0;
+    for(u32 i = 0; i < glyph_count; ++i)
+    {
+        i32 vector_count = 0;
+        i32 mismatch = compare_glyph_coordinate_decoders(font_dir, (u16)i, &vector_count);
+        if(mismatch)
+        {
+            fprintf(stderr, "coordinate decoders differ for glyph %u\n", i);
+        }
+        decode_mismatch += mismatch;
+        vector_points += vector_count;
+    }
+    fprintf(stdout, "  ssse3 vs scalar decode: %u glyphs, %lld coordinates through ssse3, %lld mismatches\n",
+            glyph_count, vector_points, decode_mismatch);
+    if(decode_mismatch)
+    {
+        ++bench->failures;
+    }
+}
+
+// NOTE: Glyph info index, checked against the decoded outline of every
+// glyph. Then what the info sizes against what the pipeline writes. The old
+// bound gave every outline point a whole curve (curve_count equal to
+// point_count), the em square is a fixed bitmap per pixel size
+static void bench_glyph_info(Bench *bench)
+{
+    u16 *glyph_indices = bench->glyph_indices;
+    Glyph *glyphs = bench->glyphs;
+    i32 code_point_count = bench->code_point_count;
+    Arena *scratch = get_scratch_arena();
+
+    u64 info_bytes = font_allocated_bytes;
+    u64 info_start = get_time_ns();
+    GlyphInfoTable info_table = load_glyph_info_table(bench->font->font_dir);
+    u64 info_ns = get_time_ns() - info_start;
+    i32 info_mismatch = 0;
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        GlyphInfo info = get_glyph_info(&info_table, glyph_indices[i]);
+        GlyphInfo decoded = get_glyph_outline_info(glyphs[i]);
+        if(info.number_of_contours != decoded.number_of_contours ||
+           info.point_count != decoded.point_count || info.curve_count != decoded.curve_count ||
+           (decoded.number_of_contours > 0 &&
+            (info.x_min != decoded.x_min || info.y_min != decoded.y_min ||
+             info.x_max != decoded.x_max || info.y_max != decoded.y_max)))
+        {
+            fprintf(stderr, "glyph info mismatch for U+%04X\n", bench->code_points[i]);
+            ++info_mismatch;
+        }
+    }
+    fprintf(stdout, "  glyph info: %u glyphs, loaded in %.3f ms (%llu bytes), %d mismatches\n",
+            info_table.glyph_count, (f64)info_ns / 1000000.0, font_allocated_bytes - info_bytes, info_mismatch);
+    if(info_mismatch)
+    {
+        ++bench->failures;
+    }
+
+    fprintf(stdout, "\nglyph info sizing (per glyph)\n");
+    fprintf(stdout, "  %-22s %10s %10s %10s %12s %12s\n",
+            "size", "points", "bound", "old bound", "bitmap bytes", "em bytes");
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        f32 pixel_size = bench->sizes[s];
+        f32 scale = scale_pixel_height(bench->hhea, pixel_size);
+        u64 generated = 0;
+        u64 bound = 0;
+        u64 old_bound = 0;
+        u64 bitmap_bytes = 0;
+        i32 over_bound = 0;
+        i32 glyph_count = 0;
+        v2f offset = {};
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            GlyphInfo info = get_glyph_info(&info_table, glyph_indices[i]);
+            if(info.number_of_contours <= 0) continue;
+
+            i32 max_points = get_glyph_info_max_points(info, scale);
+            v2f *glyph_points = ARENA_PUSH_ARRAY(scratch, v2f, max_points);
+            i32 *glyph_contours = ARENA_PUSH_ARRAY(scratch, i32, info.number_of_contours);
+            i32 point_count = 0;
+            generate_glyph_points(glyphs[i], glyph_points, &point_count, scale, glyph_contours);
+            over_bound += point_count > max_points;
+            generated += point_count;
+            bound += max_points;
+            GlyphInfo every_point_curves = info;
+            every_point_curves.curve_count = info.point_count;
+            old_bound += get_glyph_info_max_points(every_point_curves, scale);
+            v2i bitmap_size = get_glyph_info_bitmap_size(info, scale, offset);
+            bitmap_bytes += (u64)bitmap_size.x*bitmap_size.y;
+            ++glyph_count;
+            arena_reset(scratch);
+        }
+        if(over_bound)
+        {
+            fprintf(stderr, "%d glyphs over the point bound at %gpx\n", over_bound, pixel_size);
+            ++bench->failures;
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "%gpx", pixel_size);
+        i32 em = (i32)pixel_size;
+        fprintf(stdout, "  %-22s %10.1f %10.1f %10.1f %12.1f %12d\n", label,
+                (f64)generated / MAX(glyph_count, 1), (f64)bound / MAX(glyph_count, 1),
+                (f64)old_bound / MAX(glyph_count, 1), (f64)bitmap_bytes / MAX(glyph_count, 1), em*em);
+    }
+    free_glyph_info_table(&info_table);
+}
+
+// NOTE: Every stage of the pipeline on its own at every size: points, lines
+// and the float, coverage and 26.6 rasterizers. Coverage and the binary 4x4
+// supersampling it replaces are both measured against a reference
+static void bench_raster(Bench *bench)
+{
+    Glyph *glyphs = bench->glyphs;
+    i32 code_point_count = bench->code_point_count;
+    Arena *scratch = get_scratch_arena();
+
+    // NOTE: The flattening depends on the scale, the buffer has to hold the
+    // biggest size of the 4x supersampled reference
+    f32 max_scale = 0.0f;
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        max_scale = MAX(max_scale, scale_pixel_height(bench->hhea, bench->sizes[s])*4.0f);
+    }
+    i32 max_points = 0;
+    i32 max_contours = 0;
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        max_points = MAX(max_points, get_glyph_max_points(glyphs[i], max_scale));
+        max_points = MAX(max_points, get_glyph_max_points_fixed(glyphs[i], get_fixed_scale(max_scale)));
+        max_contours = MAX(max_contours, glyphs[i].number_of_contours);
+    }
+    v2f *points = (v2f *)malloc(MAX(max_points, 1)*sizeof(v2f));
+    v2i *fixed_points = (v2i *)malloc(MAX(max_points, 1)*sizeof(v2i));
+    i32 *contour_end_index = (i32 *)malloc(MAX(max_contours, 1)*sizeof(i32));
+
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        f32 scale = scale_pixel_height(bench->hhea, bench->sizes[s]);
+        Stage points_stage;
+        Stage lines_stage;
+        Stage raster_stage;
+        Stage coverage_stage;
+        Stage supersample_stage;
+        Stage fixed_points_stage;
+        Stage fixed_lines_stage;
+        Stage fixed_raster_stage;
+        begin_stage(&points_stage, "generate_glyph_points", code_point_count);
+        begin_stage(&lines_stage, "generate_glyph_lines", code_point_count);
+        begin_stage(&raster_stage, "rasterize_glyph", code_point_count);
+        begin_stage(&coverage_stage, "rasterize_coverage", code_point_count);
+        begin_stage(&supersample_stage, "binary 4x4 supersample", code_point_count);
+        begin_stage(&fixed_points_stage, "points fixed", code_point_count);
+        begin_stage(&fixed_lines_stage, "lines fixed", code_point_count);
+        begin_stage(&fixed_raster_stage, "rasterize_glyph_fixed", code_point_count);
+        i32 fixed_scale = get_fixed_scale(scale);
+        v2i fixed_offset = {};
+        u64 fixed_mismatch = 0;
+
+        u64 pixels = 0;
+        u64 lines_total = 0;
+        u64 coverage_error = 0;
+        u64 supersample_error = 0;
+        i32 coverage_max_error = 0;
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            Glyph glyph = glyphs[i];
+            if(glyph.number_of_contours <= 0) continue;
+
+            Sample sample = begin_sample();
+            i32 point_count = 0;
+            generate_glyph_points(glyph, points, &point_count, scale, contour_end_index);
+            end_sample(&points_stage, sample, 1);
+
+            sample = begin_sample();
+            i32 line_count = 0;
+            Line *lines = generate_glyph_lines(scratch, glyph, &line_count, points, contour_end_index);
+            end_sample(&lines_stage, sample, 1);
+            lines_total += line_count;
+
+            v2i bitmap_size = get_glyph_bitmap_size(glyph, scale);
+            sample = begin_sample();
+            u8 *binary = rasterize_glyph(scratch, lines, line_count, bitmap_size.y, bitmap_size.x);
+            end_sample(&raster_stage, sample, 1);
+            pixels += (u64)bitmap_size.x*bitmap_size.y;
+
+            sample = begin_sample();
+            u8 *coverage = rasterize_glyph_coverage(scratch, lines, line_count, bitmap_size.y, bitmap_size.x);
+            end_sample(&coverage_stage, sample, 1);
+
+            sample = begin_sample();
+            i32 fixed_point_count = 0;
+            generate_glyph_points_fixed(glyph, fixed_points, &fixed_point_count, fixed_scale, fixed_offset,
+                                        contour_end_index);
+            end_sample(&fixed_points_stage, sample, 1);
+
+            sample = begin_sample();
+            i32 fixed_line_count = 0;
+            LineFixed *fixed_lines = generate_glyph_lines_fixed(scratch, glyph, &fixed_line_count, fixed_points,
+                                                                contour_end_index);
+            end_sample(&fixed_lines_stage, sample, 1);
+
+            sample = begin_sample();
+            u8 *fixed = rasterize_glyph_fixed(scratch, fixed_lines, fixed_line_count, bitmap_size.y, bitmap_size.x);
+            end_sample(&fixed_raster_stage, sample, 1);
+            for(i32 p = 0; p < bitmap_size.x*bitmap_size.y; ++p)
+            {
+                fixed_mismatch += fixed[p] != binary[p];
+            }
+
+            u8 *reference = ARENA_PUSH_ARRAY(scratch, u8, bitmap_size.x*bitmap_size.y);
+            supersample_glyph(scratch, lines, line_count, bitmap_size.x, bitmap_size.y, reference);
+
+            // NOTE: The cheap supersampling the coverage rasterizer replaces:
+            // binary raster at 4x and a box filter
+            generate_glyph_points(glyph, points, &point_count, scale*4.0f, contour_end_index);
+            Line *lines_4x = generate_glyph_lines(scratch, glyph, &line_count, points, contour_end_index);
+            v2i size_4x = { bitmap_size.x*4, bitmap_size.y*4 };
+
+            sample = begin_sample();
+            u8 *bitmap_4x = rasterize_glyph(scratch, lines_4x, line_count, size_4x.y, size_4x.x);
+            u8 *supersampled = ARENA_PUSH_ARRAY(scratch, u8, bitmap_size.x*bitmap_size.y);
+            for(i32 y = 0; y < bitmap_size.y; ++y)
+            {
+                for(i32 x = 0; x < bitmap_size.x; ++x)
+                {
+                    u32 sum = 0;
+                    for(i32 sy = 0; sy < 4; ++sy)
+                    {
+                        u8 *row = bitmap_4x + (y*4 + sy)*size_4x.x + x*4;
+                        sum += row[0] + row[1] + row[2] + row[3];
+                    }
+                    supersampled[y*bitmap_size.x + x] = (u8)(sum / 16);
+                }
+            }
+            end_sample(&supersample_stage, sample, 1);
+
+            for(i32 p = 0; p < bitmap_size.x*bitmap_size.y; ++p)
+            {
+                i32 error = abs((i32)coverage[p] - (i32)reference[p]);
+                coverage_error += error;
+                coverage_max_error = MAX(coverage_max_error, error);
+                supersample_error += abs((i32)supersampled[p] - (i32)reference[p]);
+            }
+
+            arena_reset(scratch);
+        }
+
+        char title[64];
+        snprintf(title, sizeof(title), "\n%gpx (%.0f pixels/glyph, %.1f lines/glyph)", bench->sizes[s],
+                 raster_stage.sample_count ? (f64)pixels / raster_stage.sample_count : 0.0,
+                 raster_stage.sample_count ? (f64)lines_total / raster_stage.sample_count : 0.0);
+        print_header(title);
+        print_stage(&points_stage);
+        print_stage(&lines_stage);
+        print_stage(&raster_stage);
+        print_stage(&coverage_stage);
+        print_stage(&supersample_stage);
+        print_stage(&fixed_points_stage);
+        print_stage(&fixed_lines_stage);
+        print_stage(&fixed_raster_stage);
+        fprintf(stdout, "  against 16 samples at sub-pixel centres: coverage mean %.2f/255 (max %d), "
+                "binary 4x4 mean %.2f/255\n", pixels ? (f64)coverage_error / pixels : 0.0, coverage_max_error,
+                pixels ? (f64)supersample_error / pixels : 0.0);
+        fprintf(stdout, "  fixed vs float binary: %.3f%% of the pixels differ\n",
+                pixels ? 100.0*(f64)fixed_mismatch / pixels : 0.0);
+    }
+
+    free(contour_end_index);
+    free(fixed_points);
+    free(points);
+}
+
+// NOTE: Span output against the dense bitmap of the same glyph. The bytes
+// are what the rasterizer writes and a consumer has to read. Coverage spans
+// come from bands, every row has to match the full bitmap. The picked time
+// takes whichever output prefer_span_output gives every glyph
+static void bench_spans(Bench *bench)
+{
+    Arena *scratch = get_scratch_arena();
+    i32 span_capacity = 4096;
+    RasterSpan *spans = (RasterSpan *)malloc(span_capacity*sizeof(RasterSpan));
+    fprintf(stdout, "\nspans vs dense bitmap\n");
+    fprintf(stdout, "  %-22s %10s %12s %10s %12s %10s %10s\n",
+            "size", "dense ns", "dense bytes", "spans ns", "span bytes", "picked ns", "max diff");
+    for(i32 m = 0; m < 2; ++m)
+    {
+        RasterMode span_mode = m ? RASTER_COVERAGE : RASTER_BINARY;
+        for(i32 s = 0; s < bench->size_count; ++s)
+        {
+            f32 scale = scale_pixel_height(bench->hhea, bench->sizes[s]);
+            v2f offset = {};
+            u64 dense_ns = 0;
+            u64 span_ns = 0;
+            u64 picked_ns = 0;
+            u64 dense_bytes = 0;
+            u64 span_bytes = 0;
+            i32 max_difference = 0;
+            i32 glyph_count = 0;
+            for(i32 i = 0; i < bench->code_point_count; ++i)
+            {
+                Glyph glyph = bench->glyphs[i];
+                if(glyph.number_of_contours <= 0) continue;
+
+                v2i size = {};
+                u64 start = get_time_ns();
+                u8 *bitmap = render_glyph(scratch, glyph, scale, span_mode, &size);
+                u64 glyph_dense_ns = get_time_ns() - start;
+                dense_ns += glyph_dense_ns;
+                dense_bytes += (u64)size.x*size.y;
+
+                start = get_time_ns();
+                i32 span_count = render_glyph_spans(glyph, scale, offset, span_mode, spans, span_capacity, &size);
+                u64 glyph_span_ns = get_time_ns() - start;
+                span_ns += glyph_span_ns;
+                picked_ns += prefer_span_output(span_mode, size) ? glyph_span_ns : glyph_dense_ns;
+                if(span_count > span_capacity)
+                {
+                    span_capacity = span_count*2;
+                    free(spans);
+                    spans = (RasterSpan *)malloc(span_capacity*sizeof(RasterSpan));
+                    render_glyph_spans(glyph, scale, offset, span_mode, spans, span_capacity, &size);
+                }
+                span_bytes += (u64)span_count*sizeof(RasterSpan);
+
+                u8 *drawn = (u8 *)arena_push_zero(scratch, size.x*size.y);
+                draw_spans(drawn, size.x, size.y, 0, 0, spans, span_count);
+                for(i32 p = 0; p < size.x*size.y; ++p)
+                {
+                    max_difference = MAX(max_difference, abs((i32)drawn[p] - (i32)bitmap[p]));
+                }
+                ++glyph_count;
+                arena_reset(scratch);
+            }
+
+            char label[64];
+            snprintf(label, sizeof(label), "%s %gpx", m ? "coverage" : "binary", bench->sizes[s]);
+            fprintf(stdout, "  %-22s %10.1f %12.1f %10.1f %12.1f %10.1f %10d\n", label,
+                    (f64)dense_ns / MAX(glyph_count, 1), (f64)dense_bytes / MAX(glyph_count, 1),
+                    (f64)span_ns / MAX(glyph_count, 1), (f64)span_bytes / MAX(glyph_count, 1),
+                    (f64)picked_ns / MAX(glyph_count, 1), max_difference);
+            if(max_difference)
+            {
+                fprintf(stderr, "%s: spans differ from the dense bitmap\n", label);
+                ++bench->failures;
+            }
+        }
+    }
+    free(spans);
+}
+
+// NOTE: Glyph atlas, first pass fills it and second pass only hits. The
+// atlas has room for every glyph, misses in the second pass would time the
+// rasterizer as hits
+static void bench_atlas(Bench *bench)
+{
+    i32 code_point_count = bench->code_point_count;
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        f32 pixel_size = bench->sizes[s];
+        i32 pages = get_bench_atlas_pages(bench->font, bench->glyph_indices, code_point_count, pixel_size, 1);
+        Atlas atlas = atlas_create(BENCH_ATLAS_PAGE_SIZE, BENCH_ATLAS_PAGE_SIZE, pages, code_point_count,
+                                   RASTER_COVERAGE, 1, 1);
+        u64 first_pass_misses = 0;
+        Stage miss_stage;
+        Stage hit_stage;
+        begin_stage(&miss_stage, "atlas_get miss", code_point_count);
+        begin_stage(&hit_stage, "atlas_get hit", code_point_count);
+        for(i32 pass = 0; pass < 2; ++pass)
+        {
+            Stage *atlas_stage = pass ? &hit_stage : &miss_stage;
+            for(i32 i = 0; i < code_point_count; ++i)
+            {
+                AtlasKey key = { bench->glyph_indices[i], (u16)pixel_size, 0 };
+                Sample sample = begin_sample();
+                AtlasEntry *entry = atlas_get(&atlas, bench->font, key);
+                end_sample(atlas_stage, sample, 1);
+                bench_sink += entry ? entry->width : 0;
+            }
+            if(!pass) first_pass_misses = atlas.misses;
+        }
+
+        char title[128];
+        snprintf(title, sizeof(title), "\natlas %gpx (%d of %d pages, %llu hits, %llu misses, %llu evicted pages)",
+                 pixel_size, atlas.page_count, pages, atlas.hits, atlas.misses, atlas.evicted_pages);
+        print_header(title);
+        print_stage(&miss_stage);
+        print_stage(&hit_stage);
+        if(atlas.misses != first_pass_misses)
+        {
+            fprintf(stdout, "  (%llu of the hits were misses, the atlas is too small)\n",
+                    atlas.misses - first_pass_misses);
+        }
+        atlas_destroy(&atlas);
+    }
+}
+
+// NOTE: Disk cache. Every size fills a cold atlas that writes the cache, then
+// the cache is opened again like a restarted process would and a new atlas
+// fills from it. The glyphs from the disk are checked against the rasterized
+// ones
+static void bench_disk_cache(Bench *bench)
+{
+    Font *font = bench->font;
+    u16 *glyph_indices = bench->glyph_indices;
+    i32 code_point_count = bench->code_point_count;
+    Arena *scratch = get_scratch_arena();
+
+    u64 font_hash = hash_font_file(&font->file);
+    remove(DISK_CACHE_BENCH_PATH);
+    DiskCache cache;
+    if(!disk_cache_open(DISK_CACHE_BENCH_PATH, DISK_CACHE_BENCH_CAPACITY, &cache))
+    {
+        fprintf(stdout, "\n  cannot open %s\n", DISK_CACHE_BENCH_PATH);
+    }
+    for(i32 s = 0; s < bench->size_count && cache.data; ++s)
+    {
+        f32 pixel_size = bench->sizes[s];
+        Atlas atlases[2];
+        Stage write_stage;
+        Stage read_stage;
+        begin_stage(&write_stage, "atlas_get miss, write", code_point_count);
+        begin_stage(&read_stage, "atlas_get miss, disk", code_point_count);
+        u64 open_ns = 0;
+        u64 mismatch = 0;
+        for(i32 pass = 0; pass < 2; ++pass)
+        {
+            if(pass)
+            {
+                u64 start = get_time_ns();
+                disk_cache_close(&cache);
+                disk_cache_open(DISK_CACHE_BENCH_PATH, DISK_CACHE_BENCH_CAPACITY, &cache);
+                open_ns = get_time_ns() - start;
+            }
+            Stage *stage = pass ? &read_stage : &write_stage;
+            Atlas *atlas = atlases + pass;
+            // NOTE: Room for every glyph, so the check below finds them all
+            *atlas = atlas_create(2048, 2048, 64, code_point_count, RASTER_COVERAGE, 1, 1);
+            atlas_set_disk_cache(atlas, &cache, font_hash);
+            for(i32 i = 0; i < code_point_count; ++i)
+            {
+                AtlasKey key = { glyph_indices[i], (u16)pixel_size, 0 };
+                Sample sample = begin_sample();
+                AtlasEntry *entry = atlas_get(atlas, font, key);
+                end_sample(stage, sample, 1);
+                bench_sink += entry ? entry->width : 0;
+            }
+        }
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            AtlasKey key = { glyph_indices[i], (u16)pixel_size, 0 };
+            AtlasEntry *written = atlas_find(atlases + 0, key);
+            AtlasEntry *read = atlas_find(atlases + 1, key);
+            i32 same = written && read && written->width == read->width && written->height == read->height &&
+                written->bearing_x == read->bearing_x && written->bearing_y == read->bearing_y &&
+                written->advance == read->advance;
+            for(i32 y = 0; same && y < written->height; ++y)
+            {
+                same = !memcmp(atlases[0].pages[written->page].pixels + (written->y + y)*atlases[0].page_width + written->x,
+                               atlases[1].pages[read->page].pixels + (read->y + y)*atlases[1].page_width + read->x,
+                               written->width);
+            }
+            mismatch += !same;
+        }
+
+        char title[160];
+        snprintf(title, sizeof(title), "\ndisk cache %gpx (reopened in %.3f ms, %llu records, %.1f MB written, %llu hits, %llu mismatches)",
+                 pixel_size, open_ns / 1000000.0, cache.recovered, (cache.header->head - DISK_CACHE_DATA_OFFSET) / 1048576.0,
+                 cache.hits, mismatch);
+        print_header(title);
+        print_stage(&write_stage);
+        print_stage(&read_stage);
+        if(mismatch)
+        {
+            fprintf(stderr, "%gpx: glyphs read from the disk cache differ\n", pixel_size);
+            ++bench->failures;
+        }
+        atlas_destroy(atlases + 0);
+        atlas_destroy(atlases + 1);
+    }
+
+    // NOTE: A record torn by a crash. The last one is damaged and the header
+    // is left from before it, the scan has to stop there
+    if(cache.data)
+    {
+        DiskCacheKey key = { font_hash, glyph_indices[0], 1, RASTER_COVERAGE, 0, 1, 1 };
+        u8 pixels[64] = {};
+        DiskCacheGlyph glyph = { 8, 8, 0, 0, 0, pixels };
+        u64 head = cache.header->head;
+        u64 records = cache.entry_count;
+        disk_cache_insert(&cache, key, &glyph);
+        cache.data[head + sizeof(DiskCacheRecord) + 10] ^= 0xFF;
+        cache.header->head = head;
+        disk_cache_close(&cache);
+        disk_cache_open(DISK_CACHE_BENCH_PATH, DISK_CACHE_BENCH_CAPACITY, &cache);
+        DiskCacheGlyph found = {};
+        i32 torn_found = disk_cache_find(&cache, scratch, key, &found);
+        fprintf(stdout, "  torn record: %llu of %llu records recovered, torn glyph %s\n",
+                cache.recovered, records, torn_found ? "found (wrong)" : "dropped");
+        if(torn_found || cache.recovered != records)
+        {
+            fprintf(stderr, "torn record not recovered from\n");
+            ++bench->failures;
+        }
+        arena_reset(scratch);
+    }
+    disk_cache_close(&cache);
+    remove(DISK_CACHE_BENCH_PATH);
+
+    // NOTE: Every size through a ring much smaller than the glyphs, it wraps
+    // and evicts and everything live is found again after a reopen
+    if(disk_cache_open(DISK_CACHE_BENCH_PATH, DISK_CACHE_BENCH_SMALL_CAPACITY, &cache))
+    {
+        for(i32 s = 0; s < bench->size_count; ++s)
+        {
+            Atlas atlas = atlas_create(1024, 1024, 8, 4096, RASTER_COVERAGE, 1, 1);
+            atlas_set_disk_cache(&atlas, &cache, font_hash);
+            for(i32 i = 0; i < code_point_count; ++i)
+            {
+                AtlasKey key = { glyph_indices[i], (u16)bench->sizes[s], 0 };
+                AtlasEntry *entry = atlas_get(&atlas, font, key);
+                bench_sink += entry ? entry->width : 0;
+            }
+            atlas_destroy(&atlas);
+        }
+        u64 inserts = cache.inserts;
+        u64 evictions = cache.evictions;
+        i32 live = cache.entry_count;
+        disk_cache_close(&cache);
+        disk_cache_open(DISK_CACHE_BENCH_PATH, DISK_CACHE_BENCH_SMALL_CAPACITY, &cache);
+        fprintf(stdout, "  %llu KB ring: %llu inserts, %llu evicted, %d live, %llu recovered after reopen\n",
+                DISK_CACHE_BENCH_SMALL_CAPACITY >> 10, inserts, evictions, live, cache.recovered);
+        disk_cache_close(&cache);
+    }
+    remove(DISK_CACHE_BENCH_PATH);
+}
+
+// NOTE: Text runs, timed per run and reported per glyph of the run
+static void bench_text_runs(Bench *bench)
+{
+    Arena *scratch = get_scratch_arena();
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        Stage layout_stage;
+        Stage run_stage;
+        begin_stage(&layout_stage, "layout_text", RUN_REPEAT);
+        begin_stage(&run_stage, "render_text_run", RUN_REPEAT);
+        v2i run_size = {};
+        i32 run_glyphs = 1;
+        for(i32 r = 0; r < RUN_REPEAT; ++r)
+        {
+            Sample sample = begin_sample();
+            TextRun run = layout_text(scratch, bench->font, bench_run_text, bench->sizes[s]);
+            run_glyphs = MAX(run.glyph_count, 1);
+            end_sample(&layout_stage, sample, run_glyphs);
+
+            v2f origin = {};
+            sample = begin_sample();
+            render_text_run(scratch, bench->font, run, RASTER_COVERAGE, &run_size, &origin);
+            end_sample(&run_stage, sample, run_glyphs);
+            arena_reset(scratch);
+        }
+        layout_stage.allocations /= run_glyphs;
+        layout_stage.bytes /= run_glyphs;
+        run_stage.allocations /= run_glyphs;
+        run_stage.bytes /= run_glyphs;
+        char title[128];
+        snprintf(title, sizeof(title), "\ntext run %gpx (%d glyphs, %dx%d bitmap)",
+                 bench->sizes[s], run_glyphs, run_size.x, run_size.y);
+        print_header(title);
+        print_stage(&layout_stage);
+        print_stage(&run_stage);
+    }
+}
+
+// NOTE: A run goes through the rasterizer as one outline, so glyphs drawn
+// over each other have to stay filled where they overlap. The second O is
+// moved back by half an advance and every pixel inside both Os on their own
+// is checked in the bitmap of the pair
+static void bench_overlap(Bench *bench)
+{
+    Arena *scratch = get_scratch_arena();
+    fprintf(stdout, "\noverlapping glyphs (\"OO\", second one half an advance back)\n");
+    RasterMode overlap_modes[] = { RASTER_BINARY, RASTER_FIXED, RASTER_COVERAGE };
+    const char *overlap_mode_names[] = { "binary", "fixed", "coverage" };
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        for(i32 m = 0; m < 3; ++m)
+        {
+            TextRun pair = layout_text(scratch, bench->font, "OO", bench->sizes[s]);
+            if(pair.glyph_count != 2) break;
+            pair.glyphs[1].x = pair.glyphs[0].x + 0.5f*pair.glyphs[0].advance;
+
+            v2i pair_size = {};
+            v2f pair_origin = {};
+            u8 *pair_bitmap = render_text_run(scratch, bench->font, pair, overlap_modes[m], &pair_size, &pair_origin);
+            u8 *single_bitmaps[2];
+            v2i single_sizes[2];
+            v2i single_offsets[2];
+            for(i32 g = 0; g < 2; ++g)
+            {
+                TextRun single = pair;
+                single.glyphs = pair.glyphs + g;
+                single.glyph_count = 1;
+                v2f single_origin = {};
+                single_bitmaps[g] = render_text_run(scratch, bench->font, single, overlap_modes[m],
+                                                    single_sizes + g, &single_origin);
+                // NOTE: Both origins are whole pixels
+                single_offsets[g].x = (i32)(pair_origin.x - single_origin.x);
+                single_offsets[g].y = (i32)(pair_origin.y - single_origin.y);
+            }
+
+            u64 inside_both = 0;
+            u64 unfilled = 0;
+            for(i32 y = 0; pair_bitmap && y < pair_size.y; ++y)
+            {
+                for(i32 x = 0; x < pair_size.x; ++x)
+                {
+                    i32 inside = 1;
+                    for(i32 g = 0; g < 2; ++g)
+                    {
+                        i32 gx = x - single_offsets[g].x;
+                        i32 gy = y - single_offsets[g].y;
+                        inside = inside && gx >= 0 && gx < single_sizes[g].x && gy >= 0 && gy < single_sizes[g].y &&
+                                 single_bitmaps[g][gy*single_sizes[g].x + gx] == 255;
+                    }
+                    inside_both += inside;
+                    unfilled += inside && pair_bitmap[y*pair_size.x + x] != 255;
+                }
+            }
+            fprintf(stdout, "  %-8s %5gpx %8llu pixels inside both, %llu not filled\n",
+                    overlap_mode_names[m], bench->sizes[s], inside_both, unfilled);
+            if(unfilled)
+            {
+                fprintf(stderr, "%s %gpx: overlapping glyphs not filled\n", overlap_mode_names[m], bench->sizes[s]);
+                ++bench->failures;
+            }
+            arena_reset(scratch);
+        }
+    }
+}
+
+// NOTE: Subpixel positioned text through the atlas. The same run is drawn on
+// RUN_REPEAT lines, each one starting at a different fraction of a pixel,
+// with 1 to 8 horizontal phases per glyph. The first time through gives the
+// hit rate of the phases and the cost of the misses, the atlas has room for
+// every phase of the run so the second time only hits
+static void bench_subpixel_atlas(Bench *bench)
+{
+    Font *font = bench->font;
+    Arena *scratch = get_scratch_arena();
+    i32 phase_counts[] = { 1, 2, 4, 8 };
+    i32 phase_count_count = (i32)(sizeof(phase_counts)/sizeof(phase_counts[0]));
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        f32 pixel_size = bench->sizes[s];
+        TextRun run = layout_text(scratch, font, bench_run_text, pixel_size);
+        u16 *run_glyph_indices = ARENA_PUSH_ARRAY(scratch, u16, run.glyph_count);
+        for(i32 i = 0; i < run.glyph_count; ++i)
+        {
+            run_glyph_indices[i] = run.glyphs[i].glyph_index;
+        }
+        fprintf(stdout, "\nsubpixel atlas %gpx (%d glyphs x %d lines)\n", pixel_size, run.glyph_count, RUN_REPEAT);
+        for(i32 p = 0; p < phase_count_count; ++p)
+        {
+            i32 pages = get_bench_atlas_pages(font, run_glyph_indices, run.glyph_count, pixel_size, phase_counts[p]);
+            Atlas atlas = atlas_create(BENCH_ATLAS_PAGE_SIZE, BENCH_ATLAS_PAGE_SIZE, pages,
+                                       run.glyph_count*phase_counts[p], RASTER_COVERAGE, phase_counts[p], 1);
+            f64 pass_ns[2] = {};
+            u64 first_hits = 0;
+            u64 first_misses = 0;
+            for(i32 pass = 0; pass < 2; ++pass)
+            {
+                u64 start = get_time_ns();
+                for(i32 r = 0; r < RUN_REPEAT; ++r)
+                {
+                    f32 line_x = 0.37f*r;
+                    for(i32 i = 0; i < run.glyph_count; ++i)
+                    {
+                        LayoutGlyph *glyph = run.glyphs + i;
+                        v2f pen = { line_x + glyph->x, glyph->y };
+                        v2i pixel = {};
+                        AtlasKey key = atlas_key(&atlas, glyph->glyph_index, (u16)pixel_size, pen, &pixel);
+                        AtlasEntry *entry = atlas_get(&atlas, font, key);
+                        bench_sink += entry ? pixel.x + (i32)entry->bearing_x : 0;
+                    }
+                }
+                pass_ns[pass] = (f64)(get_time_ns() - start);
+                if(!pass)
+                {
+                    first_hits = atlas.hits;
+                    first_misses = atlas.misses;
+                }
+            }
+            u64 lookups = first_hits + first_misses;
+            fprintf(stdout, "  %d phases %8.1f ns/hit %10.1f ns/glyph first time %6.2f%% hit rate %5d entries %8.1f KB pixels  max error %.3f px\n",
+                    phase_counts[p], lookups ? pass_ns[1] / lookups : 0.0, lookups ? pass_ns[0] / lookups : 0.0,
+                    lookups ? 100.0*first_hits / lookups : 0.0, atlas.entry_count,
+                    atlas.glyph_pixels / 1024.0, 0.5f/phase_counts[p]);
+            if(atlas.misses != first_misses)
+            {
+                fprintf(stdout, "  (%llu misses the second time, the atlas is too small)\n",
+                        atlas.misses - first_misses);
+            }
+            atlas_destroy(&atlas);
+        }
+        arena_reset(scratch);
+    }
+}
+
+// NOTE: Compositing. Lines of the run are drawn from the atlas until they
+// fill a 1080p image (the last ones clipped), every third line at half
+// alpha. Every kernel with and without gamma tables, checked byte for byte
+// against the scalar one
+static void bench_composite(Bench *bench)
+{
+    Font *font = bench->font;
+    Arena *scratch = get_scratch_arena();
+    const char *kernel_names[] = { "scalar", "sse2", "avx2" };
+    CompositeKernel best_kernel = get_composite_kernel();
+    CompositeGamma *gamma = (CompositeGamma *)malloc(sizeof(CompositeGamma));
+    build_composite_gamma(gamma, 0);
+    u32 *pixels = (u32 *)malloc(COMPOSITE_BENCH_WIDTH*COMPOSITE_BENCH_HEIGHT*sizeof(u32));
+    u32 *reference = (u32 *)malloc(COMPOSITE_BENCH_WIDTH*COMPOSITE_BENCH_HEIGHT*sizeof(u32));
+    CompositeTarget target = composite_target(pixels, COMPOSITE_BENCH_WIDTH, COMPOSITE_BENCH_HEIGHT,
+                                              COMPOSITE_BENCH_WIDTH);
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        f32 pixel_size = bench->sizes[s];
+        TextRun run = layout_text(scratch, font, bench_run_text, pixel_size);
+        Atlas atlas = atlas_create(1024, 1024, 8, 4096, RASTER_COVERAGE, 1, 1);
+        i32 line_height = (i32)run.line_height + 1;
+        i32 run_width = (i32)run.width + 1;
+        i32 runs_per_line = COMPOSITE_BENCH_WIDTH / run_width + 1;
+        i32 line_count = COMPOSITE_BENCH_HEIGHT / line_height + 1;
+        i32 draw_capacity = runs_per_line*line_count*run.glyph_count;
+        CompositeDraw *draws = (CompositeDraw *)malloc(draw_capacity*sizeof(CompositeDraw));
+        i32 draw_count = 0;
+        u64 draw_pixels = 0;
+        for(i32 line = 0; line < line_count; ++line)
+        {
+            u32 color = line % 3 == 2 ? COMPOSITE_RGBA(200, 40, 40, 128) : COMPOSITE_RGBA(20, 20, 60, 255);
+            i32 baseline = (line + 1)*line_height;
+            for(i32 r = 0; r < runs_per_line; ++r)
+            {
+                for(i32 i = 0; i < run.glyph_count; ++i)
+                {
+                    LayoutGlyph *glyph = run.glyphs + i;
+                    v2f pen = { (f32)(r*run_width) + glyph->x, 0 };
+                    v2i pixel = {};
+                    AtlasKey key = atlas_key(&atlas, glyph->glyph_index, (u16)pixel_size, pen, &pixel);
+                    AtlasEntry *entry = atlas_get(&atlas, font, key);
+                    if(!entry || !entry->width || !entry->height) continue;
+
+                    CompositeDraw *draw = draws + draw_count++;
+                    draw->coverage = atlas.pages[entry->page].pixels + entry->y*atlas.page_width + entry->x;
+                    draw->width = entry->width;
+                    draw->height = entry->height;
+                    draw->stride = atlas.page_width;
+                    draw->x = pixel.x + (i32)entry->bearing_x;
+                    draw->y = baseline - (i32)entry->bearing_y - entry->height;
+                    draw->color = color;
+                    draw_pixels += entry->width*entry->height;
+                }
+            }
+        }
+
+        fprintf(stdout, "\ncomposite %gpx (%d draws, %.1f Mpixels of coverage)\n",
+                pixel_size, draw_count, draw_pixels / 1000000.0);
+        for(i32 g = 0; g < 2; ++g)
+        {
+            for(i32 k = COMPOSITE_SCALAR; k <= (i32)best_kernel; ++k)
+            {
+                set_composite_kernel((CompositeKernel)k);
+                // NOTE: Fastest pass, the fill in between evicts the cache the same
+                // way every time
+                u64 best_ns = ~0ull;
+                for(i32 r = 0; r < COMPOSITE_BENCH_REPEAT; ++r)
+                {
+                    composite_fill(&target, COMPOSITE_RGBA(240, 240, 230, 255));
+                    u64 start = get_time_ns();
+                    composite_draws(&target, g ? gamma : 0, draws, draw_count);
+                    best_ns = MIN(best_ns, get_time_ns() - start);
+                }
+
+                u64 mismatch = 0;
+                if(k == COMPOSITE_SCALAR)
+                {
+                    memcpy(reference, pixels, COMPOSITE_BENCH_WIDTH*COMPOSITE_BENCH_HEIGHT*sizeof(u32));
+                }
+                else
+                {
+                    for(i32 p = 0; p < COMPOSITE_BENCH_WIDTH*COMPOSITE_BENCH_HEIGHT; ++p)
+                    {
+                        mismatch += pixels[p] != reference[p];
+                    }
+                }
+                fprintf(stdout, "  %-6s %-6s %8.3f ms %8.2f ns/pixel %8.1f Mpixels/s %10llu pixels differ\n",
+                        kernel_names[k], g ? "gamma" : "plain", best_ns / 1000000.0,
+                        draw_pixels ? (f64)best_ns / draw_pixels : 0.0,
+                        best_ns ? draw_pixels*1000.0 / best_ns : 0.0, mismatch);
+                if(mismatch)
+                {
+                    ++bench->failures;
+                }
+            }
+        }
+        set_composite_kernel(best_kernel);
+        free(draws);
+        atlas_destroy(&atlas);
+        arena_reset(scratch);
+    }
+    free(reference);
+    free(pixels);
+    free(gamma);
+}
+
+// NOTE: Distance fields, generated once per glyph and sampled at every size.
+// Compared with the coverage rasterizer at the same size and with one bitmap
+// per size in memory
+static void bench_sdf(Bench *bench)
+{
+    Glyph *glyphs = bench->glyphs;
+    i32 code_point_count = bench->code_point_count;
+    Arena *scratch = get_scratch_arena();
+
+    f32 sdf_scale = scale_pixel_height(bench->hhea, SDF_BENCH_SIZE);
+    Arena field_arena = {};
+    SdfBitmap *fields = (SdfBitmap *)malloc(code_point_count*sizeof(SdfBitmap));
+    Stage shape_stage;
+    Stage field_stage;
+    begin_stage(&shape_stage, "build_sdf_shape", code_point_count);
+    begin_stage(&field_stage, "generate_sdf_rows", code_point_count);
+    u64 lines_measured = 0;
+    u64 lines_brute_force = 0;
+    u64 field_bytes = 0;
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        Sample sample = begin_sample();
+        SdfShape shape = build_sdf_shape(scratch, glyphs[i], sdf_scale, SDF_BENCH_SPREAD);
+        end_sample(&shape_stage, sample, 1);
+
+        fields[i] = push_sdf_bitmap(&field_arena, &shape, glyphs[i], sdf_scale);
+        if(fields[i].pixels)
+        {
+            sample = begin_sample();
+            generate_sdf_rows(&shape, fields[i].pixels, 0, shape.height);
+            end_sample(&field_stage, sample, 1);
+            field_bytes += fields[i].width*fields[i].height;
+            for(i32 y = 0; y < shape.height; ++y)
+            {
+                i32 *cell_row = shape.cell_start + (y / SDF_CELL_SIZE)*shape.cells_x;
+                for(i32 x = 0; x < shape.width; ++x)
+                {
+                    lines_measured += cell_row[x / SDF_CELL_SIZE + 1] - cell_row[x / SDF_CELL_SIZE];
+                }
+            }
+            lines_brute_force += (u64)shape.line_count*shape.width*shape.height;
+        }
+        arena_reset(scratch);
+    }
+
+    char title[128];
+    snprintf(title, sizeof(title), "\nsdf %gpx spread %g (%.1f KB, %.1f of %.1f lines measured/pixel)",
+             SDF_BENCH_SIZE, SDF_BENCH_SPREAD, field_bytes / 1024.0,
+             field_bytes ? (f64)lines_measured / field_bytes : 0.0,
+             field_bytes ? (f64)lines_brute_force / field_bytes : 0.0);
+    print_header(title);
+    print_stage(&shape_stage);
+    print_stage(&field_stage);
+
+    u64 bitmap_bytes = 0;
+    for(i32 s = 0; s < bench->size_count; ++s)
+    {
+        f32 scale = scale_pixel_height(bench->hhea, bench->sizes[s]);
+        Stage sample_stage;
+        Stage render_stage;
+        begin_stage(&sample_stage, "render_sdf_alpha", code_point_count);
+        begin_stage(&render_stage, "render_glyph coverage", code_point_count);
+        u64 pixels = 0;
+        u64 error = 0;
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            if(!fields[i].pixels) continue;
+            v2i sampled_size = {};
+            Sample sample = begin_sample();
+            u8 *sampled = render_sdf_alpha(scratch, fields[i], scale, &sampled_size);
+            end_sample(&sample_stage, sample, 1);
+
+            v2i coverage_size = {};
+            sample = begin_sample();
+            u8 *coverage = render_glyph(scratch, glyphs[i], scale, RASTER_COVERAGE, &coverage_size);
+            end_sample(&render_stage, sample, 1);
+
+            i32 pixel_count = sampled_size.x*sampled_size.y;
+            for(i32 p = 0; p < pixel_count; ++p)
+            {
+                error += abs((i32)sampled[p] - (i32)coverage[p]);
+            }
+            pixels += pixel_count;
+            arena_reset(scratch);
+        }
+        bitmap_bytes += pixels;
+
+        snprintf(title, sizeof(title), "\nsdf sampled at %gpx", bench->sizes[s]);
+        print_header(title);
+        print_stage(&sample_stage);
+        print_stage(&render_stage);
+        fprintf(stdout, "  sdf vs coverage: mean abs difference %.2f/255\n",
+                pixels ? (f64)error / pixels : 0.0);
+    }
+    fprintf(stdout, "  one field per glyph %.1f KB, one bitmap per glyph and size %.1f KB\n",
+            field_bytes / 1024.0, bitmap_bytes / 1024.0);
+
+    free(fields);
+    arena_free(&field_arena);
+}
+
+// NOTE: Poster sizes, full bitmap against bands of BAND_BENCH_ROWS rows. The
+// scratch arena starts empty every time so the bytes it allocates are the
+// peak memory of the render
+static void bench_bands(Bench *bench)
+{
+    Font *font = bench->font;
+    f32 band_sizes[] = { 1000, 4000, 8000 };
+    u16 glyph_index = 0;
+    for(i32 i = 0; i < bench->code_point_count; ++i)
+    {
+        if(bench->code_points[i] == BAND_BENCH_CODE_POINT) glyph_index = bench->glyph_indices[i];
+    }
+    fprintf(stdout, "\nbanded raster (U+%04X, %d row bands)\n", BAND_BENCH_CODE_POINT, BAND_BENCH_ROWS);
+    fprintf(stdout, "  %-22s %10s %12s %10s %12s %8s\n",
+            "size", "full ms", "full bytes", "band ms", "band bytes", "max diff");
+    for(i32 m = 0; m < 2; ++m)
+    {
+        RasterMode band_mode = m ? RASTER_COVERAGE : RASTER_BINARY;
+        for(i32 s = 0; s < (i32)(sizeof(band_sizes)/sizeof(band_sizes[0])); ++s)
+        {
+            f32 scale = scale_pixel_height(bench->hhea, band_sizes[s]);
+
+            free_scratch_arena();
+            Glyph glyph = get_font_glyph(get_scratch_arena(), font, glyph_index);
+            u64 bytes = font_allocated_bytes;
+            u64 start = get_time_ns();
+            v2i size = {};
+            u8 *bitmap = render_glyph(get_scratch_arena(), glyph, scale, band_mode, &size);
+            u64 full_ns = get_time_ns() - start;
+            u64 full_bytes = font_allocated_bytes - bytes;
+
+            BandCheck check = {};
+            check.reference = (u8 *)malloc((u64)size.x*size.y);
+            memcpy(check.reference, bitmap, (u64)size.x*size.y);
+
+            free_scratch_arena();
+            glyph = get_font_glyph(get_scratch_arena(), font, glyph_index);
+            bytes = font_allocated_bytes;
+            start = get_time_ns();
+            render_glyph_bands(glyph, scale, band_mode, BAND_BENCH_ROWS, skip_band, 0);
+            u64 band_ns = get_time_ns() - start;
+            u64 band_bytes = font_allocated_bytes - bytes;
+            render_glyph_bands(glyph, scale, band_mode, BAND_BENCH_ROWS, check_band, &check);
+            free(check.reference);
+
+            char label[64];
+            snprintf(label, sizeof(label), "%s %gpx %dx%d", m ? "coverage" : "binary",
+                     band_sizes[s], size.x, size.y);
+            fprintf(stdout, "  %-22s %10.3f %12llu %10.3f %12llu %8d\n", label,
+                    (f64)full_ns / 1000000.0, full_bytes, (f64)band_ns / 1000000.0, band_bytes,
+                    check.max_difference);
+            if(check.max_difference)
+            {
+                fprintf(stderr, "%s: bands differ from the full bitmap\n", label);
+                ++bench->failures;
+            }
+        }
+    }
+    free_scratch_arena();
+}
+
+// NOTE: Cold start of a render worker, every codepoint at every size. From
+// the font: open, char map, hmtx and an atlas filled by the rasterizer. From
+// a baked pack: open and look every glyph up
+static void bench_cold_start(Bench *bench)
+{
+    Font *font = bench->font;
+    u16 *code_points = bench->code_points;
+    i32 code_point_count = bench->code_point_count;
+    i32 size_count = bench->size_count;
+
+    u32 *pack_code_points = (u32 *)malloc(code_point_count*sizeof(u32));
+    u16 pixel_sizes[MAX_SIZES];
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        pack_code_points[i] = code_points[i];
+    }
+    for(i32 s = 0; s < size_count; ++s)
+    {
+        pixel_sizes[s] = (u16)bench->sizes[s];
+    }
+
+    u64 start = get_time_ns();
+    i32 baked = bake_font_pack(PACK_BENCH_PATH, font, pack_code_points, code_point_count,
+                               pixel_sizes, size_count, RASTER_COVERAGE, 2048, 64);
+    u64 bake_ns = get_time_ns() - start;
+
+    start = get_time_ns();
+    Font cold_font = {};
+    open_font(bench->font_path, &cold_font);
+    CharMap *cold_char_map = get_font_char_map(&cold_font);
+    get_font_hmtx(&cold_font);
+    Atlas atlas = atlas_create(2048, 2048, 64, code_point_count*size_count, RASTER_COVERAGE, 1, 1);
+    for(i32 s = 0; s < size_count; ++s)
+    {
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            AtlasKey key = { char_map_lookup(cold_char_map, code_points[i]), pixel_sizes[s], 0 };
+            AtlasEntry *entry = atlas_get(&atlas, &cold_font, key);
+            bench_sink += entry ? entry->width : 0;
+        }
+    }
+    u64 font_ns = get_time_ns() - start;
+    atlas_destroy(&atlas);
+    close_font(&cold_font);
+
+    fprintf(stdout, "\ncold start (%d codepoints x %d sizes)\n", code_point_count, size_count);
+    fprintf(stdout, "  font + atlas fill        %10.3f ms\n", (f64)font_ns / 1000000.0);
+    if(baked)
+    {
+        for(i32 check = 0; check < 2; ++check)
+        {
+            start = get_time_ns();
+            FontPack pack = {};
+            i32 opened = open_font_pack(PACK_BENCH_PATH, check ? &font->file : 0, &pack);
+            u64 open_ns = get_time_ns() - start;
+            for(i32 s = 0; opened && s < size_count; ++s)
+            {
+                for(i32 i = 0; i < code_point_count; ++i)
+                {
+                    PackGlyph *glyph = pack_find_glyph(&pack, pixel_sizes[s], pack_glyph_index(&pack, code_points[i]));
+                    bench_sink += glyph ? glyph->width : 0;
+                }
+            }
+            u64 pack_ns = get_time_ns() - start;
+            fprintf(stdout, "  pack%-20s %10.3f ms (open %.3f ms, %u bytes%s)\n",
+                    check ? " + source hash" : "", (f64)pack_ns / 1000000.0, (f64)open_ns / 1000000.0,
+                    pack.file.size, pack.file.mapped ? " mapped" : "");
+            close_font_pack(&pack);
+        }
+        fprintf(stdout, "  bake_font_pack           %10.3f ms\n", (f64)bake_ns / 1000000.0);
+    }
+    else
+    {
+        fprintf(stdout, "  cannot bake %s\n", PACK_BENCH_PATH);
+    }
+    remove(PACK_BENCH_PATH);
+    free(pack_code_points);
+}
+
+// NOTE: Every codepoint at every size as one batch, on one thread, on every
+// cpu and on more threads than cpus so workers run out of their own range and
+// steal even on a small host. Every result has to match a serial
+// render_glyph of the same job
+static void bench_batch(Bench *bench)
+{
+    i32 code_point_count = bench->code_point_count;
+    i32 size_count = bench->size_count;
+    Arena *scratch = get_scratch_arena();
+
+    i32 job_count = code_point_count*size_count;
+    BatchJob *jobs = (BatchJob *)malloc(job_count*sizeof(BatchJob));
+    BatchResult *results = (BatchResult *)malloc(job_count*sizeof(BatchResult));
+    for(i32 s = 0; s < size_count; ++s)
+    {
+        for(i32 i = 0; i < code_point_count; ++i)
+        {
+            jobs[s*code_point_count + i].glyph_index = bench->glyph_indices[i];
+            jobs[s*code_point_count + i].pixel_size = bench->sizes[s];
+        }
+    }
+    fprintf(stdout, "\nbatch_render (%d jobs)\n", job_count);
+    i32 batch_thread_counts[] = { 1, 0, 4 };
+    i32 batch_pass_count = (i32)(sizeof(batch_thread_counts)/sizeof(batch_thread_counts[0]));
+    f64 single_thread_ns = 0;
+    for(i32 pass = 0; pass < batch_pass_count; ++pass)
+    {
+        BatchPool *pool = batch_create(batch_thread_counts[pass]);
+        // NOTE: First batch grows the worker arenas, the second one is timed
+        batch_render(pool, bench->font, RASTER_COVERAGE, jobs, job_count, results);
+        u64 stolen = batch_stolen_jobs(pool);
+        u64 start = get_time_ns();
+        batch_render(pool, bench->font, RASTER_COVERAGE, jobs, job_count, results);
+        f64 ns = (f64)(get_time_ns() - start);
+        if(!pass) single_thread_ns = ns;
+
+        i32 differ = 0;
+        for(i32 s = 0; s < size_count; ++s)
+        {
+            f32 scale = scale_pixel_height(bench->hhea, bench->sizes[s]);
+            for(i32 i = 0; i < code_point_count; ++i)
+            {
+                BatchResult *result = results + s*code_point_count + i;
+                ArenaTemp temp = arena_begin_temp(scratch);
+                v2i size = {};
+                u8 *bitmap = render_glyph(scratch, bench->glyphs[i], scale, RASTER_COVERAGE, &size);
+                if(size.x != result->width || size.y != result->height ||
+                   !bitmap != !result->bitmap ||
+                   (bitmap && memcmp(bitmap, result->bitmap, (size_t)size.x*size.y)))
+                {
+                    ++differ;
+                }
+                arena_end_temp(temp);
+            }
+        }
+
+        fprintf(stdout, "  %3d threads %10.3f ms %12.0f glyphs/sec %6.2fx %8llu jobs stolen %6d differ\n",
+                batch_thread_count(pool), ns / 1000000.0, job_count / (ns / 1000000000.0),
+                single_thread_ns / ns, batch_stolen_jobs(pool) - stolen, differ);
+        if(differ)
+        {
+            fprintf(stderr, "batch_render on %d threads differs from render_glyph on %d jobs\n",
+                    batch_thread_count(pool), differ);
+            ++bench->failures;
+        }
+        batch_destroy(pool);
+    }
+    free(results);
+    free(jobs);
+}
+
+int main(int argc, char **argv)
+{
+    const char *font_path = "fonts/UbuntuMono-Regular.ttf";
+    f32 sizes[MAX_SIZES] = { 12, 24, 100, 400 };
+    i32 size_count = 4;
+
+    for(i32 i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-f") && i + 1 < argc)
+        {
+            font_path = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            size_count = 0;
+            char *token = strtok(argv[++i], ",");
+            while(token && size_count < MAX_SIZES)
+            {
+                sizes[size_count++] = (f32)atof(token);
+                token = strtok(0, ",");
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-f font.ttf] [-s 12,24,100,400]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    u64 open_start = get_time_ns();
+    Font font = {};
+    if(!open_font(font_path, &font))
+    {
+        fprintf(stderr, "cannot open font %s\n", font_path);
+        return 1;
+    }
+    u64 open_ns = get_time_ns() - open_start;
+
+    Bench bench = {};
+    bench.font = &font;
+    bench.font_path = font_path;
+    bench.format = load_format4(font.font_dir, load_cmap_table(font.font_dir));
+    bench.hhea = *get_font_hhea(&font);
+    bench.code_points = (u16 *)malloc(0x10000*sizeof(u16));
+    bench.code_point_count = collect_code_points(bench.format, bench.code_points);
+    bench.glyphs = (Glyph *)malloc(bench.code_point_count*sizeof(Glyph));
+    bench.glyph_indices = (u16 *)malloc(bench.code_point_count*sizeof(u16));
+    bench.sizes = sizes;
+    bench.size_count = size_count;
+
+    fprintf(stdout, "font: %s, %d mapped codepoints, opened in %llu ns\n\n",
+            font_path, bench.code_point_count, open_ns);
+
+    // NOTE: Decoded glyphs stay alive for the whole run, everything per size
+    // goes to the scratch arena and is reset after every glyph
+    Arena glyph_arena = {};
+    print_header("lookup and decode");
+    bench_lookup(&bench);
+    bench_decode(&bench, &glyph_arena);
+    bench_coordinate_decoders(&bench);
+    bench_glyph_info(&bench);
+    bench_raster(&bench);
+    bench_spans(&bench);
+    bench_atlas(&bench);
+    bench_disk_cache(&bench);
+    bench_text_runs(&bench);
+    bench_overlap(&bench);
+    bench_subpixel_atlas(&bench);
+    bench_composite(&bench);
+    bench_sdf(&bench);
+    bench_bands(&bench);
+    bench_cold_start(&bench);
+    bench_batch(&bench);
+
+    free(bench.glyph_indices);
+    free(bench.glyphs);
+    free(bench.code_points);
+    arena_free(&glyph_arena);
+    free_scratch_arena();
+    close_font(&font);
+
+    if(bench.failures)
+    {
+        fprintf(stderr, "%d checks failed\n", bench.failures);
+        return 1;
+    }
+    return 0;
+}
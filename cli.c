@@ -0,0 +1,643 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "batch.h"
+#include "pack.h"
+#include "composite.h"
+
+// NOTE: Headless batch renderer. Rasterizes a list of codepoints (or every
+// codepoint of a UTF-8 text file) at the requested pixel sizes and writes
+// one PGM per glyph and size
+
+#define MAX_SIZES 32
+// NOTE: Distance field falloff in pixels of the field size
+#define CLI_SDF_SPREAD 4.0f
+#define CLI_PACK_PAGE_SIZE 1024
+#define CLI_PACK_MAX_PAGES 64
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [options] [chars | U+XXXX ...]\n", program);
+    fprintf(stderr, "  -f <font.ttf>   font file (default fonts/UbuntuMono-Regular.ttf)\n");
+    fprintf(stderr, "  -i <face>       face index inside a font collection (default 0)\n");
+    fprintf(stderr, "  -s <12,24,...>  comma separated pixel sizes (default 24)\n");
+    fprintf(stderr, "  -t <file>       render every codepoint of a UTF-8 text file\n");
+    fprintf(stderr, "  -o <dir>        output directory for the PGM files (default .)\n");
+    fprintf(stderr, "  -a              anti-aliased coverage instead of binary pixels\n");
+    fprintf(stderr, "  -x              binary pixels from the fixed point rasterizer, the same on\n");
+    fprintf(stderr, "                  every build (for golden images)\n");
+    fprintf(stderr, "  -n              do not write PGM files, only time the pipeline\n");
+    fprintf(stderr, "  -p              decode every outline of the font when it is opened\n");
+    fprintf(stderr, "  -r <text>       lay out the text and render it as one bitmap (run_<size>.pgm)\n");
+    fprintf(stderr, "  -c <rrggbb>     with -r, blend the run in this colour over white with sRGB\n");
+    fprintf(stderr, "                  gamma and write run_<size>.ppm instead\n");
+    fprintf(stderr, "  -j <threads>    render the whole list as one batch on a thread pool\n");
+    fprintf(stderr, "                  (0 uses every cpu)\n");
+    fprintf(stderr, "  -d <size>       render one distance field per glyph at this pixel size and\n");
+    fprintf(stderr, "                  sample it at every -s size (also writes sdf_uXXXX.pgm),\n");
+    fprintf(stderr, "                  with -j the rows of every field are split between threads\n");
+    fprintf(stderr, "  -b <file.pack>  bake the glyphs at every size into a font pack\n");
+    fprintf(stderr, "  -l <file.pack>  write the glyphs from a baked pack, the font is not opened\n");
+    fprintf(stderr, "  -B <rows>       rasterize in bands of this many rows and stream them into the\n");
+    fprintf(stderr, "                  PGM files, for glyphs too big to keep in memory\n");
+    fprintf(stderr, "  -S <file.json>  write the pipeline counters and stage histograms (- for stdout)\n");
+}
+
+static i32 parse_sizes(char *list, f32 *sizes)
+{
+    i32 count = 0;
+    char *token = strtok(list, ",");
+    while(token && count < MAX_SIZES)
+    {
+        f32 size = (f32)atof(token);
+        if(size > 0)
+        {
+            sizes[count++] = size;
+        }
+        token = strtok(0, ",");
+    }
+    return count;
+}
+
+typedef struct
+{
+    u32 *code_points;
+    i32 count;
+    i32 capacity;
+} CodePointList;
+
+static void push_code_point(CodePointList *list, u32 code_point)
+{
+    // NOTE: Only keep one copy of every codepoint, the output is per glyph
+    for(i32 i = 0; i < list->count; ++i)
+    {
+        if(list->code_points[i] == code_point) return;
+    }
+    if(list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity*2 : 128;
+        list->code_points = (u32 *)realloc(list->code_points, list->capacity*sizeof(u32));
+    }
+    list->code_points[list->count++] = code_point;
+}
+
+static void push_utf8_text(CodePointList *list, const char *text)
+{
+    u32 code_point = 0;
+    i32 length = 0;
+    while((length = utf8_decode(text, &code_point)))
+    {
+        if(code_point >= 0x20)
+        {
+            push_code_point(list, code_point);
+        }
+        text += length;
+    }
+}
+
+static void write_pgm(const char *path, u8 *bitmap, i32 width, i32 height)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", width, height);
+    // NOTE: The rasterizer works with y up, PGM rows go from top to bottom
+    for(i32 y = height - 1; y >= 0; --y)
+    {
+        fwrite(bitmap + y*width, 1, width, file);
+    }
+    fclose(file);
+}
+
+// NOTE: The target is opaque, the alpha byte is dropped
+static void write_ppm(const char *path, u32 *pixels, i32 width, i32 height)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for(i32 i = 0; i < width*height; ++i)
+    {
+        u8 rgb[3] = { (u8)pixels[i], (u8)(pixels[i] >> 8), (u8)(pixels[i] >> 16) };
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+    fclose(file);
+}
+
+static void write_stats(const char *path)
+{
+    FontStats stats;
+    get_font_stats(&stats);
+    i32 length = format_font_stats_json(&stats, 0, 0);
+    char *json = (char *)malloc(length + 1);
+    format_font_stats_json(&stats, json, length + 1);
+
+    FILE *file = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+    if(!file)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+    }
+    else
+    {
+        fprintf(file, "%s\n", json);
+        if(file != stdout) fclose(file);
+    }
+    free(json);
+}
+
+// NOTE: Band sink for -B. The header goes out first and every band row is
+// written at its final place, bands come bottom up and PGM rows top down
+typedef struct
+{
+    FILE *file;
+    long header_size;
+    i32 height;
+} PgmBandWriter;
+
+static void write_pgm_band(void *user_data, u8 *rows, i32 row_begin, i32 row_count, i32 width)
+{
+    PgmBandWriter *writer = (PgmBandWriter *)user_data;
+    for(i32 y = 0; y < row_count; ++y)
+    {
+        fseek(writer->file, writer->header_size + (long)(writer->height - 1 - (row_begin + y))*width, SEEK_SET);
+        fwrite(rows + y*width, 1, width, writer->file);
+    }
+}
+
+static v2i write_pgm_bands(const char *path, Glyph glyph, f32 scale, RasterMode mode, i32 band_rows)
+{
+    v2i size = get_glyph_bitmap_size(glyph, scale);
+    PgmBandWriter writer = {};
+    writer.file = fopen(path, "wb");
+    if(!writer.file)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return size;
+    }
+    writer.header_size = fprintf(writer.file, "P5\n%d %d\n255\n", size.x, size.y);
+    writer.height = size.y;
+    // NOTE: Glyphs without contours still get a blank file of the right size
+    if(glyph.number_of_contours <= 0 && size.x > 0 && size.y > 0)
+    {
+        fseek(writer.file, writer.header_size + (long)size.x*size.y - 1, SEEK_SET);
+        fputc(0, writer.file);
+    }
+    render_glyph_bands(glyph, scale, mode, band_rows, write_pgm_band, &writer);
+    fclose(writer.file);
+    return size;
+}
+
+// NOTE: Copies every glyph out of the pack pages, the render workers path
+static i32 write_pack_glyphs(const char *pack_path, const char *output_dir, i32 write_output,
+                             CodePointList *list, f32 *sizes, i32 size_count)
+{
+    u64 open_start = get_time_ns();
+    FontPack pack = {};
+    if(!open_font_pack(pack_path, 0, &pack))
+    {
+        fprintf(stderr, "cannot open pack %s\n", pack_path);
+        return 1;
+    }
+    u64 open_ns = get_time_ns() - open_start;
+
+    i32 glyph_count = 0;
+    u64 lookup_ns = 0;
+    Arena *scratch = get_scratch_arena();
+    for(i32 s = 0; s < size_count; ++s)
+    {
+        for(i32 c = 0; c < list->count; ++c)
+        {
+            u32 code_point = list->code_points[c];
+            u64 start = get_time_ns();
+            PackGlyph *glyph = pack_find_glyph(&pack, (u32)sizes[s], pack_glyph_index(&pack, code_point));
+            lookup_ns += get_time_ns() - start;
+            if(!glyph)
+            {
+                fprintf(stderr, "U+%04X at %gpx is not in %s\n", code_point, sizes[s], pack_path);
+                continue;
+            }
+            ++glyph_count;
+
+            if(write_output && glyph->page != PACK_NO_PAGE)
+            {
+                u8 *page = pack_page(&pack, glyph->page);
+                u8 *bitmap = ARENA_PUSH_ARRAY(scratch, u8, glyph->width*glyph->height);
+                for(i32 row = 0; row < glyph->height; ++row)
+                {
+                    memcpy(bitmap + row*glyph->width,
+                           page + (glyph->y + row)*pack.header->page_width + glyph->x, glyph->width);
+                }
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/u%04X_%d.pgm", output_dir, code_point, (i32)sizes[s]);
+                write_pgm(path, bitmap, glyph->width, glyph->height);
+                arena_reset(scratch);
+            }
+        }
+    }
+
+    fprintf(stdout, "pack: %s (%u bytes%s)\n", pack_path, pack.file.size, pack.file.mapped ? ", mapped" : "");
+    fprintf(stdout, "open: %.3f ms\n", (f64)open_ns / 1000000.0);
+    fprintf(stdout, "glyphs: %d looked up in %.3f ms\n", glyph_count, (f64)lookup_ns / 1000000.0);
+
+    free_scratch_arena();
+    close_font_pack(&pack);
+    free(list->code_points);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *font_path = "fonts/UbuntuMono-Regular.ttf";
+    const char *output_dir = ".";
+    i32 write_output = 1;
+    i32 predecode = 0;
+    const char *run_text = 0;
+    const char *run_color = 0;
+    RasterMode mode = RASTER_BINARY;
+    f32 sizes[MAX_SIZES] = { 24 };
+    i32 size_count = 1;
+    i32 thread_count = -1;
+    f32 sdf_size = 0;
+    const char *bake_path = 0;
+    const char *pack_path = 0;
+    const char *stats_path = 0;
+    i32 band_rows = 0;
+    u32 face_index = 0;
+    CodePointList list = {};
+
+    for(i32 i = 1; i < argc; ++i)
+    {
+        char *arg = argv[i];
+        if(arg[0] == '-' && arg[1] && !arg[2] && arg[1] != 'n' && arg[1] != 'a' && arg[1] != 'p' && arg[1] != 'x' && i + 1 >= argc)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        if(!strcmp(arg, "-f"))
+        {
+            font_path = argv[++i];
+        }
+        else if(!strcmp(arg, "-i"))
+        {
+            face_index = (u32)atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "-s"))
+        {
+            size_count = parse_sizes(argv[++i], sizes);
+        }
+        else if(!strcmp(arg, "-o"))
+        {
+            output_dir = argv[++i];
+        }
+        else if(!strcmp(arg, "-n"))
+        {
+            write_output = 0;
+        }
+        else if(!strcmp(arg, "-j"))
+        {
+            thread_count = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "-d"))
+        {
+            sdf_size = (f32)atof(argv[++i]);
+        }
+        else if(!strcmp(arg, "-b"))
+        {
+            bake_path = argv[++i];
+        }
+        else if(!strcmp(arg, "-B"))
+        {
+            band_rows = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "-S"))
+        {
+            stats_path = argv[++i];
+        }
+        else if(!strcmp(arg, "-l"))
+        {
+            pack_path = argv[++i];
+        }
+        else if(!strcmp(arg, "-r"))
+        {
+            run_text = argv[++i];
+        }
+        else if(!strcmp(arg, "-c"))
+        {
+            run_color = argv[++i];
+        }
+        else if(!strcmp(arg, "-p"))
+        {
+            predecode = 1;
+        }
+        else if(!strcmp(arg, "-a"))
+        {
+            mode = RASTER_COVERAGE;
+        }
+        else if(!strcmp(arg, "-x"))
+        {
+            mode = RASTER_FIXED;
+        }
+        else if(!strcmp(arg, "-t"))
+        {
+            u32 text_size = 0;
+            char *text = read_entire_file(argv[++i], &text_size);
+            if(!text)
+            {
+                fprintf(stderr, "cannot read %s\n", argv[i]);
+                return 1;
+            }
+            char *terminated = (char *)malloc(text_size + 1);
+            memcpy(terminated, text, text_size);
+            terminated[text_size] = 0;
+            push_utf8_text(&list, terminated);
+            free(terminated);
+            font_free(text);
+        }
+        else if((arg[0] == 'U' || arg[0] == 'u') && arg[1] == '+')
+        {
+            push_code_point(&list, (u32)strtoul(arg + 2, 0, 16));
+        }
+        else if(arg[0] == '-')
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            push_utf8_text(&list, arg);
+        }
+    }
+
+    if((!list.count && !run_text) || !size_count)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if(pack_path)
+    {
+        return write_pack_glyphs(pack_path, output_dir, write_output, &list, sizes, size_count);
+    }
+
+    u64 load_start = get_time_ns();
+    u64 load_bytes = font_allocated_bytes;
+
+    FontCollection collection = {};
+    Font font = {};
+    if(!open_font_collection(font_path, &collection) || !open_collection_face(&collection, face_index, &font))
+    {
+        fprintf(stderr, "cannot open face %u of font %s\n", face_index, font_path);
+        return 1;
+    }
+    CharMap *char_map = get_font_char_map(&font);
+    Hhead hhea = *get_font_hhea(&font);
+    if(predecode && !load_font_outlines(&font))
+    {
+        fprintf(stderr, "cannot decode the outlines of %s\n", font_path);
+    }
+
+    if(bake_path)
+    {
+        u16 pixel_sizes[MAX_SIZES];
+        for(i32 s = 0; s < size_count; ++s)
+        {
+            pixel_sizes[s] = (u16)sizes[s];
+        }
+        u64 bake_start = get_time_ns();
+        if(!bake_font_pack(bake_path, &font, list.code_points, list.count, pixel_sizes, size_count, mode,
+                           CLI_PACK_PAGE_SIZE, CLI_PACK_MAX_PAGES))
+        {
+            fprintf(stderr, "cannot bake %s\n", bake_path);
+            return 1;
+        }
+        fprintf(stdout, "baked %s: %d codepoints, %d sizes in %.3f ms\n", bake_path, list.count, size_count,
+                (f64)(get_time_ns() - bake_start) / 1000000.0);
+        close_font(&font);
+        close_font_collection(&collection);
+        free(list.code_points);
+        return 0;
+    }
+
+    u64 load_end = get_time_ns();
+    u64 render_bytes = font_allocated_bytes;
+    u64 render_allocations = font_allocation_count;
+
+    i32 glyph_count = 0;
+    u64 render_ns = 0;
+
+    Arena *scratch = get_scratch_arena();
+
+    if(run_text)
+    {
+        for(i32 s = 0; s < size_count; ++s)
+        {
+            u64 run_start = get_time_ns();
+            TextRun run = layout_text(scratch, &font, run_text, sizes[s]);
+            v2i bitmap_size = {};
+            v2f origin = {};
+            u8 *bitmap = render_text_run(scratch, &font, run, mode, &bitmap_size, &origin);
+            render_ns += get_time_ns() - run_start;
+            glyph_count += run.glyph_count;
+
+            if(write_output && bitmap && run_color)
+            {
+                u32 rgb = (u32)strtoul(run_color, 0, 16);
+                CompositeGamma *gamma = ARENA_PUSH_ARRAY(scratch, CompositeGamma, 1);
+                build_composite_gamma(gamma, 0);
+                u32 *pixels = ARENA_PUSH_ARRAY(scratch, u32, bitmap_size.x*bitmap_size.y);
+                CompositeTarget target = composite_target(pixels, bitmap_size.x, bitmap_size.y, bitmap_size.x);
+                composite_fill(&target, COMPOSITE_RGBA(255, 255, 255, 255));
+
+                CompositeDraw draw = {};
+                draw.coverage = bitmap;
+                draw.width = bitmap_size.x;
+                draw.height = bitmap_size.y;
+                draw.stride = bitmap_size.x;
+                draw.color = COMPOSITE_RGBA(rgb >> 16, (rgb >> 8) & 0xFF, rgb & 0xFF, 255);
+                composite_draws(&target, gamma, &draw, 1);
+
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/run_%d.ppm", output_dir, (i32)sizes[s]);
+                write_ppm(path, pixels, bitmap_size.x, bitmap_size.y);
+            }
+            else if(write_output && bitmap)
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/run_%d.pgm", output_dir, (i32)sizes[s]);
+                write_pgm(path, bitmap, bitmap_size.x, bitmap_size.y);
+            }
+            arena_reset(scratch);
+        }
+    }
+
+    if(sdf_size > 0)
+    {
+        BatchPool *pool = thread_count >= 0 ? batch_create(thread_count) : 0;
+        f32 sdf_scale = scale_pixel_height(hhea, sdf_size);
+        for(i32 c = 0; c < list.count; ++c)
+        {
+            u32 code_point = list.code_points[c];
+            u64 glyph_start = get_time_ns();
+
+            u16 glyph_index = char_map_lookup(char_map, code_point);
+            Glyph glyph = get_font_glyph(scratch, &font, glyph_index);
+            SdfBitmap sdf = {};
+            if(pool)
+            {
+                SdfShape shape = build_sdf_shape(scratch, glyph, sdf_scale, CLI_SDF_SPREAD);
+                sdf = push_sdf_bitmap(scratch, &shape, glyph, sdf_scale);
+                batch_render_sdf(pool, &shape, sdf.pixels);
+            }
+            else
+            {
+                sdf = render_glyph_sdf(scratch, glyph, sdf_scale, CLI_SDF_SPREAD);
+            }
+
+            u8 *bitmaps[MAX_SIZES];
+            v2i bitmap_sizes[MAX_SIZES];
+            for(i32 s = 0; s < size_count; ++s)
+            {
+                f32 scale = scale_pixel_height(hhea, sizes[s]);
+                bitmaps[s] = render_sdf_alpha(scratch, sdf, scale, bitmap_sizes + s);
+            }
+            render_ns += get_time_ns() - glyph_start;
+            glyph_count += size_count;
+
+            if(write_output && sdf.pixels)
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/sdf_u%04X.pgm", output_dir, code_point);
+                write_pgm(path, sdf.pixels, sdf.width, sdf.height);
+                for(i32 s = 0; s < size_count; ++s)
+                {
+                    snprintf(path, sizeof(path), "%s/u%04X_%d.pgm", output_dir, code_point, (i32)sizes[s]);
+                    write_pgm(path, bitmaps[s], bitmap_sizes[s].x, bitmap_sizes[s].y);
+                }
+            }
+            arena_reset(scratch);
+        }
+        if(pool)
+        {
+            batch_destroy(pool);
+        }
+        thread_count = -1;
+        size_count = 0;
+    }
+
+    if(thread_count >= 0)
+    {
+        i32 job_count = size_count*list.count;
+        BatchJob *jobs = (BatchJob *)malloc(job_count*sizeof(BatchJob));
+        BatchResult *results = (BatchResult *)malloc(job_count*sizeof(BatchResult));
+        for(i32 s = 0; s < size_count; ++s)
+        {
+            for(i32 c = 0; c < list.count; ++c)
+            {
+                BatchJob *job = jobs + s*list.count + c;
+                job->glyph_index = char_map_lookup(char_map, list.code_points[c]);
+                job->pixel_size = sizes[s];
+            }
+        }
+
+        BatchPool *pool = batch_create(thread_count);
+        u64 batch_start = get_time_ns();
+        batch_render(pool, &font, mode, jobs, job_count, results);
+        render_ns = get_time_ns() - batch_start;
+        glyph_count = job_count;
+        fprintf(stdout, "batch: %d threads, %llu jobs stolen\n",
+                batch_thread_count(pool), batch_stolen_jobs(pool));
+
+        for(i32 i = 0; write_output && i < job_count; ++i)
+        {
+            if(results[i].bitmap)
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/u%04X_%d.pgm", output_dir,
+                         list.code_points[i % list.count], (i32)sizes[i / list.count]);
+                write_pgm(path, results[i].bitmap, results[i].width, results[i].height);
+            }
+        }
+
+        batch_destroy(pool);
+        free(results);
+        free(jobs);
+        size_count = 0;
+    }
+
+    for(i32 s = 0; s < size_count; ++s)
+    {
+        f32 scale = scale_pixel_height(hhea, sizes[s]);
+        for(i32 c = 0; c < list.count; ++c)
+        {
+            u32 code_point = list.code_points[c];
+
+            u64 glyph_start = get_time_ns();
+
+            u16 glyph_index = char_map_lookup(char_map, code_point);
+            Glyph glyph = get_font_glyph(scratch, &font, glyph_index);
+            if(band_rows > 0)
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/u%04X_%d.pgm", output_dir, code_point, (i32)sizes[s]);
+                if(write_output)
+                {
+                    write_pgm_bands(path, glyph, scale, mode, band_rows);
+                }
+                else
+                {
+                    render_glyph_bands(glyph, scale, mode, band_rows, 0, 0);
+                }
+                render_ns += get_time_ns() - glyph_start;
+                ++glyph_count;
+                arena_reset(scratch);
+                continue;
+            }
+            v2i bitmap_size = {};
+            u8 *bitmap = render_glyph(scratch, glyph, scale, mode, &bitmap_size);
+
+            render_ns += get_time_ns() - glyph_start;
+            ++glyph_count;
+
+            if(write_output && bitmap)
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/u%04X_%d.pgm", output_dir, code_point, (i32)sizes[s]);
+                write_pgm(path, bitmap, bitmap_size.x, bitmap_size.y);
+            }
+
+            arena_reset(scratch);
+        }
+    }
+
+    f64 render_seconds = (f64)render_ns / 1000000000.0;
+    fprintf(stdout, "font: %s face %u of %u (%u bytes%s)\n", font_path, face_index, collection.face_count,
+            font.file.size, font.file.mapped ? ", mapped" : "");
+    fprintf(stdout, "load: %.3f ms, %llu bytes allocated\n",
+            (f64)(load_end - load_start) / 1000000.0, render_bytes - load_bytes);
+    fprintf(stdout, "glyphs: %d in %.3f ms (%.0f glyphs/sec)\n",
+            glyph_count, render_seconds*1000.0,
+            render_seconds > 0 ? glyph_count / render_seconds : 0.0);
+    fprintf(stdout, "render: %llu bytes allocated in %llu allocations (%.1f bytes/glyph)\n",
+            font_allocated_bytes - render_bytes, font_allocation_count - render_allocations,
+            glyph_count ? (f64)(font_allocated_bytes - render_bytes) / glyph_count : 0.0);
+
+    if(stats_path)
+    {
+        write_stats(stats_path);
+    }
+
+    free_scratch_arena();
+    close_font(&font);
+    close_font_collection(&collection);
+    free(list.code_points);
+    return 0;
+}
@@ -0,0 +1,388 @@
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#include "composite.h"
+
+// NOTE: The colour of one draw the way the kernels use it
+typedef struct
+{
+    // NOTE: The colour with alpha 255, full coverage moves a pixel all the
+    // way to it
+    u32 opaque;
+    u32 alpha;
+    CompositeGamma *gamma;
+    u32 linear_r;
+    u32 linear_g;
+    u32 linear_b;
+} CompositeColor;
+
+static i32 composite_kernel = -1;
+
+void build_composite_gamma(CompositeGamma *gamma, f32 exponent)
+{
+    for(i32 i = 0; i < 256; ++i)
+    {
+        f64 value = i / 255.0;
+        if(exponent > 0.0f) value = pow(value, exponent);
+        else value = value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+        gamma->to_linear[i] = (u32)(value*65535.0 + 0.5);
+    }
+    for(i32 i = 0; i < COMPOSITE_ENCODE_COUNT; ++i)
+    {
+        // NOTE: Middle of the linear values that share the entry
+        f64 value = ((i << COMPOSITE_ENCODE_SHIFT) + (1 << (COMPOSITE_ENCODE_SHIFT - 1))) / 65535.0;
+        value = MIN(value, 1.0);
+        if(exponent > 0.0f) value = pow(value, 1.0 / exponent);
+        else value = value <= 0.0031308 ? value*12.92 : 1.055*pow(value, 1.0 / 2.4) - 0.055;
+        gamma->to_encoded[i] = (u32)(value*255.0 + 0.5);
+    }
+    // NOTE: An encoded value that has an entry of its own decodes and encodes
+    // back to itself. Flat curves (power curves near black) share entries
+    // between several values, those keep the middle value
+    for(i32 i = 0; i < 256; ++i)
+    {
+        u32 entry = gamma->to_linear[i] >> COMPOSITE_ENCODE_SHIFT;
+        i32 shared = (i > 0 && (gamma->to_linear[i - 1] >> COMPOSITE_ENCODE_SHIFT) == entry) ||
+                     (i < 255 && (gamma->to_linear[i + 1] >> COMPOSITE_ENCODE_SHIFT) == entry);
+        if(!shared)
+        {
+            gamma->to_encoded[entry] = (u32)i;
+        }
+    }
+}
+
+CompositeTarget composite_target(u32 *pixels, i32 width, i32 height, i32 stride)
+{
+    CompositeTarget result = {};
+    result.pixels = pixels;
+    result.width = width;
+    result.height = height;
+    result.stride = stride;
+    result.clip_x1 = width;
+    result.clip_y1 = height;
+    return result;
+}
+
+void set_composite_clip(CompositeTarget *target, i32 x0, i32 y0, i32 x1, i32 y1)
+{
+    target->clip_x0 = CLAMP(x0, 0, target->width);
+    target->clip_y0 = CLAMP(y0, 0, target->height);
+    target->clip_x1 = CLAMP(x1, target->clip_x0, target->width);
+    target->clip_y1 = CLAMP(y1, target->clip_y0, target->height);
+}
+
+void composite_fill(CompositeTarget *target, u32 color)
+{
+    for(i32 y = target->clip_y0; y < target->clip_y1; ++y)
+    {
+        u32 *row = target->pixels + (i64)y*target->stride;
+        for(i32 x = target->clip_x0; x < target->clip_x1; ++x)
+        {
+            row[x] = color;
+        }
+    }
+}
+
+// NOTE: x/255 rounded to nearest, exact for x up to 255*255
+static inline u32 divide_255(u32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// NOTE: 16-bit linear values, factor in 16 bits too. Same rounding as divide_255
+static inline u32 blend_linear(u32 target, u32 source, u32 factor)
+{
+    u32 value = target*(65535 - factor) + source*factor + 32768;
+    return (value + (value >> 16)) >> 16;
+}
+
+// NOTE: The reference every kernel matches
+static inline u32 blend_pixel(u32 pixel, u32 coverage, CompositeColor *color)
+{
+    u32 factor = divide_255(coverage*color->alpha);
+    if(!factor) return pixel;
+    if(factor == 255) return color->opaque;
+
+    u32 inverse = 255 - factor;
+    u32 r, g, b;
+    if(color->gamma)
+    {
+        CompositeGamma *gamma = color->gamma;
+        u32 factor16 = factor*257;
+        r = blend_linear(gamma->to_linear[pixel & 0xFF], color->linear_r, factor16);
+        g = blend_linear(gamma->to_linear[(pixel >> 8) & 0xFF], color->linear_g, factor16);
+        b = blend_linear(gamma->to_linear[(pixel >> 16) & 0xFF], color->linear_b, factor16);
+        r = gamma->to_encoded[r >> COMPOSITE_ENCODE_SHIFT];
+        g = gamma->to_encoded[g >> COMPOSITE_ENCODE_SHIFT];
+        b = gamma->to_encoded[b >> COMPOSITE_ENCODE_SHIFT];
+    }
+    else
+    {
+        r = divide_255((pixel & 0xFF)*inverse + (color->opaque & 0xFF)*factor);
+        g = divide_255(((pixel >> 8) & 0xFF)*inverse + ((color->opaque >> 8) & 0xFF)*factor);
+        b = divide_255(((pixel >> 16) & 0xFF)*inverse + ((color->opaque >> 16) & 0xFF)*factor);
+    }
+    u32 a = divide_255((pixel >> 24)*inverse + 255*factor);
+    return COMPOSITE_RGBA(r, g, b, a);
+}
+
+#ifdef __SSE2__
+// NOTE: target*(255 - factor) + source*factor over 255 in 16-bit lanes, the
+// sums stay under 65536 so the unsigned math fits
+static inline __m128i blend_lanes_sse2(__m128i target, __m128i source, __m128i factor)
+{
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), factor);
+    __m128i value = _mm_add_epi16(_mm_mullo_epi16(target, inverse), _mm_mullo_epi16(source, factor));
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+static i32 blend_row_sse2(u32 *pixels, u8 *coverage, i32 count, CompositeColor *color)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alpha = _mm_set1_epi16((i16)color->alpha);
+    __m128i round = _mm_set1_epi16(128);
+    __m128i source = _mm_unpacklo_epi8(_mm_set1_epi32((i32)color->opaque), zero);
+    i32 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        u32 block;
+        memcpy(&block, coverage + i, sizeof(block));
+        if(!block) continue;
+
+        __m128i factor = _mm_unpacklo_epi8(_mm_cvtsi32_si128((i32)block), zero);
+        factor = _mm_add_epi16(_mm_mullo_epi16(factor, alpha), round);
+        factor = _mm_srli_epi16(_mm_add_epi16(factor, _mm_srli_epi16(factor, 8)), 8);
+        // NOTE: Every factor once per channel, pixels 0 and 1 then 2 and 3
+        factor = _mm_unpacklo_epi16(factor, factor);
+        __m128i factor_low = _mm_unpacklo_epi32(factor, factor);
+        __m128i factor_high = _mm_unpackhi_epi32(factor, factor);
+
+        __m128i target = _mm_loadu_si128((__m128i *)(pixels + i));
+        __m128i low = blend_lanes_sse2(_mm_unpacklo_epi8(target, zero), source, factor_low);
+        __m128i high = blend_lanes_sse2(_mm_unpackhi_epi8(target, zero), source, factor_high);
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm_packus_epi16(low, high));
+    }
+    return i;
+}
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+// NOTE: Factors of the 8 pixels at coverage in 32-bit lanes, same math as
+// divide_255. The products fit in 16 bits so the cheap 16-bit multiply is
+// enough
+__attribute__((target("avx2")))
+static inline __m256i get_factors_avx2(u8 *coverage, __m256i alpha)
+{
+    __m256i factor = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)coverage));
+    factor = _mm256_add_epi32(_mm256_mullo_epi16(factor, alpha), _mm256_set1_epi32(128));
+    return _mm256_srli_epi32(_mm256_add_epi32(factor, _mm256_srli_epi32(factor, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_lanes_avx2(__m256i target, __m256i source, __m256i factor)
+{
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), factor);
+    __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(target, inverse), _mm256_mullo_epi16(source, factor));
+    value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static i32 blend_row_avx2(u32 *pixels, u8 *coverage, i32 count, CompositeColor *color)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i alpha = _mm256_set1_epi32((i32)color->alpha);
+    __m256i source = _mm256_unpacklo_epi8(_mm256_set1_epi32((i32)color->opaque), zero);
+    i32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        u64 block;
+        memcpy(&block, coverage + i, sizeof(block));
+        if(!block) continue;
+
+        // NOTE: The byte unpacks work inside each 128-bit half, the low
+        // unpack holds pixels 0, 1, 4, 5 and the high one 2, 3, 6, 7. The
+        // factors are spread to 4 lanes each in the same order
+        __m256i factor = get_factors_avx2(coverage + i, alpha);
+        factor = _mm256_or_si256(factor, _mm256_slli_epi32(factor, 16));
+        __m256i factor_low = _mm256_unpacklo_epi32(factor, factor);
+        __m256i factor_high = _mm256_unpackhi_epi32(factor, factor);
+
+        __m256i target = _mm256_loadu_si256((__m256i *)(pixels + i));
+        __m256i low = blend_lanes_avx2(_mm256_unpacklo_epi8(target, zero), source, factor_low);
+        __m256i high = blend_lanes_avx2(_mm256_unpackhi_epi8(target, zero), source, factor_high);
+        _mm256_storeu_si256((__m256i *)(pixels + i), _mm256_packus_epi16(low, high));
+    }
+    return i;
+}
+
+// NOTE: One channel of 8 pixels through the gamma tables, returns the
+// encoded values in the low byte of every lane
+__attribute__((target("avx2")))
+static inline __m256i blend_channel_avx2(CompositeGamma *gamma, __m256i target, __m256i source,
+                                         __m256i factor, __m256i inverse)
+{
+    __m256i linear = _mm256_i32gather_epi32((const int *)gamma->to_linear, target, 4);
+    __m256i value = _mm256_add_epi32(_mm256_mullo_epi32(linear, inverse), _mm256_mullo_epi32(source, factor));
+    value = _mm256_add_epi32(value, _mm256_set1_epi32(32768));
+    value = _mm256_srli_epi32(_mm256_add_epi32(value, _mm256_srli_epi32(value, 16)), 16);
+    return _mm256_i32gather_epi32((const int *)gamma->to_encoded, _mm256_srli_epi32(value, COMPOSITE_ENCODE_SHIFT), 4);
+}
+
+__attribute__((target("avx2")))
+static i32 blend_row_gamma_avx2(u32 *pixels, u8 *coverage, i32 count, CompositeColor *color)
+{
+    CompositeGamma *gamma = color->gamma;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    __m256i max_factor = _mm256_set1_epi32(255);
+    __m256i alpha = _mm256_set1_epi32((i32)color->alpha);
+    __m256i opaque = _mm256_set1_epi32((i32)color->opaque);
+    __m256i source_r = _mm256_set1_epi32((i32)color->linear_r);
+    __m256i source_g = _mm256_set1_epi32((i32)color->linear_g);
+    __m256i source_b = _mm256_set1_epi32((i32)color->linear_b);
+    i32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        u64 block;
+        memcpy(&block, coverage + i, sizeof(block));
+        if(!block) continue;
+        if(block == ~0ull && color->alpha == 255)
+        {
+            _mm256_storeu_si256((__m256i *)(pixels + i), opaque);
+            continue;
+        }
+
+        __m256i factor = get_factors_avx2(coverage + i, alpha);
+        // NOTE: factor*257 stretches 255 to 65535
+        __m256i factor16 = _mm256_or_si256(factor, _mm256_slli_epi32(factor, 8));
+        __m256i inverse16 = _mm256_sub_epi32(_mm256_set1_epi32(65535), factor16);
+
+        __m256i target = _mm256_loadu_si256((__m256i *)(pixels + i));
+        __m256i r = blend_channel_avx2(gamma, _mm256_and_si256(target, byte_mask), source_r, factor16, inverse16);
+        __m256i g = blend_channel_avx2(gamma, _mm256_and_si256(_mm256_srli_epi32(target, 8), byte_mask),
+                                       source_g, factor16, inverse16);
+        __m256i b = blend_channel_avx2(gamma, _mm256_and_si256(_mm256_srli_epi32(target, 16), byte_mask),
+                                       source_b, factor16, inverse16);
+        __m256i a = _mm256_mullo_epi16(_mm256_srli_epi32(target, 24), _mm256_sub_epi32(max_factor, factor));
+        a = _mm256_add_epi32(a, _mm256_mullo_epi16(factor, max_factor));
+        a = _mm256_add_epi32(a, _mm256_set1_epi32(128));
+        a = _mm256_srli_epi32(_mm256_add_epi32(a, _mm256_srli_epi32(a, 8)), 8);
+
+        __m256i result = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                                         _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_slli_epi32(a, 24)));
+        result = _mm256_blendv_epi8(result, opaque, _mm256_cmpeq_epi32(factor, max_factor));
+        result = _mm256_blendv_epi8(result, target, _mm256_cmpeq_epi32(factor, zero));
+        _mm256_storeu_si256((__m256i *)(pixels + i), result);
+    }
+    return i;
+}
+#endif
+
+static CompositeKernel get_cpu_kernel(void)
+{
+#if defined(__SSE2__) && defined(__GNUC__)
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return COMPOSITE_AVX2;
+    }
+#endif
+#ifdef __SSE2__
+    return COMPOSITE_SSE2;
+#else
+    return COMPOSITE_SCALAR;
+#endif
+}
+
+CompositeKernel get_composite_kernel(void)
+{
+    i32 result = __atomic_load_n(&composite_kernel, __ATOMIC_RELAXED);
+    if(result < 0)
+    {
+        result = get_cpu_kernel();
+        __atomic_store_n(&composite_kernel, result, __ATOMIC_RELAXED);
+    }
+    return (CompositeKernel)result;
+}
+
+void set_composite_kernel(CompositeKernel kernel)
+{
+    __atomic_store_n(&composite_kernel, MIN((i32)kernel, (i32)get_cpu_kernel()), __ATOMIC_RELAXED);
+}
+
+static void blend_row(u32 *pixels, u8 *coverage, i32 count, CompositeColor *color, CompositeKernel kernel)
+{
+    i32 i = 0;
+#if defined(__SSE2__) && defined(__GNUC__)
+    if(kernel == COMPOSITE_AVX2)
+    {
+        i = color->gamma ? blend_row_gamma_avx2(pixels, coverage, count, color) :
+            blend_row_avx2(pixels, coverage, count, color);
+    }
+#endif
+#ifdef __SSE2__
+    // NOTE: Also what is left of the row after AVX2, small glyphs are mostly
+    // narrower than 8 pixels. Without gathers the gamma blend is the scalar
+    // one, reading the tables one channel at a time into the lanes cost more
+    // than the lanes saved
+    if(kernel >= COMPOSITE_SSE2 && !color->gamma)
+    {
+        i += blend_row_sse2(pixels + i, coverage + i, count - i, color);
+    }
+#else
+    (void)kernel;
+#endif
+    for(; i < count; ++i)
+    {
+        pixels[i] = blend_pixel(pixels[i], coverage[i], color);
+    }
+}
+
+void composite_draws(CompositeTarget *target, CompositeGamma *gamma, CompositeDraw *draws, i32 draw_count)
+{
+    STAT_TIMER_BEGIN(STAT_STAGE_COMPOSITE, timer);
+    CompositeKernel kernel = get_composite_kernel();
+    u64 pixel_count = 0;
+    for(i32 d = 0; d < draw_count; ++d)
+    {
+        CompositeDraw *draw = draws + d;
+        CompositeColor color = {};
+        color.opaque = draw->color | 0xFF000000;
+        color.alpha = draw->color >> 24;
+        if(!color.alpha) continue;
+        if(gamma)
+        {
+            color.gamma = gamma;
+            color.linear_r = gamma->to_linear[draw->color & 0xFF];
+            color.linear_g = gamma->to_linear[(draw->color >> 8) & 0xFF];
+            color.linear_b = gamma->to_linear[(draw->color >> 16) & 0xFF];
+        }
+
+        i32 x0 = MAX(draw->x, target->clip_x0);
+        i32 y0 = MAX(draw->y, target->clip_y0);
+        i32 x1 = MIN(draw->x + draw->width, target->clip_x1);
+        i32 y1 = MIN(draw->y + draw->height, target->clip_y1);
+        if(x0 >= x1 || y0 >= y1) continue;
+
+        for(i32 y = y0; y < y1; ++y)
+        {
+            // NOTE: Target rows go down and bitmap rows go up
+            i32 row = draw->height - 1 - (y - draw->y);
+            u8 *coverage = draw->coverage + (i64)row*draw->stride + (x0 - draw->x);
+            u32 *pixels = target->pixels + (i64)y*target->stride + x0;
+            blend_row(pixels, coverage, x1 - x0, &color, kernel);
+        }
+        pixel_count += (u64)(x1 - x0)*(y1 - y0);
+    }
+    STAT_ADD(STAT_PIXELS_COMPOSITED, pixel_count);
+    STAT_TIMER_END(STAT_STAGE_COMPOSITE, timer);
+}
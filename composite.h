@@ -0,0 +1,93 @@
+#ifndef COMPOSITE_H
+#define COMPOSITE_H
+
+#include "font.h"
+
+// NOTE: Software compositor. Blends 8-bit coverage (rasterizer bitmaps, text
+// runs, glyphs straight from atlas or pack pages) in a colour into an RGBA8
+// image, for the servers that put text on images without a GPU. Target
+// pixels are premultiplied RGBA with R in the low byte of the u32 and rows
+// from top to bottom like an image file. Coverage keeps the y up rows of the
+// rasterizer and is flipped on the way in
+//
+// Every channel of the target is moved toward the colour (alpha 255) by the
+// colour alpha times the coverage. With gamma tables the colour channels
+// move in linear light instead: the target is decoded through a 256 entry
+// table and the result encoded back through a 4096 entry one, so the edges
+// of dark text on light backgrounds (and the other way around) keep their
+// weight. Alpha is always blended as it is. Zero coverage leaves the pixel
+// as it was and full coverage of an opaque colour writes the colour, on
+// every path
+//
+// The rows are blended 4 pixels at a time with SSE2 or 8 with AVX2, the
+// kernel is picked once from the cpu. The AVX2 kernel gathers the gamma
+// tables, with SSE2 the gamma blend stays scalar. Every kernel gives the same
+// bytes
+
+#define COMPOSITE_RGBA(r, g, b, a) ((u32)(r) | (u32)(g) << 8 | (u32)(b) << 16 | (u32)(a) << 24)
+
+// NOTE: Linear values are 16-bit, the encode table is indexed by the top bits
+#define COMPOSITE_ENCODE_SHIFT 4
+#define COMPOSITE_ENCODE_COUNT (65536 >> COMPOSITE_ENCODE_SHIFT)
+
+typedef enum
+{
+    COMPOSITE_SCALAR,
+    COMPOSITE_SSE2,
+    COMPOSITE_AVX2,
+} CompositeKernel;
+
+// NOTE: 32-bit entries so the AVX2 kernel can gather them
+typedef struct
+{
+    u32 to_linear[256];
+    u32 to_encoded[COMPOSITE_ENCODE_COUNT];
+} CompositeGamma;
+
+typedef struct
+{
+    u32 *pixels;
+    i32 width;
+    i32 height;
+    // NOTE: In pixels
+    i32 stride;
+    // NOTE: Draws only write [clip_x0, clip_x1) x [clip_y0, clip_y1)
+    i32 clip_x0;
+    i32 clip_y0;
+    i32 clip_x1;
+    i32 clip_y1;
+} CompositeTarget;
+
+typedef struct
+{
+    // NOTE: Rows bottom up. stride is in bytes, a glyph can be drawn from the
+    // middle of an atlas page with the page width
+    u8 *coverage;
+    i32 width;
+    i32 height;
+    i32 stride;
+    // NOTE: Target pixel the top left of the bitmap lands on
+    i32 x;
+    i32 y;
+    // NOTE: Straight alpha, COMPOSITE_RGBA
+    u32 color;
+} CompositeDraw;
+
+// NOTE: exponent 0 builds the sRGB curve, anything else a power curve
+void build_composite_gamma(CompositeGamma *gamma, f32 exponent);
+
+// NOTE: The clip starts as the whole image, set_composite_clip keeps it inside
+CompositeTarget composite_target(u32 *pixels, i32 width, i32 height, i32 stride);
+void set_composite_clip(CompositeTarget *target, i32 x0, i32 y0, i32 x1, i32 y1);
+// NOTE: Fills the clip with one premultiplied colour
+void composite_fill(CompositeTarget *target, u32 color);
+// NOTE: Blends the draws in list order, one colour per draw. Without gamma
+// tables the encoded values are blended
+void composite_draws(CompositeTarget *target, CompositeGamma *gamma, CompositeDraw *draws, i32 draw_count);
+
+// NOTE: Best kernel this cpu runs. It can be lowered (to compare them) but
+// never raised over what the cpu supports
+CompositeKernel get_composite_kernel(void);
+void set_composite_kernel(CompositeKernel kernel);
+
+#endif // COMPOSITE_H
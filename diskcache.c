@@ -0,0 +1,467 @@
+#include <stddef.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "diskcache.h"
+
+#define DISK_CACHE_ALIGN(size) (((size) + DISK_CACHE_ALIGNMENT - 1) & ~(u64)(DISK_CACHE_ALIGNMENT - 1))
+
+static u32 hash_key(DiskCacheKey key)
+{
+    u32 result = (u32)key.font_hash ^ (u32)(key.font_hash >> 32);
+    result = result*31 + key.glyph_index;
+    result = result*31 + key.pixel_size;
+    result = result*31 + (key.mode | key.phase << 8 | key.x_phases << 16 | (u32)key.y_phases << 24);
+    result ^= result >> 15;
+    result *= 0x2C1B3C6D;
+    result ^= result >> 12;
+    return result;
+}
+
+static i32 keys_equal(DiskCacheKey a, DiskCacheKey b)
+{
+    return a.font_hash == b.font_hash && a.glyph_index == b.glyph_index && a.pixel_size == b.pixel_size &&
+           a.mode == b.mode && a.phase == b.phase && a.x_phases == b.x_phases && a.y_phases == b.y_phases;
+}
+
+// NOTE: 8 bytes a step, it only has to catch torn and overwritten records
+static u64 hash_bytes(u64 result, u8 *bytes, u64 size)
+{
+    u64 i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+        u64 word;
+        memcpy(&word, bytes + i, sizeof(word));
+        result = (result ^ word)*0x9E3779B97F4A7C15ull;
+        result ^= result >> 32;
+    }
+    for(; i < size; ++i)
+    {
+        result = (result ^ bytes[i])*0x100000001B3ull;
+    }
+    return result;
+}
+
+// NOTE: Seeded with the version, records of another version never check out
+static u64 get_record_checksum(DiskCacheRecord *record, u8 *pixels)
+{
+    u64 result = hash_bytes(0xCBF29CE484222325ull ^ DISK_CACHE_VERSION, (u8 *)&record->key,
+                            sizeof(DiskCacheRecord) - offsetof(DiskCacheRecord, key));
+    return hash_bytes(result, pixels, (u64)record->width*record->height);
+}
+
+static u64 get_record_size(u64 pixel_count)
+{
+    return DISK_CACHE_ALIGN(sizeof(DiskCacheRecord) + pixel_count);
+}
+
+static i32 find_entry(DiskCache *cache, DiskCacheKey key)
+{
+    u32 bucket = hash_key(key) & (cache->hash_size - 1);
+    for(i32 index = cache->hash[bucket]; index != DISK_CACHE_NIL; index = cache->entries[index].hash_next)
+    {
+        if(keys_equal(cache->entries[index].key, key))
+        {
+            return index;
+        }
+    }
+    return DISK_CACHE_NIL;
+}
+
+static void grow_entries(DiskCache *cache)
+{
+    i32 entry_capacity = cache->entry_capacity ? cache->entry_capacity*2 : 1024;
+    DiskCacheEntry *entries = (DiskCacheEntry *)font_alloc(entry_capacity*sizeof(DiskCacheEntry));
+    if(cache->entries)
+    {
+        memcpy(entries, cache->entries, cache->entry_capacity*sizeof(DiskCacheEntry));
+        font_free(cache->entries);
+        font_free(cache->hash);
+    }
+    for(i32 i = cache->entry_capacity; i < entry_capacity; ++i)
+    {
+        entries[i].hash_next = (i + 1 < entry_capacity) ? i + 1 : DISK_CACHE_NIL;
+    }
+    cache->first_free_entry = cache->entry_capacity;
+
+    cache->hash_size = 1;
+    while(cache->hash_size < entry_capacity*2)
+    {
+        cache->hash_size <<= 1;
+    }
+    cache->hash = (i32 *)font_alloc(cache->hash_size*sizeof(i32));
+    for(i32 i = 0; i < cache->hash_size; ++i)
+    {
+        cache->hash[i] = DISK_CACHE_NIL;
+    }
+    // NOTE: Every old entry was in use, the free list was empty
+    for(i32 i = 0; i < cache->entry_capacity; ++i)
+    {
+        u32 bucket = hash_key(entries[i].key) & (cache->hash_size - 1);
+        entries[i].hash_next = cache->hash[bucket];
+        cache->hash[bucket] = i;
+    }
+    cache->entries = entries;
+    cache->entry_capacity = entry_capacity;
+}
+
+// NOTE: A key written again points at the new record, the old one is dead
+// space until the tail gets to it
+static void add_entry(DiskCache *cache, DiskCacheKey key, u64 offset)
+{
+    i32 index = find_entry(cache, key);
+    if(index != DISK_CACHE_NIL)
+    {
+        cache->entries[index].offset = offset;
+        return;
+    }
+    if(cache->first_free_entry == DISK_CACHE_NIL)
+    {
+        grow_entries(cache);
+    }
+    index = cache->first_free_entry;
+    DiskCacheEntry *entry = cache->entries + index;
+    cache->first_free_entry = entry->hash_next;
+    ++cache->entry_count;
+
+    entry->key = key;
+    entry->offset = offset;
+    u32 bucket = hash_key(key) & (cache->hash_size - 1);
+    entry->hash_next = cache->hash[bucket];
+    cache->hash[bucket] = index;
+}
+
+// NOTE: Only if the entry still points at this record
+static void remove_entry(DiskCache *cache, DiskCacheKey key, u64 offset)
+{
+    u32 bucket = hash_key(key) & (cache->hash_size - 1);
+    for(i32 *link = cache->hash + bucket; *link != DISK_CACHE_NIL; link = &cache->entries[*link].hash_next)
+    {
+        DiskCacheEntry *entry = cache->entries + *link;
+        if(keys_equal(entry->key, key))
+        {
+            if(entry->offset == offset)
+            {
+                i32 index = *link;
+                *link = entry->hash_next;
+                entry->hash_next = cache->first_free_entry;
+                cache->first_free_entry = index;
+                --cache->entry_count;
+            }
+            return;
+        }
+    }
+}
+
+static DiskCacheRecord *get_valid_record(DiskCache *cache, u64 offset, u64 end)
+{
+    if(offset + sizeof(DiskCacheRecord) > end) return 0;
+    DiskCacheRecord *record = (DiskCacheRecord *)(cache->data + offset);
+    if(record->magic != DISK_CACHE_RECORD_MAGIC ||
+       record->size != get_record_size((u64)record->width*record->height) ||
+       offset + record->size > end)
+    {
+        return 0;
+    }
+    return record->checksum == get_record_checksum(record, (u8 *)(record + 1)) ? record : 0;
+}
+
+// NOTE: Indexes the valid records from offset on while the sequence goes up
+// and stays under max_sequence, returns where the chain ends. Later records
+// of a key are newer, except over entries below newer_end (the newer lap)
+static u64 scan_chain(DiskCache *cache, u64 offset, u64 end, u64 max_sequence, u64 newer_end,
+                      u64 *first_sequence, u64 *last_sequence)
+{
+    u64 sequence = 0;
+    for(DiskCacheRecord *record; (record = get_valid_record(cache, offset, end)); offset += record->size)
+    {
+        if(record->sequence <= sequence || record->sequence >= max_sequence) break;
+        if(!sequence) *first_sequence = record->sequence;
+        sequence = record->sequence;
+        i32 index = find_entry(cache, record->key);
+        if(index == DISK_CACHE_NIL)
+        {
+            add_entry(cache, record->key, offset);
+            ++cache->recovered;
+        }
+        else if(cache->entries[index].offset >= newer_end)
+        {
+            cache->entries[index].offset = offset;
+        }
+    }
+    *last_sequence = sequence;
+    return offset;
+}
+
+// NOTE: The header is a hint. The newest lap is the chain from the start of
+// the data, the chain from the saved tail to the end of the old lap is only
+// taken if the new lap has not run over it
+static void recover_records(DiskCache *cache)
+{
+    DiskCacheHeader saved = *cache->header;
+    u64 first_sequence = ~0ull;
+    u64 last_sequence = 0;
+    u64 head = scan_chain(cache, DISK_CACHE_DATA_OFFSET, cache->capacity, ~0ull, 0, &first_sequence,
+                          &last_sequence);
+    u64 next_sequence = last_sequence + 1;
+
+    u64 tail = DISK_CACHE_DATA_OFFSET;
+    u64 lap_end = 0;
+    if(saved.lap_end && saved.lap_end <= cache->capacity && saved.tail >= head && saved.tail < saved.lap_end &&
+       !(saved.tail % DISK_CACHE_ALIGNMENT))
+    {
+        u64 old_first = 0;
+        u64 old_last = 0;
+        lap_end = scan_chain(cache, saved.tail, saved.lap_end, first_sequence, head, &old_first, &old_last);
+        tail = saved.tail;
+        if(lap_end == tail)
+        {
+            tail = DISK_CACHE_DATA_OFFSET;
+            lap_end = 0;
+        }
+        else if(head == DISK_CACHE_DATA_OFFSET)
+        {
+            next_sequence = old_last + 1;
+        }
+    }
+
+    cache->next_sequence = next_sequence;
+    if(!cache->read_only)
+    {
+        cache->header->head = head;
+        cache->header->tail = tail;
+        cache->header->lap_end = lap_end;
+    }
+}
+
+i32 disk_cache_open(const char *file_path, u64 capacity, DiskCache *cache)
+{
+    DiskCache result = {};
+    result.fd = -1;
+    result.first_free_entry = DISK_CACHE_NIL;
+#ifdef _WIN32
+    (void)file_path;
+    (void)capacity;
+    *cache = result;
+    return 0;
+#else
+    i32 fd = open(file_path, O_RDWR | O_CREAT, 0644);
+    if(fd >= 0 && flock(fd, LOCK_EX | LOCK_NB))
+    {
+        close(fd);
+        fd = -1;
+    }
+    if(fd < 0)
+    {
+        fd = open(file_path, O_RDONLY);
+        result.read_only = 1;
+    }
+    if(fd < 0)
+    {
+        *cache = result;
+        return 0;
+    }
+
+    struct stat info;
+    DiskCacheHeader existing = {};
+    i32 valid = !fstat(fd, &info) && pread(fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                existing.magic == DISK_CACHE_MAGIC && existing.version == DISK_CACHE_VERSION &&
+                existing.capacity == (u64)info.st_size && existing.capacity > DISK_CACHE_DATA_OFFSET &&
+                existing.head >= DISK_CACHE_DATA_OFFSET;
+    if(valid)
+    {
+        capacity = existing.capacity;
+    }
+    else
+    {
+        // NOTE: Another version, or not a cache. The records it has do not
+        // check out under this version, only the header is written
+        capacity &= ~(u64)(DISK_CACHE_ALIGNMENT - 1);
+        if(result.read_only || capacity <= DISK_CACHE_DATA_OFFSET + sizeof(DiskCacheRecord) ||
+           ftruncate(fd, (off_t)capacity))
+        {
+            close(fd);
+            *cache = result;
+            return 0;
+        }
+    }
+
+    void *data = mmap(0, capacity, result.read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        close(fd);
+        *cache = result;
+        return 0;
+    }
+    result.fd = fd;
+    result.data = (u8 *)data;
+    result.header = (DiskCacheHeader *)data;
+    result.capacity = capacity;
+    if(!valid)
+    {
+        DiskCacheHeader header = {};
+        header.magic = DISK_CACHE_MAGIC;
+        header.version = DISK_CACHE_VERSION;
+        header.capacity = capacity;
+        header.head = DISK_CACHE_DATA_OFFSET;
+        header.tail = DISK_CACHE_DATA_OFFSET;
+        *result.header = header;
+    }
+    grow_entries(&result);
+    recover_records(&result);
+    *cache = result;
+    return 1;
+#endif
+}
+
+void disk_cache_close(DiskCache *cache)
+{
+#ifndef _WIN32
+    if(cache->data)
+    {
+        munmap(cache->data, cache->capacity);
+    }
+    if(cache->fd >= 0)
+    {
+        // NOTE: Drops the lock too
+        close(cache->fd);
+    }
+#endif
+    font_free(cache->entries);
+    font_free(cache->hash);
+    DiskCache zero = {};
+    zero.fd = -1;
+    *cache = zero;
+}
+
+i32 disk_cache_find(DiskCache *cache, Arena *arena, DiskCacheKey key, DiskCacheGlyph *glyph)
+{
+    i32 index = cache->data ? find_entry(cache, key) : DISK_CACHE_NIL;
+    if(index == DISK_CACHE_NIL)
+    {
+        ++cache->misses;
+        STAT_ADD(STAT_DISK_CACHE_MISSES, 1);
+        return 0;
+    }
+
+    // NOTE: The record is copied before it is checked, a writer in another
+    // process can overwrite it at any point. The size is checked first so the
+    // copy stays inside the file
+    u64 offset = cache->entries[index].offset;
+    DiskCacheRecord *mapped = (DiskCacheRecord *)(cache->data + offset);
+    u32 width = __atomic_load_n(&mapped->width, __ATOMIC_RELAXED);
+    u32 height = __atomic_load_n(&mapped->height, __ATOMIC_RELAXED);
+    u64 size = get_record_size((u64)width*height);
+    ArenaTemp temp = arena_begin_temp(arena);
+    DiskCacheRecord *record = 0;
+    if(offset + size <= cache->capacity)
+    {
+        record = (DiskCacheRecord *)arena_push(arena, size);
+        memcpy(record, mapped, size);
+    }
+    if(!record || record->magic != DISK_CACHE_RECORD_MAGIC || record->width != width || record->height != height ||
+       !keys_equal(record->key, key) || record->checksum != get_record_checksum(record, (u8 *)(record + 1)))
+    {
+        arena_end_temp(temp);
+        remove_entry(cache, key, offset);
+        ++cache->misses;
+        STAT_ADD(STAT_DISK_CACHE_MISSES, 1);
+        return 0;
+    }
+
+    glyph->width = record->width;
+    glyph->height = record->height;
+    glyph->bearing_x = record->bearing_x;
+    glyph->bearing_y = record->bearing_y;
+    glyph->advance = record->advance;
+    glyph->pixels = (u8 *)(record + 1);
+    ++cache->hits;
+    STAT_ADD(STAT_DISK_CACHE_HITS, 1);
+    return 1;
+}
+
+i32 disk_cache_insert(DiskCache *cache, DiskCacheKey key, DiskCacheGlyph *glyph)
+{
+    u64 pixel_count = (u64)glyph->width*glyph->height;
+    u64 size = get_record_size(pixel_count);
+    if(!cache->data || cache->read_only || size > cache->capacity - DISK_CACHE_DATA_OFFSET)
+    {
+        return 0;
+    }
+
+    DiskCacheHeader *header = cache->header;
+    u64 head = header->head;
+    u64 tail = header->tail;
+    u64 lap_end = header->lap_end;
+    for(;;)
+    {
+        if(!lap_end)
+        {
+            if(head + size <= cache->capacity) break;
+            // NOTE: Wrap, everything written so far is the old lap now
+            lap_end = head;
+            tail = DISK_CACHE_DATA_OFFSET;
+            head = DISK_CACHE_DATA_OFFSET;
+        }
+        if(tail >= head + size) break;
+
+        DiskCacheRecord *oldest = (DiskCacheRecord *)(cache->data + tail);
+        remove_entry(cache, oldest->key, tail);
+        ++cache->evictions;
+        tail += oldest->size;
+        if(tail >= lap_end)
+        {
+            tail = DISK_CACHE_DATA_OFFSET;
+            lap_end = 0;
+        }
+    }
+
+    // NOTE: The evictions are saved before the record overwrites them, a
+    // crash while the record is written leaves a torn record at head and
+    // the scan stops there
+    __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->lap_end, lap_end, __ATOMIC_RELEASE);
+
+    DiskCacheRecord *record = (DiskCacheRecord *)(cache->data + head);
+    DiskCacheRecord fields = {};
+    fields.magic = DISK_CACHE_RECORD_MAGIC;
+    fields.size = (u32)size;
+    fields.sequence = cache->next_sequence++;
+    fields.key = key;
+    fields.width = glyph->width;
+    fields.height = glyph->height;
+    fields.bearing_x = glyph->bearing_x;
+    fields.bearing_y = glyph->bearing_y;
+    fields.advance = glyph->advance;
+    fields.checksum = get_record_checksum(&fields, glyph->pixels);
+    if(pixel_count)
+    {
+        memcpy(record + 1, glyph->pixels, pixel_count);
+    }
+    memset((u8 *)(record + 1) + pixel_count, 0, size - sizeof(DiskCacheRecord) - pixel_count);
+    memcpy(record, &fields, sizeof(fields));
+
+    __atomic_store_n(&header->head, head + size, __ATOMIC_RELEASE);
+    add_entry(cache, key, head);
+    ++cache->inserts;
+    return 1;
+}
+
+void disk_cache_sync(DiskCache *cache)
+{
+#ifndef _WIN32
+    if(cache->data && !cache->read_only)
+    {
+        msync(cache->data, cache->capacity, MS_SYNC);
+    }
+#else
+    (void)cache;
+#endif
+}
@@ -0,0 +1,135 @@
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include "font.h"
+
+// NOTE: Persistent glyph cache. Rasterized glyphs are appended to one mapped
+// file as they are produced and looked up on atlas misses before the
+// rasterizer runs, so a restarted process starts with the glyphs of the last
+// one. Records are keyed by the hash of the font file (hash_font_file), so a
+// new version of a font never reads the bitmaps of the old one, those just
+// age out
+//
+// The file is a ring of records of fixed capacity. New records go at the
+// head and the oldest ones are evicted from the tail when the head catches
+// up with them. Every record carries a checksum and a sequence number, on
+// open the file is scanned and the first torn or stale record ends the
+// chain, so a crash in the middle of a write loses that record only
+//
+// One process writes a cache file at a time (a lock on the file). Opening a
+// cache another process writes gives a read only cache with the records
+// there were at open, lookups copy and check the record so one the writer
+// overwrote since is just a miss. Not supported on Win32, open fails
+
+#define DISK_CACHE_MAGIC TAG('F', 'D', 'C', 'H')
+// NOTE: Bumped when the file layout or the rasterizer output changes
+#define DISK_CACHE_VERSION 1
+#define DISK_CACHE_RECORD_MAGIC TAG('G', 'L', 'P', 'H')
+#define DISK_CACHE_ALIGNMENT 16
+#define DISK_CACHE_DATA_OFFSET 64
+#define DISK_CACHE_NIL -1
+
+typedef struct
+{
+    u64 font_hash;
+    u16 glyph_index;
+    u16 pixel_size;
+    // NOTE: RasterMode
+    u8 mode;
+    // NOTE: Atlas phase and phase counts, a phase means another fraction of a
+    // pixel with other counts
+    u8 phase;
+    u8 x_phases;
+    u8 y_phases;
+} DiskCacheKey;
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u64 capacity;
+    // NOTE: Next record goes at head. While lap_end is not 0 the ring has
+    // wrapped, the live records are [tail, lap_end) then
+    // [DISK_CACHE_DATA_OFFSET, head). Written after every record, the scan
+    // on open does not trust head
+    u64 head;
+    u64 tail;
+    u64 lap_end;
+} DiskCacheHeader;
+
+typedef struct
+{
+    u32 magic;
+    // NOTE: Header, pixels and padding to DISK_CACHE_ALIGNMENT
+    u32 size;
+    u64 sequence;
+    // NOTE: Over everything after it, pixels included
+    u64 checksum;
+    DiskCacheKey key;
+    u16 width;
+    u16 height;
+    // NOTE: Same as AtlasEntry
+    f32 bearing_x;
+    f32 bearing_y;
+    f32 advance;
+} DiskCacheRecord;
+
+typedef struct
+{
+    u16 width;
+    u16 height;
+    f32 bearing_x;
+    f32 bearing_y;
+    f32 advance;
+    // NOTE: width*height bytes, rows bottom up
+    u8 *pixels;
+} DiskCacheGlyph;
+
+typedef struct
+{
+    DiskCacheKey key;
+    u64 offset;
+    i32 hash_next;
+} DiskCacheEntry;
+
+typedef struct
+{
+    i32 fd;
+    i32 read_only;
+    u8 *data;
+    DiskCacheHeader *header;
+    u64 capacity;
+    u64 next_sequence;
+
+    // NOTE: Records in the file by key. Entries are chained in the buckets
+    // and free entries through hash_next
+    DiskCacheEntry *entries;
+    i32 entry_capacity;
+    i32 entry_count;
+    i32 first_free_entry;
+    i32 *hash;
+    i32 hash_size;
+
+    u64 hits;
+    u64 misses;
+    u64 inserts;
+    u64 evictions;
+    // NOTE: Records the scan on open found
+    u64 recovered;
+} DiskCache;
+
+// NOTE: Opens the cache file or creates it with room for capacity bytes. An
+// existing file keeps its own capacity, one from another version (or that is
+// not a cache) is started over
+i32 disk_cache_open(const char *file_path, u64 capacity, DiskCache *cache);
+void disk_cache_close(DiskCache *cache);
+// NOTE: The pixels are copied into the arena and checked there
+i32 disk_cache_find(DiskCache *cache, Arena *arena, DiskCacheKey key, DiskCacheGlyph *glyph);
+// NOTE: Appends the glyph, evicting the oldest records to make room. Fails on
+// read only caches and glyphs bigger than the ring
+i32 disk_cache_insert(DiskCache *cache, DiskCacheKey key, DiskCacheGlyph *glyph);
+// NOTE: Records survive a crash of the process as they are written, this
+// flushes them to the disk against power loss
+void disk_cache_sync(DiskCache *cache);
+
+#endif // DISKCACHE_H
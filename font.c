@@ -0,0 +1,4005 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "font.h"
+
+u64 font_allocated_bytes = 0;
+u64 font_allocation_count = 0;
+
+void *font_alloc(size_t size)
+{
+    // NOTE: The batch workers allocate too when their arenas grow
+    __atomic_fetch_add(&font_allocated_bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&font_allocation_count, 1, __ATOMIC_RELAXED);
+    STAT_ADD(STAT_BYTES_ALLOCATED, size);
+    STAT_ADD(STAT_ALLOCATIONS, 1);
+    return malloc(size);
+}
+
+void font_free(void *memory)
+{
+    free(memory);
+}
+
+static ArenaBlock *push_arena_block(Arena *arena, size_t size)
+{
+    ArenaBlock *block = 0;
+    if(arena->spare && arena->spare->size >= size + ARENA_ALIGNMENT)
+    {
+        block = arena->spare;
+        arena->spare = 0;
+    }
+    else
+    {
+        size_t block_size = MAX(size + ARENA_ALIGNMENT, MAX(arena->minimum_block_size, ARENA_DEFAULT_BLOCK_SIZE));
+        block = (ArenaBlock *)font_alloc(sizeof(ArenaBlock) + block_size);
+        block->size = block_size;
+    }
+    block->prev = arena->current;
+    block->used = 0;
+    arena->current = block;
+    return block;
+}
+
+// NOTE: Keep the biggest released block around so a glyph that overflows
+// the arena in every frame does not hit the heap every time
+static void release_arena_block(Arena *arena, ArenaBlock *block)
+{
+    if(!arena->spare || block->size > arena->spare->size)
+    {
+        font_free(arena->spare);
+        arena->spare = block;
+    }
+    else
+    {
+        font_free(block);
+    }
+}
+
+void *arena_push(Arena *arena, size_t size)
+{
+    ArenaBlock *block = arena->current;
+    size_t offset = 0;
+    if(block)
+    {
+        u8 *base = (u8 *)(block + 1);
+        size_t address = (size_t)(base + block->used);
+        offset = block->used + ((ARENA_ALIGNMENT - (address & (ARENA_ALIGNMENT - 1))) & (ARENA_ALIGNMENT - 1));
+    }
+    if(!block || offset + size > block->size)
+    {
+        block = push_arena_block(arena, size);
+        size_t address = (size_t)(block + 1);
+        offset = (ARENA_ALIGNMENT - (address & (ARENA_ALIGNMENT - 1))) & (ARENA_ALIGNMENT - 1);
+    }
+
+    void *result = (u8 *)(block + 1) + offset;
+    block->used = offset + size;
+    return result;
+}
+
+void *arena_push_zero(Arena *arena, size_t size)
+{
+    void *result = arena_push(arena, size);
+    memset(result, 0, size);
+    return result;
+}
+
+void arena_reset(Arena *arena)
+{
+    ArenaBlock *block = arena->current;
+    if(!block) return;
+
+    if(block->prev)
+    {
+        // NOTE: The glyph did not fit in one block. Replace the chain with a
+        // single block big enough for all of it so the next reset is free
+        size_t total = 0;
+        while(block)
+        {
+            ArenaBlock *prev = block->prev;
+            total += block->size;
+            font_free(block);
+            block = prev;
+        }
+        arena->current = 0;
+        font_free(arena->spare);
+        arena->spare = 0;
+        push_arena_block(arena, total);
+    }
+    else
+    {
+        block->used = 0;
+    }
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaBlock *block = arena->current;
+    while(block)
+    {
+        ArenaBlock *prev = block->prev;
+        font_free(block);
+        block = prev;
+    }
+    font_free(arena->spare);
+    arena->current = 0;
+    arena->spare = 0;
+}
+
+ArenaTemp arena_begin_temp(Arena *arena)
+{
+    ArenaTemp result = {};
+    result.arena = arena;
+    result.block = arena->current;
+    result.used = arena->current ? arena->current->used : 0;
+    return result;
+}
+
+void arena_end_temp(ArenaTemp temp)
+{
+    Arena *arena = temp.arena;
+    while(arena->current != temp.block)
+    {
+        ArenaBlock *prev = arena->current->prev;
+        release_arena_block(arena, arena->current);
+        arena->current = prev;
+    }
+    if(arena->current)
+    {
+        arena->current->used = temp.used;
+    }
+}
+
+static FONT_THREAD_LOCAL Arena scratch_arena;
+
+Arena *get_scratch_arena(void)
+{
+    return &scratch_arena;
+}
+
+void free_scratch_arena(void)
+{
+    arena_free(&scratch_arena);
+}
+
+u64 get_time_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    if(!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (u64)((f64)counter.QuadPart*(1000000000.0/(f64)frequency.QuadPart));
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec*1000000000ull + (u64)time.tv_nsec;
+#endif
+}
+
+static const char *stat_counter_names[STAT_COUNTER_COUNT] =
+{
+    "glyphs_decoded",
+    "points_generated",
+    "lines_emitted",
+    "scanlines",
+    "scanline_crossings",
+    "component_cache_hits",
+    "component_cache_misses",
+    "atlas_hits",
+    "atlas_misses",
+    "bytes_allocated",
+    "allocations",
+    "pixels_composited",
+    "disk_cache_hits",
+    "disk_cache_misses",
+};
+
+static const char *stat_stage_names[STAT_STAGE_COUNT] =
+{
+    "decode",
+    "points",
+    "lines",
+    "raster",
+    "sdf",
+    "composite",
+};
+
+#if FONT_STATS
+typedef struct StatBlock
+{
+    FontStats stats;
+    struct StatBlock *next;
+} StatBlock;
+
+static StatBlock *stat_blocks;
+FONT_THREAD_LOCAL FontStats *font_thread_stats;
+
+FontStats *create_thread_stats(void)
+{
+    // NOTE: Not font_alloc, it counts its allocations in here
+    StatBlock *block = (StatBlock *)calloc(1, sizeof(StatBlock));
+    block->next = __atomic_load_n(&stat_blocks, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&stat_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    font_thread_stats = &block->stats;
+    return font_thread_stats;
+}
+
+void stat_record(StatStage stage, u64 ns)
+{
+    StatHistogram *histogram = get_thread_stats()->stages + stage;
+    i32 bucket = 63 - __builtin_clzll(ns | 1);
+    bucket = MIN(bucket, STAT_HISTOGRAM_BUCKETS - 1);
+    stat_add(&histogram->samples, 1);
+    stat_add(&histogram->total_ns, ns);
+    stat_add(&histogram->buckets[bucket], 1);
+    if(ns > histogram->max_ns)
+    {
+        __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+#endif
+
+void get_font_stats(FontStats *snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+#if FONT_STATS
+    // NOTE: A snapshot taken while other threads render can miss the glyphs
+    // in flight
+    StatBlock *block = __atomic_load_n(&stat_blocks, __ATOMIC_ACQUIRE);
+    for(; block; block = block->next)
+    {
+        for(i32 i = 0; i < STAT_COUNTER_COUNT; ++i)
+        {
+            snapshot->counters[i] += __atomic_load_n(block->stats.counters + i, __ATOMIC_RELAXED);
+        }
+        for(i32 i = 0; i < STAT_STAGE_COUNT; ++i)
+        {
+            StatHistogram *source = block->stats.stages + i;
+            StatHistogram *destination = snapshot->stages + i;
+            destination->calls += __atomic_load_n(&source->calls, __ATOMIC_RELAXED);
+            destination->samples += __atomic_load_n(&source->samples, __ATOMIC_RELAXED);
+            destination->total_ns += __atomic_load_n(&source->total_ns, __ATOMIC_RELAXED);
+            destination->max_ns = MAX(destination->max_ns, __atomic_load_n(&source->max_ns, __ATOMIC_RELAXED));
+            for(i32 j = 0; j < STAT_HISTOGRAM_BUCKETS; ++j)
+            {
+                destination->buckets[j] += __atomic_load_n(source->buckets + j, __ATOMIC_RELAXED);
+            }
+        }
+    }
+#endif
+}
+
+void reset_font_stats(void)
+{
+#if FONT_STATS
+    StatBlock *block = __atomic_load_n(&stat_blocks, __ATOMIC_ACQUIRE);
+    for(; block; block = block->next)
+    {
+        u64 *values = (u64 *)&block->stats;
+        for(size_t i = 0; i < sizeof(FontStats)/sizeof(u64); ++i)
+        {
+            __atomic_store_n(values + i, 0, __ATOMIC_RELAXED);
+        }
+    }
+#endif
+}
+
+i32 format_font_stats_json(FontStats *stats, char *buffer, i32 buffer_size)
+{
+    i32 length = 0;
+#define STAT_APPEND(...) length += snprintf(buffer + MIN(length, buffer_size), \
+                                            buffer_size > length ? buffer_size - length : 0, __VA_ARGS__)
+    STAT_APPEND("{\"enabled\":%d,\"sample_interval\":%d,\"counters\":{", FONT_STATS, STAT_SAMPLE_INTERVAL);
+    for(i32 i = 0; i < STAT_COUNTER_COUNT; ++i)
+    {
+        STAT_APPEND("%s\"%s\":%llu", i ? "," : "", stat_counter_names[i], stats->counters[i]);
+    }
+    STAT_APPEND("},\"stages\":{");
+    for(i32 i = 0; i < STAT_STAGE_COUNT; ++i)
+    {
+        StatHistogram *histogram = stats->stages + i;
+        STAT_APPEND("%s\"%s\":{\"calls\":%llu,\"samples\":%llu,\"total_ns\":%llu,\"mean_ns\":%llu,\"max_ns\":%llu,"
+                    "\"histogram_ns_log2\":[", i ? "," : "", stat_stage_names[i], histogram->calls, histogram->samples,
+                    histogram->total_ns, histogram->samples ? histogram->total_ns / histogram->samples : 0,
+                    histogram->max_ns);
+        for(i32 j = 0; j < STAT_HISTOGRAM_BUCKETS; ++j)
+        {
+            STAT_APPEND("%s%llu", j ? "," : "", histogram->buckets[j]);
+        }
+        STAT_APPEND("]}");
+    }
+    STAT_APPEND("}}");
+#undef STAT_APPEND
+    return length;
+}
+
+char *
+read_entire_file(const char *file_path, u32 *file_size)
+{
+    char *result = 0;
+    FILE *file = fopen(file_path, "rb"); 
+    if(file)
+    {
+        u32 size_to_read = 0;
+        fseek(file, 0, SEEK_END);
+        size_to_read = ftell(file); 
+        fseek(file, 0, SEEK_SET);
+        if(size_to_read)
+        {
+            *file_size = size_to_read;
+            result = (char *)font_alloc(size_to_read);
+            fread(result, 1, size_to_read, file);
+        }
+        fclose(file);
+    }
+    return result;
+}
+
+// NOTE(tomi): Font Directory code
+i32 open_font_file(const char *file_path, FontFile *file)
+{
+    FontFile result = {};
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, 0);
+    if(handle != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size;
+        if(GetFileSizeEx(handle, &size) && size.QuadPart > 0 && size.QuadPart <= 0xFFFFFFFF)
+        {
+            HANDLE mapping = CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+            if(mapping)
+            {
+                result.data = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                result.size = (u32)size.QuadPart;
+                result.mapped = 1;
+                // NOTE: The view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(handle);
+    }
+#else
+    i32 fd = open(file_path, O_RDONLY);
+    if(fd >= 0)
+    {
+        struct stat info;
+        if(!fstat(fd, &info) && info.st_size > 0 && info.st_size <= 0xFFFFFFFF)
+        {
+            void *data = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if(data != MAP_FAILED)
+            {
+                result.data = (char *)data;
+                result.size = (u32)info.st_size;
+                result.mapped = 1;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if(!result.data)
+    {
+        result.data = read_entire_file(file_path, &result.size);
+        result.mapped = 0;
+    }
+    *file = result;
+    return result.data != 0;
+}
+
+void close_font_file(FontFile *file)
+{
+    if(file->data)
+    {
+        if(file->mapped)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(file->data);
+#else
+            munmap(file->data, file->size);
+#endif
+        }
+        else
+        {
+            font_free(file->data);
+        }
+    }
+    FontFile zero = {};
+    *file = zero;
+}
+
+u64 hash_font_file(FontFile *file)
+{
+    // NOTE: FNV-1a offset basis, then 8 bytes per multiply like hash_bytes
+    // in diskcache.c, byte at a time FNV-1a was most of open_font_pack when
+    // the pack checks its source. The tail goes byte by byte
+    u64 result = 0xCBF29CE484222325ull;
+    u8 *bytes = (u8 *)file->data;
+    u32 i = 0;
+    for(; i + 8 <= file->size; i += 8)
+    {
+        u64 word;
+        memcpy(&word, bytes + i, sizeof(word));
+        result = (result ^ word)*0x9E3779B97F4A7C15ull;
+        result ^= result >> 32;
+    }
+    for(; i < file->size; ++i)
+    {
+        result = (result ^ bytes[i])*0x100000001B3ull;
+    }
+    return result;
+}
+
+i32 utf8_decode(const char *text, u32 *code_point)
+{
+    u8 *bytes = (u8 *)text;
+    if(!bytes[0])
+    {
+        *code_point = 0;
+        return 0;
+    }
+
+    i32 length = 1;
+    u32 result = 0xFFFD;
+    if(bytes[0] < 0x80)
+    {
+        result = bytes[0];
+    }
+    else if((bytes[0] & 0xE0) == 0xC0 && (bytes[1] & 0xC0) == 0x80)
+    {
+        result = ((bytes[0] & 0x1F) << 6) | (bytes[1] & 0x3F);
+        length = 2;
+    }
+    else if((bytes[0] & 0xF0) == 0xE0 && (bytes[1] & 0xC0) == 0x80 &&
+            (bytes[2] & 0xC0) == 0x80)
+    {
+        result = ((bytes[0] & 0x0F) << 12) | ((bytes[1] & 0x3F) << 6) | (bytes[2] & 0x3F);
+        length = 3;
+    }
+    else if((bytes[0] & 0xF8) == 0xF0 && (bytes[1] & 0xC0) == 0x80 &&
+            (bytes[2] & 0xC0) == 0x80 && (bytes[3] & 0xC0) == 0x80)
+    {
+        result = ((bytes[0] & 0x07) << 18) | ((bytes[1] & 0x3F) << 12) |
+                 ((bytes[2] & 0x3F) << 6) | (bytes[3] & 0x3F);
+        length = 4;
+    }
+
+    *code_point = result;
+    return length;
+}
+
+TableDirectory get_table_directory(FontDirectory font_dir, i32 index)
+{
+    TableDirectory result = {};
+    char *entry = font_dir.table_dir_ptr + index*16;
+    result.tag = GET_32_MOVE(entry);
+    result.check_sum = GET_32_MOVE(entry);
+    result.offset = GET_32_MOVE(entry);
+    result.length = GET_32_MOVE(entry);
+    return result;
+}
+
+i32 find_table(FontDirectory font_dir, u32 tag, TableDirectory *table_dir)
+{
+    OffsetSubtable *offset_sub = &font_dir.offset_sub;
+    char *entry = font_dir.table_dir_ptr;
+    if(!offset_sub->search_range)
+    {
+        for(i32 i = 0; i < offset_sub->num_tables; ++i)
+        {
+            if((u32)GET_32(entry + i*16) == tag)
+            {
+                *table_dir = get_table_directory(font_dir, i);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // NOTE: search_range is the largest power of two entries (in bytes) that
+    // fits in the directory, range_shift the entries left over. Start in the
+    // upper window if the tag is past it, then halve entry_selector times
+    u32 search_range = offset_sub->search_range;
+    if((u32)GET_32(entry + offset_sub->range_shift) <= tag)
+    {
+        entry += offset_sub->range_shift;
+    }
+    for(i32 i = 0; i < offset_sub->entry_selector; ++i)
+    {
+        search_range >>= 1;
+        if((u32)GET_32(entry + search_range) <= tag)
+        {
+            entry += search_range;
+        }
+    }
+    if((u32)GET_32(entry) != tag)
+    {
+        return 0;
+    }
+    *table_dir = get_table_directory(font_dir, (i32)((entry - font_dir.table_dir_ptr) / 16));
+    return 1;
+}
+
+static char *find_table_ptr(FontDirectory font_dir, u32 tag)
+{
+    TableDirectory table_dir = {};
+    return find_table(font_dir, tag, &table_dir) ? font_dir.start + table_dir.offset : 0;
+}
+
+void load_font_directory(char *file, u32 offset, FontDirectory *font_dir)
+{
+    // NOTE: Table offsets are from the start of the file, in a collection
+    // the directory of every face sits somewhere after it
+    char *start = file + offset;
+    font_dir->start = file;
+
+    OffsetSubtable *offset_sub = &font_dir->offset_sub;
+    offset_sub->scaler_type = GET_32_MOVE(start);
+    offset_sub->num_tables = GET_16_MOVE(start);
+    offset_sub->search_range = GET_16_MOVE(start);
+    offset_sub->entry_selector = GET_16_MOVE(start);
+    offset_sub->range_shift = GET_16_MOVE(start);
+
+    // NOTE: The directory is read in place, nothing gets copied out of the file
+    font_dir->table_dir_ptr = start;
+
+    // NOTE: The binary search needs the directory sorted by tag and search
+    // fields that match num_tables. Some writers get the fields wrong, those
+    // are recomputed, and an unsorted directory falls back to a linear scan
+    u16 entry_selector = 0;
+    while(offset_sub->num_tables >> (entry_selector + 1))
+    {
+        ++entry_selector;
+    }
+    offset_sub->entry_selector = entry_selector;
+    offset_sub->search_range = offset_sub->num_tables ? (u16)(16 << entry_selector) : 0;
+    offset_sub->range_shift = (u16)(offset_sub->num_tables*16 - offset_sub->search_range);
+    for(i32 i = 1; i < offset_sub->num_tables; ++i)
+    {
+        if((u32)GET_32(start + (i - 1)*16) >= (u32)GET_32(start + i*16))
+        {
+            offset_sub->search_range = 0;
+            break;
+        }
+    }
+
+    font_dir->cmap_ptr = find_table_ptr(*font_dir, CMAP_TAG);
+    font_dir->head_ptr = find_table_ptr(*font_dir, HEAD_TAG);
+    font_dir->loca_ptr = find_table_ptr(*font_dir, LOCA_TAG);
+    font_dir->glyf_ptr = find_table_ptr(*font_dir, GLYF_TAG);
+    font_dir->hhea_ptr = find_table_ptr(*font_dir, HHEA_TAG);
+    font_dir->hmtx_ptr = find_table_ptr(*font_dir, HMTX_TAG);
+    font_dir->maxp_ptr = find_table_ptr(*font_dir, MAXP_TAG);
+    font_dir->kern_ptr = find_table_ptr(*font_dir, KERN_TAG);
+}
+
+void print_font_directory(FontDirectory font_dir)
+{
+    fprintf(stdout, "Number of tables: %d\n", font_dir.offset_sub.num_tables);
+    for(int i = 0; i < font_dir.offset_sub.num_tables; ++i)
+    {
+        TableDirectory table_dir = get_table_directory(font_dir, i);
+        u8 *tag = (u8 *)&table_dir.tag;
+        fprintf(stdout, "-------------------------------\n");
+        fprintf(stdout, "(Table %d)\n", i+1);
+        fprintf(stdout, "-------------------------------\n");
+        fprintf(stdout, "Tag: %c%c%c%c\n", tag[3], tag[2], tag[1], tag[0]);
+        fprintf(stdout, "CheckSum: %u\n", table_dir.check_sum);
+        fprintf(stdout, "Offset: %u\n", table_dir.offset);
+        fprintf(stdout, "Length: %u\n", table_dir.length);
+    }
+}
+
+// NOTE(tomi): CMap table code
+CMap load_cmap_table(FontDirectory font_dir)
+{
+    CMap result = {};
+    
+    char *cmap_data = font_dir.cmap_ptr;
+
+    result.version = GET_16_MOVE(cmap_data);
+    result.num_subtables = GET_16_MOVE(cmap_data);
+
+    result.subtables = (Subtable *)font_alloc(result.num_subtables*sizeof(Subtable));
+
+    for(int i = 0; i < result.num_subtables; ++i)
+    {
+        Subtable *subtable = result.subtables + i;
+        subtable->platform_id = GET_16_MOVE(cmap_data);
+        subtable->platform_specific_id = GET_16_MOVE(cmap_data);
+        subtable->offset = GET_32_MOVE(cmap_data);
+    }
+
+    return result;
+}
+
+void print_cmap_table(CMap cmap)
+{
+    fprintf(stdout, "-----------------------\n");
+    fprintf(stdout, "           CMAP        \n");
+    fprintf(stdout, "-----------------------\n");
+    fprintf(stdout, "Version: %d\n", cmap.version);
+    fprintf(stdout, "Number of subtables: %d\n", cmap.num_subtables);
+
+    for(int i = 0; i < cmap.num_subtables; ++i)
+    {
+        Subtable *subtable = cmap.subtables + i;
+        fprintf(stdout, "-----------------------\n");
+        fprintf(stdout, "PlatformID: %d\n", subtable->platform_id);
+        fprintf(stdout, "PlatformEspID: %d\n", subtable->platform_specific_id);
+        fprintf(stdout, "Offset: %d\n", subtable->offset);
+    }
+}
+
+// NOTE: Higher is better, 0 means we cannot use the subtable
+static i32 get_subtable_priority(Subtable subtable, u16 format)
+{
+    i32 unicode = (subtable.platform_id == 0) ||
+                  (subtable.platform_id == 3 && (subtable.platform_specific_id == 1 ||
+                                                 subtable.platform_specific_id == 10));
+    if(!unicode) return 0;
+    if(format == 12) return 2;
+    if(format == 4) return 1;
+    return 0;
+}
+
+i32 find_cmap_subtable(FontDirectory font_dir, CMap cmap, u16 format)
+{
+    i32 result = -1;
+    i32 best_priority = 0;
+    for(i32 i = 0; i < cmap.num_subtables; ++i)
+    {
+        u16 subtable_format = GET_16(font_dir.cmap_ptr + cmap.subtables[i].offset);
+        if(format && subtable_format != format) continue;
+        i32 priority = get_subtable_priority(cmap.subtables[i], subtable_format);
+        if(priority > best_priority)
+        {
+            best_priority = priority;
+            result = i;
+        }
+    }
+    return result;
+}
+
+Format4 load_format4(FontDirectory font_dir, CMap cmap)
+{
+    Format4 result = {};
+    i32 subtable_index = find_cmap_subtable(font_dir, cmap, 4);
+    if(subtable_index < 0)
+    {
+        return result;
+    }
+    char * format_data = font_dir.cmap_ptr + cmap.subtables[subtable_index].offset;
+
+    result.format = GET_16_MOVE(format_data);
+    result.length = GET_16_MOVE(format_data);
+    result.language = GET_16_MOVE(format_data);
+    result.seg_count_x2 = GET_16_MOVE(format_data);
+    result.search_range = GET_16_MOVE(format_data);
+    result.entry_selector = GET_16_MOVE(format_data);
+    result.range_shift = GET_16_MOVE(format_data);
+ 
+    // NOTE(tomi): Only allocates memory for the arrays not for the format struct 
+    // NOTE: The 7 header fields and the reserved pad are the only parts of
+    // the subtable that are not stored in the arrays
+    u32 format_array_size = result.length - 8*sizeof(u16);
+    u8 *format_array = (u8 *)font_alloc(format_array_size);
+    
+    result.end_code = (u16 *)format_array;
+    result.start_code = result.end_code + (result.seg_count_x2/2); 
+    result.id_delta = result.start_code + (result.seg_count_x2/2); 
+    result.id_range_offset = result.id_delta + (result.seg_count_x2/2); 
+    result.glyph_index_array = result.id_range_offset + (result.seg_count_x2/2);
+    
+    // NOTE(tomi): We are performing this subtraction in u16 so the result have
+    // to be multiply by two to get the total bytes
+    int bytes_used = (result.glyph_index_array - result.end_code) * 2;
+    
+    // NOTE(tomi): I cannot use memcpy here becouse the file have al is data
+    // in big endian so we need to switch with GET_16 or GET_32
+    for(int i = 0; i < result.seg_count_x2/2; i++)
+    {
+        result.end_code[i] = GET_16_MOVE(format_data);
+    }
+    // NOTE(tomi): Jump the reserve u16 
+    MOVE_P(format_data, 2);
+    for(int i = 0; i < result.seg_count_x2/2; i++)
+    {
+        result.start_code[i] = GET_16_MOVE(format_data);
+    }
+    for(int i = 0; i < result.seg_count_x2/2; i++)
+    {
+        result.id_delta[i] = GET_16_MOVE(format_data);
+    }
+    for(int i = 0; i < result.seg_count_x2/2; i++)
+    {
+        result.id_range_offset[i] = GET_16_MOVE(format_data);
+    }
+     
+    int bytes_left = format_array_size - bytes_used;
+    for(int i = 0; i < bytes_left/2; ++i)
+    {
+        result.glyph_index_array[i] = GET_16_MOVE(format_data); 
+    }
+
+    return result;
+}
+
+void print_format4(Format4 format)
+{
+    fprintf(stdout, "-----------------------\n");
+    fprintf(stdout, "         FORMAT        \n");
+    fprintf(stdout, "-----------------------\n");
+    fprintf(stdout, "Format: %d\n", format.format);
+    fprintf(stdout, "SegCountX2: %d\n", format.seg_count_x2);
+
+    for(int i = 0; i < format.seg_count_x2/2; i++)
+    {
+        fprintf(stdout, "start code: %d\t\t", format.start_code[i]);
+        fprintf(stdout, "end code: %d\t\t", format.end_code[i]);
+        fprintf(stdout, "id_delta: %d\t\t", format.id_delta[i]);
+        fprintf(stdout, "id_range_offset: %d\n", format.id_range_offset[i]);
+    }
+}
+
+u16 get_glyph_index(Format4 format, u16 char_code)
+{
+    i32 index = -1;
+    u16 *ptr = 0;
+    for(int i = 0; i < format.seg_count_x2/2; i++)
+    {
+        if(format.end_code[i] >= char_code)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    if(index != -1)
+    {
+        if(format.start_code[index] <= char_code)
+        {
+            if(format.id_range_offset[index])
+            {
+                ptr = (format.id_range_offset + index) + 
+                      (format.id_range_offset[index] / 2) + 
+                      (char_code - format.start_code[index]);
+                if(*ptr)
+                {
+                    return (*ptr + format.id_delta[index]);
+                }
+            }
+            else
+            {
+                return (char_code + format.id_delta[index]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// NOTE: Glyph indices of a dense block of the BMP, blocks without any mapped
+// codepoint share this page so they never fall back to the binary search
+static u16 char_map_empty_page[CHAR_MAP_PAGE_SIZE];
+
+static void push_char_map_group(CharMap *map, i32 *capacity, u32 code_point, u32 glyph_index)
+{
+    if(!glyph_index) return;
+
+    if(map->group_count)
+    {
+        CharMapGroup *last = map->groups + map->group_count - 1;
+        if(last->end_code + 1 == code_point &&
+           last->start_glyph + (last->end_code - last->start_code) + 1 == glyph_index)
+        {
+            last->end_code = code_point;
+            return;
+        }
+    }
+
+    if(map->group_count == *capacity)
+    {
+        i32 new_capacity = *capacity ? *capacity*2 : 64;
+        CharMapGroup *groups = (CharMapGroup *)font_alloc(new_capacity*sizeof(CharMapGroup));
+        if(map->group_count)
+        {
+            memcpy(groups, map->groups, map->group_count*sizeof(CharMapGroup));
+        }
+        font_free(map->groups);
+        map->groups = groups;
+        *capacity = new_capacity;
+    }
+
+    CharMapGroup *group = map->groups + map->group_count++;
+    group->start_code = code_point;
+    group->end_code = code_point;
+    group->start_glyph = glyph_index;
+}
+
+static void load_char_map_format4(CharMap *map, u8 *data)
+{
+    i32 capacity = 0;
+    u16 seg_count = GET_16(data + 6) / 2;
+    u8 *end_code = data + 14;
+    u8 *start_code = end_code + seg_count*2 + 2;
+    u8 *id_delta = start_code + seg_count*2;
+    u8 *id_range_offset = id_delta + seg_count*2;
+
+    for(i32 i = 0; i < seg_count; ++i)
+    {
+        u32 start = GET_16(start_code + i*2);
+        u32 end = GET_16(end_code + i*2);
+        u16 delta = GET_16(id_delta + i*2);
+        u16 range_offset = GET_16(id_range_offset + i*2);
+        if(start == 0xFFFF) break;
+
+        for(u32 code = start; code <= end; ++code)
+        {
+            u16 glyph_index = 0;
+            if(range_offset)
+            {
+                u8 *glyph_ptr = id_range_offset + i*2 + range_offset + (code - start)*2;
+                glyph_index = GET_16(glyph_ptr);
+                if(glyph_index)
+                {
+                    glyph_index = (u16)(glyph_index + delta);
+                }
+            }
+            else
+            {
+                glyph_index = (u16)(code + delta);
+            }
+            push_char_map_group(map, &capacity, code, glyph_index);
+        }
+    }
+}
+
+static void load_char_map_format12(CharMap *map, u8 *data)
+{
+    i32 capacity = 0;
+    u32 group_count = GET_32(data + 12);
+    u8 *group_data = data + 16;
+    for(u32 i = 0; i < group_count; ++i)
+    {
+        u32 start = GET_32(group_data);
+        u32 end = GET_32(group_data + 4);
+        u32 start_glyph = GET_32(group_data + 8);
+        MOVE_P(group_data, 12);
+        if(end < start || end > 0x10FFFF) continue;
+
+        // NOTE: The binary search needs the groups sorted and apart. A group
+        // that overlaps the one before keeps the code points past it, the
+        // earlier group wins the others like it would in a linear lookup
+        if(map->group_count && map->groups[map->group_count - 1].end_code >= start)
+        {
+            u32 previous_end = map->groups[map->group_count - 1].end_code;
+            if(previous_end >= end) continue;
+            start_glyph += previous_end + 1 - start;
+            start = previous_end + 1;
+        }
+        if(!start_glyph)
+        {
+            if(start == end) continue;
+            ++start;
+            start_glyph = 1;
+        }
+        push_char_map_group(map, &capacity, start, start_glyph);
+        map->groups[map->group_count - 1].end_code = end;
+    }
+}
+
+static u16 char_map_search(CharMap *map, u32 code_point)
+{
+    i32 low = 0;
+    i32 high = map->group_count - 1;
+    while(low <= high)
+    {
+        i32 middle = (low + high) / 2;
+        CharMapGroup *group = map->groups + middle;
+        if(code_point < group->start_code)
+        {
+            high = middle - 1;
+        }
+        else if(code_point > group->end_code)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return (u16)(group->start_glyph + (code_point - group->start_code));
+        }
+    }
+    return 0;
+}
+
+CharMap load_char_map(FontDirectory font_dir)
+{
+    CharMap result = {};
+    CMap cmap = load_cmap_table(font_dir);
+    i32 subtable_index = find_cmap_subtable(font_dir, cmap, 0);
+    if(subtable_index >= 0)
+    {
+        u8 *data = (u8 *)font_dir.cmap_ptr + cmap.subtables[subtable_index].offset;
+        result.format = GET_16(data);
+        if(result.format == 12)
+        {
+            load_char_map_format12(&result, data);
+        }
+        else
+        {
+            load_char_map_format4(&result, data);
+        }
+    }
+    font_free(cmap.subtables);
+
+    // NOTE: Count mapped codepoints per BMP block to decide which blocks get
+    // a flat table
+    u16 mapped[CHAR_MAP_PAGE_COUNT] = {};
+    for(i32 i = 0; i < result.group_count; ++i)
+    {
+        CharMapGroup *group = result.groups + i;
+        for(u32 code = group->start_code; code <= group->end_code && code < 0x10000; ++code)
+        {
+            ++mapped[code / CHAR_MAP_PAGE_SIZE];
+        }
+    }
+
+    i32 dense_pages = 0;
+    for(i32 i = 0; i < CHAR_MAP_PAGE_COUNT; ++i)
+    {
+        if(mapped[i] >= CHAR_MAP_DENSE_THRESHOLD) ++dense_pages;
+    }
+    result.dense_page_count = dense_pages;
+    result.dense_pages = (u16 *)font_alloc(MAX(dense_pages, 1)*CHAR_MAP_PAGE_SIZE*sizeof(u16));
+
+    result.bmp_pages = (u16 **)font_alloc(CHAR_MAP_PAGE_COUNT*sizeof(u16 *));
+    memset(result.bmp_pages, 0, CHAR_MAP_PAGE_COUNT*sizeof(u16 *));
+
+    u16 *next_page = result.dense_pages;
+    for(i32 i = 0; i < CHAR_MAP_PAGE_COUNT; ++i)
+    {
+        if(!mapped[i])
+        {
+            result.bmp_pages[i] = char_map_empty_page;
+        }
+        else if(mapped[i] >= CHAR_MAP_DENSE_THRESHOLD)
+        {
+            for(i32 j = 0; j < CHAR_MAP_PAGE_SIZE; ++j)
+            {
+                next_page[j] = char_map_search(&result, i*CHAR_MAP_PAGE_SIZE + j);
+            }
+            result.bmp_pages[i] = next_page;
+            next_page += CHAR_MAP_PAGE_SIZE;
+        }
+    }
+
+    return result;
+}
+
+void free_char_map(CharMap *map)
+{
+    font_free(map->groups);
+    font_free(map->dense_pages);
+    font_free(map->bmp_pages);
+    CharMap zero = {};
+    *map = zero;
+}
+
+u16 char_map_lookup(CharMap *map, u32 code_point)
+{
+    if(code_point < 0x10000)
+    {
+        u16 *page = map->bmp_pages[code_point / CHAR_MAP_PAGE_SIZE];
+        if(page)
+        {
+            return page[code_point % CHAR_MAP_PAGE_SIZE];
+        }
+    }
+    return char_map_search(map, code_point);
+}
+
+i32 char_map_utf8(CharMap *map, const char *text, u16 *glyph_indices, i32 max_glyphs)
+{
+    i32 count = 0;
+    u8 *bytes = (u8 *)text;
+    u16 *ascii_page = map->bmp_pages[0];
+    while(*bytes && count < max_glyphs)
+    {
+        // NOTE: Runs of ASCII go straight through the first page
+        if(bytes[0] < 0x80 && ascii_page)
+        {
+            glyph_indices[count++] = ascii_page[bytes[0]];
+            ++bytes;
+            continue;
+        }
+
+        u32 code_point = 0;
+        i32 length = utf8_decode((char *)bytes, &code_point);
+        glyph_indices[count++] = char_map_lookup(map, code_point);
+        bytes += length;
+    }
+    return count;
+}
+
+i16 get_loca_version(FontDirectory font_dir)
+{
+    i16 result = GET_16(font_dir.head_ptr + 50);
+    return result;
+}
+
+u32 get_glyph_offset(FontDirectory font_dir, u16 glyp_index)
+{
+    u32 result = 0;
+    u32 u32_table = get_loca_version(font_dir);
+    if(u32_table)
+    {
+        result = GET_32((u32 *)font_dir.loca_ptr + glyp_index); 
+    }
+    else // u16_table
+    {
+        result = GET_16((u16 *)font_dir.loca_ptr + glyp_index) * 2; 
+    }
+    return result;
+}
+
+Glyph get_glyph(Arena *arena, FontDirectory font_dir, Format4 format, u16 char_code)
+{
+    u16 glyph_index = get_glyph_index(format, char_code);
+    Glyph result = get_glyph_by_index(arena, font_dir, glyph_index);
+    return result;
+}
+
+u16 get_glyph_count(FontDirectory font_dir)
+{
+    u16 result = 0;
+    if(font_dir.maxp_ptr)
+    {
+        result = GET_16(font_dir.maxp_ptr + 4);
+    }
+    return result;
+}
+
+static Glyph decode_glyph(Arena *arena, FontDirectory font_dir, u16 glyph_index, GlyphCache *cache, i32 depth);
+
+// NOTE: Component outline of a composite glyph. Cached components are decoded
+// once into the cache arena, without a cache they go to the scratch arena
+static Glyph get_component_glyph(FontDirectory font_dir, u16 glyph_index, GlyphCache *cache, i32 depth)
+{
+    if(!cache)
+    {
+        return decode_glyph(get_scratch_arena(), font_dir, glyph_index, 0, depth);
+    }
+
+    if(!cache->slots)
+    {
+        cache->glyph_count = get_glyph_count(font_dir);
+        cache->slots = (i32 *)font_alloc(cache->glyph_count*sizeof(i32));
+        memset(cache->slots, 0, cache->glyph_count*sizeof(i32));
+    }
+    if(glyph_index >= cache->glyph_count)
+    {
+        Glyph empty = {};
+        return empty;
+    }
+
+    i32 slot = cache->slots[glyph_index];
+    if(slot)
+    {
+        ++cache->hits;
+        STAT_ADD(STAT_COMPONENT_CACHE_HITS, 1);
+        return cache->glyphs[slot - 1];
+    }
+
+    ++cache->misses;
+    STAT_ADD(STAT_COMPONENT_CACHE_MISSES, 1);
+    Glyph glyph = decode_glyph(&cache->arena, font_dir, glyph_index, cache, depth);
+    if(cache->count == cache->capacity)
+    {
+        i32 new_capacity = cache->capacity ? cache->capacity*2 : 64;
+        Glyph *glyphs = (Glyph *)font_alloc(new_capacity*sizeof(Glyph));
+        if(cache->count)
+        {
+            memcpy(glyphs, cache->glyphs, cache->count*sizeof(Glyph));
+        }
+        font_free(cache->glyphs);
+        cache->glyphs = glyphs;
+        cache->capacity = new_capacity;
+    }
+    cache->glyphs[cache->count++] = glyph;
+    cache->slots[glyph_index] = cache->count;
+    return glyph;
+}
+
+static f32 get_f2dot14(u8 *mem)
+{
+    i16 value = (i16)GET_16(mem);
+    return (f32)value / 16384.0f;
+}
+
+typedef struct
+{
+    Glyph glyph;
+    u16 flags;
+    // NOTE: x' = a*x + c*y + dx, y' = b*x + d*y + dy
+    f32 a, b, c, d;
+    i32 arg1, arg2;
+} GlyphComponent;
+
+static Glyph decode_composite_glyph(Arena *arena, FontDirectory font_dir, Glyph header, u8 *glyph_ptr,
+                                    GlyphCache *cache, i32 depth)
+{
+    Glyph result = header;
+    result.number_of_contours = 0;
+
+    // NOTE: Composites can nest, a broken font could also make them loop
+    if(depth >= GLYPH_MAX_COMPONENT_DEPTH)
+    {
+        return result;
+    }
+
+    // NOTE: The components are read first so the outline arrays can be
+    // allocated with their final size
+    i32 component_count = 0;
+    u8 *component_ptr = glyph_ptr;
+    u16 flags = 0;
+    do
+    {
+        flags = GET_16(component_ptr);
+        component_ptr += 4;
+        component_ptr += (flags & COMPONENT_ARG_1_AND_2_ARE_WORDS) ? 4 : 2;
+        if(flags & COMPONENT_WE_HAVE_A_SCALE) component_ptr += 2;
+        else if(flags & COMPONENT_WE_HAVE_AN_X_AND_Y_SCALE) component_ptr += 4;
+        else if(flags & COMPONENT_WE_HAVE_A_TWO_BY_TWO) component_ptr += 8;
+        ++component_count;
+    } while(flags & COMPONENT_MORE_COMPONENTS);
+
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+    GlyphComponent *components = ARENA_PUSH_ARRAY(scratch, GlyphComponent, component_count);
+
+    i32 point_count = 0;
+    i32 contour_count = 0;
+    for(i32 i = 0; i < component_count; ++i)
+    {
+        GlyphComponent *component = components + i;
+        component->flags = GET_16_MOVE(glyph_ptr);
+        u16 component_index = GET_16_MOVE(glyph_ptr);
+        if(component->flags & COMPONENT_ARG_1_AND_2_ARE_WORDS)
+        {
+            component->arg1 = (i16)GET_16_MOVE(glyph_ptr);
+            component->arg2 = (i16)GET_16_MOVE(glyph_ptr);
+        }
+        else if(component->flags & COMPONENT_ARGS_ARE_XY_VALUES)
+        {
+            component->arg1 = (i8)glyph_ptr[0];
+            component->arg2 = (i8)glyph_ptr[1];
+            MOVE_P(glyph_ptr, 2);
+        }
+        else
+        {
+            component->arg1 = glyph_ptr[0];
+            component->arg2 = glyph_ptr[1];
+            MOVE_P(glyph_ptr, 2);
+        }
+
+        component->a = 1.0f;
+        component->b = 0.0f;
+        component->c = 0.0f;
+        component->d = 1.0f;
+        if(component->flags & COMPONENT_WE_HAVE_A_SCALE)
+        {
+            component->a = component->d = get_f2dot14(glyph_ptr);
+            MOVE_P(glyph_ptr, 2);
+        }
+        else if(component->flags & COMPONENT_WE_HAVE_AN_X_AND_Y_SCALE)
+        {
+            component->a = get_f2dot14(glyph_ptr);
+            component->d = get_f2dot14(glyph_ptr + 2);
+            MOVE_P(glyph_ptr, 4);
+        }
+        else if(component->flags & COMPONENT_WE_HAVE_A_TWO_BY_TWO)
+        {
+            component->a = get_f2dot14(glyph_ptr);
+            component->b = get_f2dot14(glyph_ptr + 2);
+            component->c = get_f2dot14(glyph_ptr + 4);
+            component->d = get_f2dot14(glyph_ptr + 6);
+            MOVE_P(glyph_ptr, 8);
+        }
+
+        component->glyph = get_component_glyph(font_dir, component_index, cache, depth + 1);
+        if(component->glyph.number_of_contours > 0)
+        {
+            contour_count += component->glyph.number_of_contours;
+            point_count += get_glyph_point_count(component->glyph);
+        }
+    }
+
+    if(contour_count > 0)
+    {
+        result.number_of_contours = (i16)contour_count;
+        result.end_pts_of_contours = ARENA_PUSH_ARRAY(arena, u16, contour_count);
+        result.flags = ARENA_PUSH_ARRAY(arena, OutlineFlag, point_count);
+        result.x_coords = ARENA_PUSH_ARRAY(arena, i16, point_count);
+        result.y_coords = ARENA_PUSH_ARRAY(arena, i16, point_count);
+
+        i32 point_base = 0;
+        i32 contour_base = 0;
+        for(i32 i = 0; i < component_count; ++i)
+        {
+            GlyphComponent *component = components + i;
+            Glyph glyph = component->glyph;
+            if(glyph.number_of_contours <= 0) continue;
+
+            i32 glyph_points = get_glyph_point_count(glyph);
+            f32 dx = 0.0f;
+            f32 dy = 0.0f;
+            if(component->flags & COMPONENT_ARGS_ARE_XY_VALUES)
+            {
+                dx = (f32)component->arg1;
+                dy = (f32)component->arg2;
+                if((component->flags & COMPONENT_SCALED_COMPONENT_OFFSET) &&
+                   !(component->flags & COMPONENT_UNSCALED_COMPONENT_OFFSET))
+                {
+                    f32 x = dx;
+                    dx = component->a*x + component->c*dy;
+                    dy = component->b*x + component->d*dy;
+                }
+            }
+            else if(component->arg1 < point_base && component->arg2 < glyph_points)
+            {
+                // NOTE: Align a point of the component with a point that is
+                // already in the composite
+                f32 x = glyph.x_coords[component->arg2];
+                f32 y = glyph.y_coords[component->arg2];
+                dx = result.x_coords[component->arg1] - (component->a*x + component->c*y);
+                dy = result.y_coords[component->arg1] - (component->b*x + component->d*y);
+            }
+
+            for(i32 j = 0; j < glyph.number_of_contours; ++j)
+            {
+                result.end_pts_of_contours[contour_base + j] = (u16)(glyph.end_pts_of_contours[j] + point_base);
+            }
+            for(i32 j = 0; j < glyph_points; ++j)
+            {
+                f32 x = glyph.x_coords[j];
+                f32 y = glyph.y_coords[j];
+                result.x_coords[point_base + j] = (i16)floorf(component->a*x + component->c*y + dx + 0.5f);
+                result.y_coords[point_base + j] = (i16)floorf(component->b*x + component->d*y + dy + 0.5f);
+                result.flags[point_base + j].flag = glyph.flags[j].flag & 1;
+            }
+
+            point_base += glyph_points;
+            contour_base += glyph.number_of_contours;
+        }
+    }
+
+    // NOTE: When the result lives in the scratch arena it was pushed after
+    // the components, so they can only go away with the next reset
+    if(arena != scratch)
+    {
+        arena_end_temp(temp);
+    }
+    return result;
+}
+
+// NOTE: Coordinates are deltas from the previous point. With the short bit a
+// delta is one unsigned byte and the same bit gives its sign, without it the
+// same bit means delta 0 and otherwise the delta is a big endian i16
+static u8 *decode_glyph_coordinates_scalar(u8 *glyph_ptr, OutlineFlag *flags, i32 start, i32 count,
+                                           u8 short_bit, u8 same_bit, i16 *coords)
+{
+    i16 prev_coord = start ? coords[start - 1] : 0;
+    for(i32 i = start; i < count; ++i)
+    {
+        i16 current_coord = 0;
+        u8 flag = flags[i].flag;
+        if(flag & short_bit)
+        {
+            current_coord = (flag & same_bit) ? *glyph_ptr : -*glyph_ptr;
+            glyph_ptr++;
+        }
+        else if(!(flag & same_bit))
+        {
+            current_coord = GET_16_MOVE(glyph_ptr);
+        }
+        coords[i] = current_coord + prev_coord;
+        prev_coord = coords[i];
+    }
+    return glyph_ptr;
+}
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <tmmintrin.h>
+
+// NOTE: 8 points per iteration. The byte size of every delta (0, 1 or 2) is
+// prefix summed to find where it starts, that builds the pshufb control that
+// gathers the deltas into 8 lanes of 16 bits (swapping the big endian ones),
+// then the deltas get their sign and are prefix summed on top of the last
+// coordinate of the previous 8 points
+__attribute__((target("ssse3")))
+static i32 decode_glyph_coordinates_ssse3(u8 **glyph_ptr, u8 *glyph_end, OutlineFlag *flags, i32 count,
+                                          u8 short_bit, u8 same_bit, i16 *coords)
+{
+    u8 *ptr = *glyph_ptr;
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi16(1);
+    __m128i short_mask = _mm_set1_epi16(short_bit);
+    __m128i same_mask = _mm_set1_epi16(same_bit);
+    __m128i unused = _mm_set1_epi16(0x80);
+    __m128i carry = zero;
+    i32 i = 0;
+    for(; i + 8 <= count && ptr + 16 <= glyph_end; i += 8)
+    {
+        __m128i flag = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(flags + i)), zero);
+        __m128i is_short = _mm_cmpeq_epi16(_mm_and_si128(flag, short_mask), short_mask);
+        __m128i is_same = _mm_cmpeq_epi16(_mm_and_si128(flag, same_mask), same_mask);
+        __m128i is_word = _mm_andnot_si128(_mm_or_si128(is_short, is_same), _mm_set1_epi16(-1));
+
+        // NOTE: 1 for short, 2 for word, 0 for repeated coordinates
+        __m128i size = _mm_sub_epi16(_mm_and_si128(is_short, one), _mm_add_epi16(is_word, is_word));
+        __m128i end = _mm_add_epi16(size, _mm_slli_si128(size, 2));
+        end = _mm_add_epi16(end, _mm_slli_si128(end, 4));
+        end = _mm_add_epi16(end, _mm_slli_si128(end, 8));
+        __m128i offset = _mm_sub_epi16(end, size);
+
+        // NOTE: Low byte of the lane is the last byte of the delta, the high
+        // byte is the first one for words and empty otherwise
+        __m128i low = _mm_sub_epi16(end, one);
+        low = _mm_or_si128(_mm_and_si128(_mm_or_si128(is_short, is_word), low),
+                           _mm_and_si128(_mm_cmpeq_epi16(size, zero), unused));
+        __m128i high = _mm_or_si128(_mm_and_si128(is_word, offset), _mm_andnot_si128(is_word, unused));
+        __m128i control = _mm_or_si128(low, _mm_slli_epi16(high, 8));
+        __m128i delta = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)ptr), control);
+
+        // NOTE: Short deltas without the same bit are negative
+        __m128i negative = _mm_andnot_si128(is_same, is_short);
+        delta = _mm_sub_epi16(_mm_xor_si128(delta, negative), negative);
+
+        delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 2));
+        delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 4));
+        delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 8));
+        delta = _mm_add_epi16(delta, carry);
+        _mm_storeu_si128((__m128i *)(coords + i), delta);
+        carry = _mm_shufflehi_epi16(_mm_unpackhi_epi64(delta, delta), 0xFF);
+        carry = _mm_unpackhi_epi64(carry, carry);
+
+        ptr += _mm_extract_epi16(end, 7);
+    }
+    *glyph_ptr = ptr;
+    return i;
+}
+#endif
+
+static u8 *decode_glyph_coordinates(u8 *glyph_ptr, u8 *glyph_end, OutlineFlag *flags, i32 count,
+                                    u8 short_bit, u8 same_bit, i16 *coords)
+{
+    i32 start = 0;
+#if defined(__SSE2__) && defined(__GNUC__)
+    if(__builtin_cpu_supports("ssse3"))
+    {
+        start = decode_glyph_coordinates_ssse3(&glyph_ptr, glyph_end, flags, count, short_bit, same_bit, coords);
+    }
+#else
+    (void)glyph_end;
+#endif
+    glyph_ptr = decode_glyph_coordinates_scalar(glyph_ptr, flags, start, count, short_bit, same_bit, coords);
+    return glyph_ptr;
+}
+
+static u8 *decode_glyph_flags(u8 *glyph_ptr, OutlineFlag *flags, i32 count)
+{
+    for(i32 i = 0; i < count; ++i)
+    {
+        flags[i].flag = *glyph_ptr;
+        glyph_ptr++;
+        if(flags[i].repeat)
+        {
+            // NOTE: A run of the same flag
+            i32 repeat_count = MIN(*glyph_ptr, count - 1 - i);
+            memset(flags + i + 1, flags[i].flag, repeat_count);
+            i += repeat_count;
+            glyph_ptr++;
+        }
+    }
+    return glyph_ptr;
+}
+
+i32 compare_glyph_coordinate_decoders(FontDirectory font_dir, u16 glyph_index, i32 *vector_count)
+{
+    i32 result = 0;
+    *vector_count = 0;
+#if defined(__SSE2__) && defined(__GNUC__)
+    u16 glyph_count = get_glyph_count(font_dir);
+    if(!__builtin_cpu_supports("ssse3") || (glyph_count && glyph_index >= glyph_count))
+    {
+        return result;
+    }
+    u32 glyph_offset = get_glyph_offset(font_dir, glyph_index);
+    u32 next_offset = get_glyph_offset(font_dir, glyph_index + 1);
+    u8 *glyph_ptr = (u8 *)font_dir.glyf_ptr + glyph_offset;
+    u8 *glyph_end = (u8 *)font_dir.glyf_ptr + next_offset;
+    i16 number_of_contours = glyph_offset == next_offset ? 0 : (i16)GET_16(glyph_ptr);
+    if(number_of_contours <= 0)
+    {
+        return result;
+    }
+
+    // NOTE: Same walk to the coordinates as decode_glyph
+    MOVE_P(glyph_ptr, 10);
+    i32 array_size = GET_16(glyph_ptr + (number_of_contours - 1)*2) + 1;
+    MOVE_P(glyph_ptr, number_of_contours*2);
+    u16 instruction_length = GET_16_MOVE(glyph_ptr);
+    MOVE_P(glyph_ptr, instruction_length);
+
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+    OutlineFlag *flags = ARENA_PUSH_ARRAY(temp.arena, OutlineFlag, array_size);
+    glyph_ptr = decode_glyph_flags(glyph_ptr, flags, array_size);
+    i16 *scalar_coords = ARENA_PUSH_ARRAY(temp.arena, i16, array_size);
+    i16 *vector_coords = ARENA_PUSH_ARRAY(temp.arena, i16, array_size);
+    u8 *scalar_ptr = glyph_ptr;
+    u8 *vector_ptr = glyph_ptr;
+    for(i32 axis = 0; axis < 2; ++axis)
+    {
+        u8 short_bit = axis ? FLAG_Y_SHORT : FLAG_X_SHORT;
+        u8 same_bit = axis ? FLAG_Y_SAME : FLAG_X_SAME;
+        scalar_ptr = decode_glyph_coordinates_scalar(scalar_ptr, flags, 0, array_size, short_bit, same_bit,
+                                                     scalar_coords);
+        i32 start = decode_glyph_coordinates_ssse3(&vector_ptr, glyph_end, flags, array_size, short_bit, same_bit,
+                                                   vector_coords);
+        vector_ptr = decode_glyph_coordinates_scalar(vector_ptr, flags, start, array_size, short_bit, same_bit,
+                                                     vector_coords);
+        *vector_count += start;
+        for(i32 i = 0; i < array_size; ++i)
+        {
+            result += scalar_coords[i] != vector_coords[i];
+        }
+        result += scalar_ptr != vector_ptr;
+    }
+    arena_end_temp(temp);
+#else
+    (void)font_dir;
+    (void)glyph_index;
+#endif
+    return result;
+}
+
+Glyph get_glyph_by_index(Arena *arena, FontDirectory font_dir, u16 glyph_index)
+{
+    STAT_TIMER_BEGIN(STAT_STAGE_DECODE, timer);
+    Glyph result = decode_glyph(arena, font_dir, glyph_index, 0, 0);
+    STAT_TIMER_END(STAT_STAGE_DECODE, timer);
+    return result;
+}
+
+static Glyph decode_glyph(Arena *arena, FontDirectory font_dir, u16 glyph_index, GlyphCache *cache, i32 depth)
+{
+    Glyph result = {};
+    u16 glyph_count = get_glyph_count(font_dir);
+    if(glyph_count && glyph_index >= glyph_count)
+    {
+        return result;
+    }
+
+    u32 glyph_offset = get_glyph_offset(font_dir, glyph_index);
+    u8 *glyph_ptr = (u8 *)font_dir.glyf_ptr + glyph_offset;
+
+    // NOTE: Glyphs without outline (like the space) have the same offset
+    // as the next glyph in the loca table
+    if(glyph_offset == get_glyph_offset(font_dir, glyph_index + 1))
+    {
+        return result;
+    }
+    STAT_ADD(STAT_GLYPHS_DECODED, 1);
+
+    result.number_of_contours = GET_16_MOVE(glyph_ptr);
+    result.x_min = GET_16_MOVE(glyph_ptr);
+    result.y_min = GET_16_MOVE(glyph_ptr);
+    result.x_max = GET_16_MOVE(glyph_ptr);
+    result.y_max = GET_16_MOVE(glyph_ptr);
+
+    if(result.number_of_contours < 0)
+    {
+        return decode_composite_glyph(arena, font_dir, result, glyph_ptr, cache, depth);
+    }
+    if(result.number_of_contours == 0)
+    {
+        return result;
+    }
+
+    result.end_pts_of_contours = ARENA_PUSH_ARRAY(arena, u16, result.number_of_contours);
+    for(int i = 0; i < result.number_of_contours; ++i)
+    {
+        result.end_pts_of_contours[i] = GET_16_MOVE(glyph_ptr);
+    }
+    result.instruction_length = GET_16_MOVE(glyph_ptr);
+    result.instructions = ARENA_PUSH_ARRAY(arena, u8, result.instruction_length);
+    memcpy(result.instructions, glyph_ptr, result.instruction_length);
+    MOVE_P(glyph_ptr, result.instruction_length);
+    
+    i32 array_size = result.end_pts_of_contours[result.number_of_contours-1] + 1;
+    result.flags = ARENA_PUSH_ARRAY(arena, OutlineFlag, array_size);
+    glyph_ptr = decode_glyph_flags(glyph_ptr, result.flags, array_size);
+
+    // NOTE: The vector decoder loads 16 bytes at a time, it can only run while
+    // those bytes are still inside this glyph
+    u8 *glyph_end = (u8 *)font_dir.glyf_ptr + get_glyph_offset(font_dir, glyph_index + 1);
+    result.x_coords = ARENA_PUSH_ARRAY(arena, i16, array_size);
+    glyph_ptr = decode_glyph_coordinates(glyph_ptr, glyph_end, result.flags, array_size,
+                                         FLAG_X_SHORT, FLAG_X_SAME, result.x_coords);
+    result.y_coords = ARENA_PUSH_ARRAY(arena, i16, array_size);
+    glyph_ptr = decode_glyph_coordinates(glyph_ptr, glyph_end, result.flags, array_size,
+                                         FLAG_Y_SHORT, FLAG_Y_SAME, result.y_coords);
+
+    return result;
+}
+
+void print_glyph(Glyph glyph, char char_code)
+{
+    fprintf(stdout, "-----------------------\n");
+    fprintf(stdout, "       GLYPH '%c'\n", char_code);
+    fprintf(stdout, "-----------------------\n");
+    fprintf(stdout, "number_of_contours: %d\n", glyph.number_of_contours);
+    fprintf(stdout, "x_min: %d\n", glyph.x_min);
+    fprintf(stdout, "y_min: %d\n", glyph.y_min);
+    fprintf(stdout, "x_max: %d\n", glyph.x_max);
+    fprintf(stdout, "y_max: %d\n", glyph.y_max);
+
+    for(i32 i = 0; i < glyph.number_of_contours; ++i)
+    {
+        fprintf(stdout, "end_pts_of_contours: %d\n", glyph.end_pts_of_contours[i]);
+    }
+    int last_index = glyph.end_pts_of_contours[glyph.number_of_contours-1];
+    for(int i = 0; i <= last_index; ++i) {
+		printf("%d)\t(%5d,%5d)\n", i, glyph.x_coords[i], glyph.y_coords[i]);
+	}
+}
+
+Hhead load_hhea_table(FontDirectory font_dir)
+{
+    char *hhea_ptr = font_dir.hhea_ptr;
+    Hhead result = {};
+    result.version = GET_32_MOVE(hhea_ptr);
+    
+    result.ascent = GET_16_MOVE(hhea_ptr);
+    result.descent = GET_16_MOVE(hhea_ptr);
+    result.line_gap = GET_16_MOVE(hhea_ptr);
+
+    result.advance_width_max = GET_16_MOVE(hhea_ptr);
+    result.min_left_side_bearing = GET_16_MOVE(hhea_ptr);
+    result.min_right_side_bearing = GET_16_MOVE(hhea_ptr);
+
+    result.x_max_extent = GET_16_MOVE(hhea_ptr);
+
+    result.caret_slope_rise = GET_16_MOVE(hhea_ptr);
+    result.caret_slope_run = GET_16_MOVE(hhea_ptr);
+    result.care_offset = GET_16_MOVE(hhea_ptr);
+
+    result.reserved1 = GET_16_MOVE(hhea_ptr);;
+    result.reserved2 = GET_16_MOVE(hhea_ptr);;
+    result.reserved3 = GET_16_MOVE(hhea_ptr);;
+    result.reserved4 = GET_16_MOVE(hhea_ptr);;
+
+    result.metric_data_format = GET_16_MOVE(hhea_ptr);
+    result.num_of_long_hormetrics = GET_16_MOVE(hhea_ptr);
+    
+    return result;
+}
+
+Hmtx load_hmtx_table(FontDirectory font_dir)
+{
+    // NOTE: The metrics are read straight from the file when needed
+    Hmtx result = {};
+    result.hmtx_ptr = font_dir.hmtx_ptr;
+    result.metric_count = GET_16(font_dir.hhea_ptr + 34);
+    return result;
+}
+
+LongHorMetric get_glyph_h_metric(Hmtx hmtx, u16 glyph_index)
+{
+    LongHorMetric result = {};
+    if(!hmtx.metric_count)
+    {
+        return result;
+    }
+    // NOTE: Glyphs after the last long metric share its advance width and
+    // only store their left side bearing
+    if(glyph_index < hmtx.metric_count)
+    {
+        char *metric = hmtx.hmtx_ptr + glyph_index*4;
+        result.advance_width = GET_16(metric);
+        result.left_side_bearing = GET_16(metric + 2);
+    }
+    else
+    {
+        result.advance_width = GET_16(hmtx.hmtx_ptr + (hmtx.metric_count - 1)*4);
+        result.left_side_bearing = GET_16(hmtx.hmtx_ptr + hmtx.metric_count*4 +
+                                          (glyph_index - hmtx.metric_count)*2);
+    }
+    return result;
+}
+
+static u32 get_table_length(FontDirectory font_dir, u32 tag)
+{
+    TableDirectory table_dir = {};
+    return find_table(font_dir, tag, &table_dir) ? table_dir.length : 0;
+}
+
+Kern load_kern_table(FontDirectory font_dir)
+{
+    Kern result = {};
+    char *kern_ptr = font_dir.kern_ptr;
+    u32 length = get_table_length(font_dir, KERN_TAG);
+    if(!kern_ptr || length < 4 || GET_16(kern_ptr) != 0)
+    {
+        // NOTE: Only the Microsoft version 0 header, the Apple one is 32 bit
+        return result;
+    }
+
+    u16 table_count = GET_16(kern_ptr + 2);
+    u32 offset = 4;
+    for(u16 i = 0; i < table_count && offset + 14 <= length; ++i)
+    {
+        char *subtable = kern_ptr + offset;
+        u16 subtable_length = GET_16(subtable + 2);
+        u16 coverage = GET_16(subtable + 4);
+        u8 format = coverage >> 8;
+        // NOTE: Horizontal, kerning values (not minimums) and not cross stream
+        if(format == 0 && (coverage & 0x7) == 0x1)
+        {
+            u32 pair_count = GET_16(subtable + 6);
+            // NOTE: Big subtables overflow the 16 bit length, trust the table
+            // length instead
+            u32 max_pairs = (length - offset - 14)/6;
+            result.pairs = subtable + 14;
+            result.pair_count = MIN(pair_count, max_pairs);
+            break;
+        }
+        offset += subtable_length;
+    }
+    return result;
+}
+
+i16 get_kern_advance(Kern kern, u16 left_glyph, u16 right_glyph)
+{
+    u32 key = (u32)left_glyph << 16 | right_glyph;
+    u32 low = 0;
+    u32 high = kern.pair_count;
+    while(low < high)
+    {
+        u32 middle = low + (high - low)/2;
+        char *pair = kern.pairs + middle*6;
+        u32 pair_key = (u32)GET_16(pair) << 16 | GET_16(pair + 2);
+        if(pair_key == key)
+        {
+            return (i16)GET_16(pair + 4);
+        }
+        if(pair_key < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return 0;
+}
+
+static inline i32 bezier_segment_count(f32 ax, f32 ay, f32 scale)
+{
+    // NOTE: Splitting a quadratic in n uniform steps leaves a maximum distance
+    // of |p0 - 2*p1 + p2| / (4*n*n) between every chord and the curve, solve
+    // for the smallest n under the tolerance in device pixels. The length is
+    // the octagonal approximation (never short, at most 8% long) to save a root
+    f32 dx = fabsf(ax);
+    f32 dy = fabsf(ay);
+    f32 deviation = (MAX(dx, dy) + 0.5f*MIN(dx, dy))*scale;
+    f32 count = sqrtf(deviation*(1.0f / (4.0f*BEZIER_TOLERANCE)));
+    if(count >= (f32)BEZIER_MAX_SEGMENTS)
+    {
+        return BEZIER_MAX_SEGMENTS;
+    }
+    i32 result = (i32)count;
+    result += (f32)result < count;
+    return MAX(result, 1);
+}
+
+// NOTE(tomi): Cuadratic bezier curve: (1-t)*(1-t)*p0 + 2*t*(1-t)*p1 + t*t*p2
+// NOTE: Evaluated with forward differences as B(t) = a*t*t + b*t + p0, p0 is
+// not written, the last point written is always exactly p2
+static inline i32 flatten_quadratic(v2f *output, v2f p0, v2f p1, v2f p2, f32 scale, i32 max_segments)
+{
+    f32 ax = p0.x - 2.0f*p1.x + p2.x;
+    f32 ay = p0.y - 2.0f*p1.y + p2.y;
+    i32 segments = MIN(bezier_segment_count(ax, ay, scale), max_segments);
+
+    f32 step = 1.0f/(f32)segments;
+    f32 step2 = step*step;
+    f32 d1x = ax*step2 + 2.0f*(p1.x - p0.x)*step;
+    f32 d1y = ay*step2 + 2.0f*(p1.y - p0.y)*step;
+    f32 d2x = 2.0f*ax*step2;
+    f32 d2y = 2.0f*ay*step2;
+    f32 x = p0.x;
+    f32 y = p0.y;
+    for(i32 i = 0; i < segments - 1; ++i)
+    {
+        x += d1x;
+        y += d1y;
+        d1x += d2x;
+        d1y += d2y;
+        output[i].x = x;
+        output[i].y = y;
+    }
+    output[segments - 1] = p2;
+    return segments;
+}
+
+i32 get_bezier_segment_count(v2f p0, v2f p1, v2f p2, f32 scale)
+{
+    i32 result = bezier_segment_count(p0.x - 2.0f*p1.x + p2.x, p0.y - 2.0f*p1.y + p2.y, scale);
+    return result;
+}
+
+void generate_bezier_points(v2f *output, i32 *output_size, v2f p0, v2f p1, v2f p2, f32 scale)
+{
+    *output_size = flatten_quadratic(output, p0, p1, p2, scale, BEZIER_MAX_SEGMENTS);
+}
+
+static i32 get_box_max_bezier_segments(i32 width, i32 height, f32 scale)
+{
+    // NOTE: With the three control points inside the bounding box the
+    // deviation is never bigger than twice its size
+    i32 result = bezier_segment_count(2.0f*(f32)width, 2.0f*(f32)height, scale);
+    return result;
+}
+
+static i32 get_glyph_max_bezier_segments(Glyph glyph, f32 scale)
+{
+    return get_box_max_bezier_segments(glyph.x_max - glyph.x_min, glyph.y_max - glyph.y_min, scale);
+}
+
+i32 get_glyph_point_count(Glyph glyph)
+{
+    if(glyph.number_of_contours <= 0)
+    {
+        return 0;
+    }
+    i32 result = glyph.end_pts_of_contours[glyph.number_of_contours-1] + 1;
+    return result;
+}
+
+i32 get_glyph_curve_count(Glyph glyph)
+{
+    i32 result = 0;
+    i32 point_count = get_glyph_point_count(glyph);
+    for(i32 i = 0; i < point_count; ++i)
+    {
+        result += !glyph.flags[i].on_curver;
+    }
+    return result;
+}
+
+GlyphInfo get_glyph_outline_info(Glyph glyph)
+{
+    GlyphInfo result = {};
+    if(glyph.number_of_contours > 0)
+    {
+        result.number_of_contours = glyph.number_of_contours;
+        result.x_min = glyph.x_min;
+        result.y_min = glyph.y_min;
+        result.x_max = glyph.x_max;
+        result.y_max = glyph.y_max;
+        result.point_count = get_glyph_point_count(glyph);
+        result.curve_count = get_glyph_curve_count(glyph);
+    }
+    return result;
+}
+
+// NOTE: An on curve point is written at most once (not at all when it ends a
+// curve), a curve at most max_segments times and every contour adds one more
+// point to close itself
+static i32 get_flattened_max_points(GlyphInfo info, i32 max_segments)
+{
+    if(info.number_of_contours <= 0)
+    {
+        return 0;
+    }
+    i32 result = (i32)(info.point_count - info.curve_count) + (i32)info.curve_count*max_segments +
+        info.number_of_contours;
+    return result;
+}
+
+i32 get_glyph_info_max_points(GlyphInfo info, f32 scale)
+{
+    i32 max_segments = get_box_max_bezier_segments(info.x_max - info.x_min, info.y_max - info.y_min, scale);
+    return get_flattened_max_points(info, max_segments);
+}
+
+i32 get_glyph_max_points(Glyph glyph, f32 scale)
+{
+    return get_glyph_info_max_points(get_glyph_outline_info(glyph), scale);
+}
+
+void generate_glyph_points_offset(Glyph glyph, v2f *output, i32 *output_size, f32 scale, v2f offset, i32 *contour_end_index)
+{
+    STAT_TIMER_BEGIN(STAT_STAGE_POINTS, timer);
+    i32 contour_start = 0;
+    i32 output_index = 0;
+    i32 contour_start_index = 0;
+    i32 max_segments = get_glyph_max_bezier_segments(glyph, scale);
+    // NOTE: The curve start is kept here instead of read back from the output,
+    // otherwise every curve waits for the segment count of the previous one
+    v2f last_point = {};
+    for(i32 i = 0; i < glyph.number_of_contours; ++i)
+    {
+        i32 contour_length =  (glyph.end_pts_of_contours[i]+1) - contour_start;
+        
+        for(i32 j = 0; j < contour_length; ++j)
+        {
+            i32 point_index = j + contour_start;
+            i32 next_point_index = ((j + 1) % contour_length) + contour_start; 
+            
+            OutlineFlag flag = glyph.flags[point_index];
+            OutlineFlag next_flag = glyph.flags[next_point_index];           
+            
+            v2f point = { (f32)glyph.x_coords[point_index], (f32)glyph.y_coords[point_index] };
+            v2f next_point = { (f32)glyph.x_coords[next_point_index], (f32)glyph.y_coords[next_point_index] };
+
+            if(flag.on_curver)
+            {
+                output[output_index] = point;
+                output_index += 1;
+                last_point = point;
+            }
+            else
+            {
+                v2f p0 = last_point;
+                v2f p1 = point;
+                v2f p2 = next_point; 
+                if(next_flag.on_curver) // NOTE(tomi): Quadratic curve
+                {
+                    output_index += flatten_quadratic(output + output_index, p0, p1, p2, scale, max_segments);
+                    last_point = p2;
+                    j++; // NOTE(tomi) We already add the next point
+                }
+                else // NOTE(tomi): Cubic curve
+                {
+                    p2.x = p1.x + 0.5f*(p2.x - p1.x);
+                    p2.y = p1.y + 0.5f*(p2.y - p1.y);
+                    output_index += flatten_quadratic(output + output_index, p0, p1, p2, scale, max_segments);
+                    last_point = p2;
+                }
+            }
+        }
+        
+        output[output_index++] = output[contour_start_index];
+        contour_start_index = output_index;
+        contour_start = glyph.end_pts_of_contours[i]+1;
+        contour_end_index[i] = output_index;
+    }
+    *output_size = output_index;
+    for(i32 i = 0; i < output_index; ++i)
+    {
+        output[i].x = scale*(output[i].x - glyph.x_min) + offset.x;
+        output[i].y = scale*(output[i].y - glyph.y_min) + offset.y;
+    }
+    STAT_ADD(STAT_POINTS_GENERATED, output_index);
+    STAT_TIMER_END(STAT_STAGE_POINTS, timer);
+}
+
+void generate_glyph_points(Glyph glyph, v2f *output, i32 *output_size, f32 scale, i32 *contour_end_index)
+{
+    v2f offset = {};
+    generate_glyph_points_offset(glyph, output, output_size, scale, offset, contour_end_index);
+}
+
+Line *generate_glyph_lines(Arena *arena, Glyph glyph, i32 *line_count, v2f *glyph_points, i32 *contour_end_index)
+{
+    if(glyph.number_of_contours <= 0)
+    {
+        *line_count = 0;
+        return 0;
+    }
+
+    STAT_TIMER_BEGIN(STAT_STAGE_LINES, timer);
+    Line *result = ARENA_PUSH_ARRAY(arena, Line, contour_end_index[glyph.number_of_contours-1]);
+    i32 j = 0;
+    i32 line_index = 0;
+    for(i32 i = 0; i < glyph.number_of_contours; ++i)
+    {
+        for(; j < contour_end_index[i]-1; ++j)
+        {
+            Line *line = result + line_index;
+            line->p0.x = glyph_points[j].x; 
+            line->p0.y = glyph_points[j].y; 
+            line->p1.x = glyph_points[j+1].x; 
+            line->p1.y = glyph_points[j+1].y; 
+            ++line_index;
+        }
+        // NOTE(tomi): skip the last point in contour already added
+        ++j;
+    }
+    *line_count = line_index;
+    STAT_ADD(STAT_LINES_EMITTED, line_index);
+    STAT_TIMER_END(STAT_STAGE_LINES, timer);
+    return result;
+}
+
+f32 scale_pixel_height(Hhead hhea, f32 height)
+{
+    f32 result = height / (hhea.ascent - hhea.descent);
+    return result;
+}
+
+v2i get_glyph_info_bitmap_size(GlyphInfo info, f32 scale, v2f offset)
+{
+    v2i result = {};
+    if(info.number_of_contours > 0)
+    {
+        result.x = (i32)(scale*(info.x_max - info.x_min) + offset.x) + 1;
+        result.y = (i32)(scale*(info.y_max - info.y_min) + offset.y) + 1;
+    }
+    return result;
+}
+
+v2i get_glyph_bitmap_size_offset(Glyph glyph, f32 scale, v2f offset)
+{
+    // NOTE: Only the box is needed, the point counts are left out
+    GlyphInfo info = {};
+    if(glyph.number_of_contours > 0)
+    {
+        info.number_of_contours = glyph.number_of_contours;
+        info.x_min = glyph.x_min;
+        info.y_min = glyph.y_min;
+        info.x_max = glyph.x_max;
+        info.y_max = glyph.y_max;
+    }
+    return get_glyph_info_bitmap_size(info, scale, offset);
+}
+
+v2i get_glyph_bitmap_size(Glyph glyph, f32 scale)
+{
+    v2f offset = {};
+    return get_glyph_bitmap_size_offset(glyph, scale, offset);
+}
+
+i32 get_fixed_scale(f32 scale)
+{
+    // NOTE: The product by a power of two is exact, so this is the only
+    // rounding between the float scale and the integer pipeline
+    return (i32)lrintf(scale*65536.0f);
+}
+
+// NOTE: BEZIER_TOLERANCE as the deviation in 1/16 of a 26.6 unit allowed per
+// n*n, deviation/(4*n*n) <= tolerance becomes 16*deviation <= n*n*this
+#define FIXED_BEZIER_TOLERANCE ((i64)(BEZIER_TOLERANCE*4.0f*FIXED_ONE*16.0f))
+
+// NOTE: Floor of the square root, one bit of the root per step from the top
+static inline u32 integer_sqrt(u32 value)
+{
+    u32 result = 0;
+    u32 bit = 1u << 30;
+    while(bit > value)
+    {
+        bit >>= 2;
+    }
+    while(bit)
+    {
+        if(value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+static i32 fixed_bezier_segment_count(i32 ax, i32 ay)
+{
+    i64 dx = ax < 0 ? -(i64)ax : ax;
+    i64 dy = ay < 0 ? -(i64)ay : ay;
+    i64 deviation = 16*(MAX(dx, dy) + MIN(dx, dy)/2);
+    // NOTE: Same solve as bezier_segment_count without floats, the smallest n
+    // with n*n*tolerance >= deviation is the root of the deviation in whole
+    // tolerances (rounded up) rounded up. Past the cap the root is not needed
+    if(deviation > (i64)BEZIER_MAX_SEGMENTS*BEZIER_MAX_SEGMENTS*FIXED_BEZIER_TOLERANCE)
+    {
+        return BEZIER_MAX_SEGMENTS;
+    }
+    u32 tolerances = (u32)((deviation + FIXED_BEZIER_TOLERANCE - 1) / FIXED_BEZIER_TOLERANCE);
+    u32 result = integer_sqrt(tolerances);
+    result += result*result < tolerances;
+    return MAX((i32)result, 1);
+}
+
+static i32 get_box_max_bezier_segments_fixed(i32 width, i32 height, i32 fixed_scale)
+{
+    i32 fixed_width = (i32)(((i64)width*fixed_scale) >> (16 - FIXED_SHIFT));
+    i32 fixed_height = (i32)(((i64)height*fixed_scale) >> (16 - FIXED_SHIFT));
+    return fixed_bezier_segment_count(2*fixed_width, 2*fixed_height);
+}
+
+static i32 get_glyph_max_bezier_segments_fixed(Glyph glyph, i32 fixed_scale)
+{
+    return get_box_max_bezier_segments_fixed(glyph.x_max - glyph.x_min, glyph.y_max - glyph.y_min, fixed_scale);
+}
+
+i32 get_glyph_info_max_points_fixed(GlyphInfo info, i32 fixed_scale)
+{
+    i32 max_segments = get_box_max_bezier_segments_fixed(info.x_max - info.x_min, info.y_max - info.y_min,
+                                                         fixed_scale);
+    return get_flattened_max_points(info, max_segments);
+}
+
+i32 get_glyph_max_points_fixed(Glyph glyph, i32 fixed_scale)
+{
+    return get_glyph_info_max_points_fixed(get_glyph_outline_info(glyph), fixed_scale);
+}
+
+// NOTE: The curve is evaluated exactly as n*n*B(i/n) = p0*n*n + b*i + a*i*i
+// with integer forward differences, only the division by n*n rounds
+static inline i32 flatten_quadratic_fixed(v2i *output, v2i p0, v2i p1, v2i p2, i32 max_segments)
+{
+    i32 ax = p0.x - 2*p1.x + p2.x;
+    i32 ay = p0.y - 2*p1.y + p2.y;
+    i32 segments = MIN(fixed_bezier_segment_count(ax, ay), max_segments);
+
+    i64 n2 = (i64)segments*segments;
+    i64 half = n2/2;
+    i64 x = (i64)p0.x*n2;
+    i64 y = (i64)p0.y*n2;
+    i64 d1x = 2*(i64)(p1.x - p0.x)*segments + ax;
+    i64 d1y = 2*(i64)(p1.y - p0.y)*segments + ay;
+    i64 d2x = 2*(i64)ax;
+    i64 d2y = 2*(i64)ay;
+    for(i32 i = 0; i < segments - 1; ++i)
+    {
+        x += d1x;
+        y += d1y;
+        d1x += d2x;
+        d1y += d2y;
+        // NOTE: Floor division, the sums can be negative for control points
+        // outside the box
+        i64 rx = x + half;
+        i64 ry = y + half;
+        output[i].x = (i32)(rx >= 0 ? rx / n2 : -((-rx + n2 - 1) / n2));
+        output[i].y = (i32)(ry >= 0 ? ry / n2 : -((-ry + n2 - 1) / n2));
+    }
+    output[segments - 1] = p2;
+    return segments;
+}
+
+static inline v2i get_glyph_point_fixed(Glyph glyph, i32 index, i32 fixed_scale, v2i offset)
+{
+    // NOTE: 16.16 scale times font units is 16.16 device units, rounded to 26.6
+    i32 shift = 16 - FIXED_SHIFT;
+    i64 round = (i64)1 << (shift - 1);
+    v2i result;
+    result.x = (i32)((((i64)(glyph.x_coords[index] - glyph.x_min)*fixed_scale + round) >> shift) + offset.x);
+    result.y = (i32)((((i64)(glyph.y_coords[index] - glyph.y_min)*fixed_scale + round) >> shift) + offset.y);
+    return result;
+}
+
+void generate_glyph_points_fixed(Glyph glyph, v2i *output, i32 *output_size, i32 fixed_scale, v2i offset,
+                                 i32 *contour_end_index)
+{
+    STAT_TIMER_BEGIN(STAT_STAGE_POINTS, timer);
+    i32 contour_start = 0;
+    i32 output_index = 0;
+    i32 contour_start_index = 0;
+    i32 max_segments = get_glyph_max_bezier_segments_fixed(glyph, fixed_scale);
+    v2i last_point = {};
+    for(i32 i = 0; i < glyph.number_of_contours; ++i)
+    {
+        i32 contour_length = (glyph.end_pts_of_contours[i]+1) - contour_start;
+        for(i32 j = 0; j < contour_length; ++j)
+        {
+            i32 point_index = j + contour_start;
+            i32 next_point_index = ((j + 1) % contour_length) + contour_start;
+            v2i point = get_glyph_point_fixed(glyph, point_index, fixed_scale, offset);
+
+            if(glyph.flags[point_index].on_curver)
+            {
+                output[output_index++] = point;
+                last_point = point;
+            }
+            else
+            {
+                v2i next_point = get_glyph_point_fixed(glyph, next_point_index, fixed_scale, offset);
+                if(glyph.flags[next_point_index].on_curver)
+                {
+                    output_index += flatten_quadratic_fixed(output + output_index, last_point, point, next_point,
+                                                            max_segments);
+                    last_point = next_point;
+                    j++;
+                }
+                else
+                {
+                    // NOTE: Two off curve points in a row, the curve ends on
+                    // the implied point half way between them
+                    v2i middle = { (point.x + next_point.x) >> 1, (point.y + next_point.y) >> 1 };
+                    output_index += flatten_quadratic_fixed(output + output_index, last_point, point, middle,
+                                                            max_segments);
+                    last_point = middle;
+                }
+            }
+        }
+
+        output[output_index++] = output[contour_start_index];
+        contour_start_index = output_index;
+        contour_start = glyph.end_pts_of_contours[i]+1;
+        contour_end_index[i] = output_index;
+    }
+    *output_size = output_index;
+    STAT_ADD(STAT_POINTS_GENERATED, output_index);
+    STAT_TIMER_END(STAT_STAGE_POINTS, timer);
+}
+
+LineFixed *generate_glyph_lines_fixed(Arena *arena, Glyph glyph, i32 *line_count, v2i *glyph_points,
+                                      i32 *contour_end_index)
+{
+    if(glyph.number_of_contours <= 0)
+    {
+        *line_count = 0;
+        return 0;
+    }
+
+    STAT_TIMER_BEGIN(STAT_STAGE_LINES, timer);
+    LineFixed *result = ARENA_PUSH_ARRAY(arena, LineFixed, contour_end_index[glyph.number_of_contours-1]);
+    i32 j = 0;
+    i32 line_index = 0;
+    for(i32 i = 0; i < glyph.number_of_contours; ++i)
+    {
+        for(; j < contour_end_index[i]-1; ++j)
+        {
+            // NOTE: Horizontal lines never cross a scanline
+            if(glyph_points[j].y == glyph_points[j+1].y) continue;
+            LineFixed *line = result + line_index++;
+            line->p0 = glyph_points[j];
+            line->p1 = glyph_points[j+1];
+        }
+        ++j;
+    }
+    *line_count = line_index;
+    STAT_ADD(STAT_LINES_EMITTED, line_index);
+    STAT_TIMER_END(STAT_STAGE_LINES, timer);
+    return result;
+}
+
+LineFixed *snap_lines_fixed(Arena *arena, Line *lines, i32 lines_count, i32 *line_count)
+{
+    LineFixed *result = ARENA_PUSH_ARRAY(arena, LineFixed, MAX(lines_count, 1));
+    i32 count = 0;
+    for(i32 i = 0; i < lines_count; ++i)
+    {
+        LineFixed line;
+        line.p0.x = (i32)lrintf(lines[i].p0.x*FIXED_ONE);
+        line.p0.y = (i32)lrintf(lines[i].p0.y*FIXED_ONE);
+        line.p1.x = (i32)lrintf(lines[i].p1.x*FIXED_ONE);
+        line.p1.y = (i32)lrintf(lines[i].p1.y*FIXED_ONE);
+        if(line.p0.y != line.p1.y)
+        {
+            result[count++] = line;
+        }
+    }
+    *line_count = count;
+    return result;
+}
+
+typedef struct
+{
+    f32 x;
+    f32 dxdy;
+    i32 y_end;
+    i32 next;
+    // NOTE: +1 for an edge going up, -1 for one going down
+    i32 winding;
+} ActiveEdge;
+
+// NOTE: The rows of a rasterizer go into a band of rows. With a sink every
+// full band (and the last one) is handed over and cleared for the next rows,
+// without one the band is the whole bitmap
+// NOTE: With emit_spans the rows go out as spans instead, the scanline
+// rasterizers never touch the pixels and the coverage one run length codes
+// every band. span_count keeps counting past the capacity
+typedef struct
+{
+    u8 *pixels;
+    i32 rows;
+    RasterBandSink *sink;
+    void *user_data;
+
+    i32 emit_spans;
+    RasterSpan *spans;
+    i32 span_count;
+    i32 span_capacity;
+} RasterBand;
+
+static inline void push_span(RasterBand *band, i32 y, i32 x_start, i32 x_end, u8 coverage)
+{
+    if(band->span_count < band->span_capacity)
+    {
+        RasterSpan *span = band->spans + band->span_count;
+        span->y = (u16)y;
+        span->x_start = (u16)x_start;
+        span->x_end = (u16)x_end;
+        span->coverage = coverage;
+        span->reserved = 0;
+    }
+    ++band->span_count;
+}
+
+static inline void push_coverage_span(RasterBand *band, i32 y, i32 x_start, i32 x_end, u8 coverage)
+{
+    // NOTE: Runs of 0 and spans past the capacity go to a dummy, so there is
+    // no branch on the coverage of every run
+    RasterSpan dummy;
+    RasterSpan *span = band->span_count < band->span_capacity ? band->spans + band->span_count : &dummy;
+    span->y = (u16)y;
+    span->x_start = (u16)x_start;
+    span->x_end = (u16)x_end;
+    span->coverage = coverage;
+    span->reserved = 0;
+    band->span_count += coverage != 0;
+}
+
+static void push_coverage_spans(RasterBand *band, i32 band_y, i32 band_rows, i32 bitmap_width)
+{
+    for(i32 y = 0; y < band_rows; ++y)
+    {
+        u8 *row = band->pixels + y*bitmap_width;
+        i32 run_start = 0;
+        u8 run_value = row[0];
+        i32 x = 1;
+#ifdef __SSE2__
+        // NOTE: Every pixel against the one on its left, 16 at a time, the
+        // bits of the mask are the pixels where a new run starts
+        for(; x + 16 <= bitmap_width; x += 16)
+        {
+            __m128i pixels = _mm_loadu_si128((__m128i *)(row + x));
+            __m128i left = _mm_loadu_si128((__m128i *)(row + x - 1));
+            u32 starts = ~(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(pixels, left)) & 0xFFFF;
+            while(starts)
+            {
+                i32 run_end = x + __builtin_ctz(starts);
+                push_coverage_span(band, band_y + y, run_start, run_end, run_value);
+                run_start = run_end;
+                run_value = row[run_end];
+                starts &= starts - 1;
+            }
+        }
+#endif
+        for(; x < bitmap_width; ++x)
+        {
+            if(row[x] != run_value)
+            {
+                push_coverage_span(band, band_y + y, run_start, x, run_value);
+                run_start = x;
+                run_value = row[x];
+            }
+        }
+        push_coverage_span(band, band_y + y, run_start, bitmap_width, run_value);
+    }
+}
+
+static void finish_band_row(RasterBand *band, i32 y, i32 bitmap_height, i32 bitmap_width, i32 clear)
+{
+    if(!band->sink) return;
+    i32 row_in_band = y % band->rows;
+    if(row_in_band == band->rows - 1 || y == bitmap_height - 1)
+    {
+        band->sink(band->user_data, band->pixels, y - row_in_band, row_in_band + 1, bitmap_width);
+        if(clear)
+        {
+            memset(band->pixels, 0, (row_in_band + 1)*bitmap_width);
+        }
+    }
+}
+
+// NOTE: The band starts cleared
+static void rasterize_scanline_bands(Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width, RasterBand *band)
+{
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+
+    // NOTE: Active edge table. Every edge is bucketed by the first scanline it
+    // crosses, the active list is kept sorted by x and every edge steps its x
+    // by dx/dy per row, so a row only costs the edges that actually cross it
+    ActiveEdge *edges = ARENA_PUSH_ARRAY(temp.arena, ActiveEdge, lines_count);
+    i32 *active = ARENA_PUSH_ARRAY(temp.arena, i32, lines_count);
+    i32 *edge_bucket = ARENA_PUSH_ARRAY(temp.arena, i32, bitmap_height);
+    for(i32 y = 0; y < bitmap_height; ++y)
+    {
+        edge_bucket[y] = -1;
+    }
+
+    for(i32 i = 0; i < lines_count; ++i)
+    {
+        Line *line = lines + i;
+        f32 max_y = MAX(line->p0.y, line->p1.y);
+        f32 min_y = MIN(line->p0.y, line->p1.y);
+
+        // NOTE: Scanlines strictly inside (min_y, max_y) cross this edge
+        i32 y_start = (i32)floorf(min_y) + 1;
+        i32 y_end = (i32)ceilf(max_y) - 1;
+        y_start = MAX(y_start, 0);
+        y_end = MIN(y_end, bitmap_height - 1);
+        if(y_start > y_end) continue;
+
+        f32 dx = line->p1.x - line->p0.x;
+        f32 dy = line->p1.y - line->p0.y;
+
+        ActiveEdge *edge = edges + i;
+        edge->dxdy = dx/dy;
+        edge->x = (y_start - line->p0.y)*edge->dxdy + line->p0.x;
+        edge->y_end = y_end;
+        edge->winding = dy > 0 ? 1 : -1;
+        edge->next = edge_bucket[y_start];
+        edge_bucket[y_start] = i;
+    }
+
+    i32 active_count = 0;
+    u64 crossings = 0;
+    for(i32 y = 0; y < bitmap_height; ++y)
+    {
+        // NOTE: Drop the edges that ended and add the ones that start here
+        i32 kept = 0;
+        for(i32 i = 0; i < active_count; ++i)
+        {
+            if(edges[active[i]].y_end >= y)
+            {
+                active[kept++] = active[i];
+            }
+        }
+        active_count = kept;
+        for(i32 i = edge_bucket[y]; i != -1; i = edges[i].next)
+        {
+            active[active_count++] = i;
+        }
+        crossings += active_count;
+
+        // NOTE: The list stays almost sorted between rows so insertion sort
+        // is close to linear here
+        for(i32 i = 1; i < active_count; ++i)
+        {
+            i32 index = active[i];
+            f32 x = edges[index].x;
+            i32 j = i - 1;
+            while(j >= 0 && edges[active[j]].x > x)
+            {
+                active[j + 1] = active[j];
+                --j;
+            }
+            active[j + 1] = index;
+        }
+
+        // NOTE: Nonzero winding, a span runs from the edge where the winding
+        // leaves 0 to the one where it comes back. Overlapping contours (or
+        // the glyphs of a run drawn as one outline) stay filled instead of
+        // cancelling out like they would pairing the edges even-odd
+        i32 winding = 0;
+        i32 m = 0;
+        for(i32 n = 0; n < active_count; ++n)
+        {
+            if(!winding)
+            {
+                m = n;
+            }
+            winding += edges[active[n]].winding;
+            if(winding) continue;
+
+            i32 start_index = MAX((i32)edges[active[m]].x, 0);
+            i32 end_index = MIN((i32)edges[active[n]].x, bitmap_width - 1);
+            if(band->emit_spans)
+            {
+                if(start_index <= end_index) push_span(band, y, start_index, end_index + 1, 255);
+                continue;
+            }
+            u8 *row = band->pixels + (y % band->rows)*bitmap_width;
+            for(i32 i = start_index; i <= end_index; ++i)
+            {
+                row[i] = 255;
+            }
+        }
+
+        for(i32 i = 0; i < active_count; ++i)
+        {
+            edges[active[i]].x += edges[active[i]].dxdy;
+        }
+        finish_band_row(band, y, bitmap_height, bitmap_width, 1);
+    }
+
+    arena_end_temp(temp);
+    STAT_ADD(STAT_SCANLINES, bitmap_height);
+    STAT_ADD(STAT_SCANLINE_CROSSINGS, crossings);
+}
+
+u8 *rasterize_glyph(Arena *arena, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width)
+{
+    u8 *result = (u8 *)arena_push_zero(arena, bitmap_height*bitmap_width);
+    if(!lines_count || !bitmap_height)
+    {
+        return result;
+    }
+    STAT_TIMER_BEGIN(STAT_STAGE_RASTER, timer);
+    RasterBand band = {};
+    band.pixels = result;
+    band.rows = bitmap_height;
+    rasterize_scanline_bands(lines, lines_count, bitmap_height, bitmap_width, &band);
+    STAT_TIMER_END(STAT_STAGE_RASTER, timer);
+    return result;
+}
+
+// NOTE: Edge of the fixed point active edge table. x is in 32.32 pixels and
+// steps by dx/dy per row with one add, the error of the step is below 2^-32
+// of a pixel per row
+#define EDGE_FIXED_SHIFT 32
+
+typedef struct
+{
+    i64 x;
+    i64 step;
+    i32 y_end;
+    i32 next;
+    i32 winding;
+} ActiveEdgeFixed;
+
+static inline i64 floor_divide(i64 numerator, i64 denominator)
+{
+    i64 result = numerator / denominator;
+    return result - (numerator % denominator < 0);
+}
+
+static void rasterize_scanline_bands_fixed(LineFixed *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width,
+                                           RasterBand *band)
+{
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+
+    ActiveEdgeFixed *edges = ARENA_PUSH_ARRAY(temp.arena, ActiveEdgeFixed, lines_count);
+    i32 *active = ARENA_PUSH_ARRAY(temp.arena, i32, lines_count);
+    i32 *edge_bucket = ARENA_PUSH_ARRAY(temp.arena, i32, bitmap_height);
+    for(i32 y = 0; y < bitmap_height; ++y)
+    {
+        edge_bucket[y] = -1;
+    }
+
+    for(i32 i = 0; i < lines_count; ++i)
+    {
+        v2i p0 = lines[i].p0;
+        v2i p1 = lines[i].p1;
+        i32 winding = p1.y > p0.y ? 1 : -1;
+        if(p0.y > p1.y)
+        {
+            v2i swap = p0;
+            p0 = p1;
+            p1 = swap;
+        }
+
+        // NOTE: Same sample rows as rasterize_glyph, whole pixel y strictly
+        // inside the edge
+        i32 y_start = (p0.y >> FIXED_SHIFT) + 1;
+        i32 y_end = ((p1.y + FIXED_ONE - 1) >> FIXED_SHIFT) - 1;
+        y_start = MAX(y_start, 0);
+        y_end = MIN(y_end, bitmap_height - 1);
+        if(y_start > y_end) continue;
+
+        // NOTE: 26.6 coordinates, so dx/dy is already in pixels per pixel and
+        // x at the first row only needs the 26 integer bits moved up
+        ActiveEdgeFixed *edge = edges + i;
+        i64 dx = p1.x - p0.x;
+        i64 dy = p1.y - p0.y;
+        edge->step = floor_divide(dx*((i64)1 << EDGE_FIXED_SHIFT), dy);
+        edge->x = (i64)p0.x*((i64)1 << (EDGE_FIXED_SHIFT - FIXED_SHIFT)) +
+            (((((i64)y_start << FIXED_SHIFT) - p0.y)*edge->step) >> FIXED_SHIFT);
+        edge->y_end = y_end;
+        edge->winding = winding;
+        edge->next = edge_bucket[y_start];
+        edge_bucket[y_start] = i;
+    }
+
+    i32 active_count = 0;
+    u64 crossings = 0;
+    for(i32 y = 0; y < bitmap_height; ++y)
+    {
+        i32 kept = 0;
+        for(i32 i = 0; i < active_count; ++i)
+        {
+            if(edges[active[i]].y_end >= y)
+            {
+                active[kept++] = active[i];
+            }
+        }
+        active_count = kept;
+        for(i32 i = edge_bucket[y]; i != -1; i = edges[i].next)
+        {
+            active[active_count++] = i;
+        }
+        crossings += active_count;
+
+        for(i32 i = 1; i < active_count; ++i)
+        {
+            i32 index = active[i];
+            i64 x = edges[index].x;
+            i32 j = i - 1;
+            while(j >= 0 && edges[active[j]].x > x)
+            {
+                active[j + 1] = active[j];
+                --j;
+            }
+            active[j + 1] = index;
+        }
+
+        // NOTE: Nonzero winding like rasterize_scanline_bands
+        i32 winding = 0;
+        i32 m = 0;
+        for(i32 n = 0; n < active_count; ++n)
+        {
+            if(!winding)
+            {
+                m = n;
+            }
+            winding += edges[active[n]].winding;
+            if(winding) continue;
+
+            i32 start_index = (i32)MAX(edges[active[m]].x >> EDGE_FIXED_SHIFT, 0);
+            i32 end_index = (i32)MIN(edges[active[n]].x >> EDGE_FIXED_SHIFT, bitmap_width - 1);
+            if(band->emit_spans)
+            {
+                if(start_index <= end_index) push_span(band, y, start_index, end_index + 1, 255);
+                continue;
+            }
+            u8 *row = band->pixels + (y % band->rows)*bitmap_width;
+            for(i32 i = start_index; i <= end_index; ++i)
+            {
+                row[i] = 255;
+            }
+        }
+
+        for(i32 i = 0; i < active_count; ++i)
+        {
+            edges[active[i]].x += edges[active[i]].step;
+        }
+        finish_band_row(band, y, bitmap_height, bitmap_width, 1);
+    }
+
+    arena_end_temp(temp);
+    STAT_ADD(STAT_SCANLINES, bitmap_height);
+    STAT_ADD(STAT_SCANLINE_CROSSINGS, crossings);
+}
+
+u8 *rasterize_glyph_fixed(Arena *arena, LineFixed *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width)
+{
+    u8 *result = (u8 *)arena_push_zero(arena, bitmap_height*bitmap_width);
+    if(!lines_count || !bitmap_height)
+    {
+        return result;
+    }
+    STAT_TIMER_BEGIN(STAT_STAGE_RASTER, timer);
+    RasterBand band = {};
+    band.pixels = result;
+    band.rows = bitmap_height;
+    rasterize_scanline_bands_fixed(lines, lines_count, bitmap_height, bitmap_width, &band);
+    STAT_TIMER_END(STAT_STAGE_RASTER, timer);
+    return result;
+}
+
+// NOTE: Signed area coverage rasterizer. Every line adds the area it covers
+// to the left of each pixel (as deltas) into an accumulation buffer, a
+// running sum over the buffer then gives the coverage of every pixel
+// NOTE: Returns the number of rows of the band the line crosses. x is in
+// [0, width] and rows are stride apart, two more than the bitmap width so a
+// line on the right edge can spill to the right. y stays in bitmap rows and
+// the x of every row comes from the line equation, not stepped from the row
+// before, so a row is the same whatever band it falls in
+static i32 accumulate_line(f32 *accumulation, i32 stride, i32 band_y, i32 band_rows, v2f p0, v2f p1)
+{
+    if(p0.y == p1.y) return 0;
+
+    f32 direction = 1.0f;
+    if(p0.y > p1.y)
+    {
+        v2f temp = p0;
+        p0 = p1;
+        p1 = temp;
+        direction = -1.0f;
+    }
+
+    f32 dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    i32 y_start = MAX((i32)floorf(p0.y), band_y);
+    i32 y_end = MIN((i32)ceilf(p1.y), band_y + band_rows);
+    for(i32 y = y_start; y < y_end; ++y)
+    {
+        f32 *row = accumulation + (y - band_y)*stride;
+        f32 y0 = MAX((f32)y, p0.y);
+        f32 y1 = MIN((f32)(y + 1), p1.y);
+        f32 dy = y1 - y0;
+        f32 x = p0.x + (y0 - p0.y)*dxdy;
+        f32 x_next = p0.x + (y1 - p0.y)*dxdy;
+        f32 d = dy*direction;
+
+        // NOTE: Rounding can put x a little outside the clamped outline
+        f32 x0 = MAX(MIN(x, x_next), 0.0f);
+        f32 x1 = MAX(MAX(x, x_next), 0.0f);
+        f32 x0_floor = floorf(x0);
+        i32 x0i = (i32)x0_floor;
+        f32 x1_ceil = ceilf(x1);
+        i32 x1i = (i32)x1_ceil;
+
+        if(x1i <= x0i + 1)
+        {
+            // NOTE: The line stays inside one pixel on this row
+            f32 x_mid = 0.5f*(x + x_next) - x0_floor;
+            row[x0i] += d - d*x_mid;
+            row[x0i + 1] += d*x_mid;
+        }
+        else
+        {
+            f32 s = 1.0f / (x1 - x0);
+            f32 x0_fract = x0 - x0_floor;
+            f32 a0 = 0.5f*s*(1.0f - x0_fract)*(1.0f - x0_fract);
+            f32 x1_fract = x1 - x1_ceil + 1.0f;
+            f32 am = 0.5f*s*x1_fract*x1_fract;
+
+            row[x0i] += d*a0;
+            if(x1i == x0i + 2)
+            {
+                row[x0i + 1] += d*(1.0f - a0 - am);
+            }
+            else
+            {
+                f32 a1 = s*(1.5f - x0_fract);
+                row[x0i + 1] += d*(a1 - a0);
+                for(i32 xi = x0i + 2; xi < x1i - 1; ++xi)
+                {
+                    row[xi] += d*s;
+                }
+                f32 a2 = a1 + (x1i - x0i - 3)*s;
+                row[x1i - 1] += d*(1.0f - a2 - am);
+            }
+            row[x1i] += d*am;
+        }
+    }
+    return MAX(y_end - y_start, 0);
+}
+
+// NOTE: Prefix sum of the deltas into 8-bit alpha, row by row. The sum
+// starts over on every row, carried across rows the float rounding of every
+// row would add up down the bitmap. Both paths round half to even
+static void accumulate_coverage(f32 *accumulation, i32 stride, u8 *output, i32 width, i32 rows)
+{
+    for(i32 y = 0; y < rows; ++y)
+    {
+        f32 *deltas = accumulation + y*stride;
+        u8 *row = output + y*width;
+        i32 i = 0;
+        f32 sum = 0.0f;
+#ifdef __SSE2__
+        __m128 carry = _mm_setzero_ps();
+        __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 max_alpha = _mm_set1_ps(255.0f);
+        for(; i + 4 <= width; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(deltas + i);
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+            x = _mm_add_ps(x, carry);
+            carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128 alpha = _mm_min_ps(_mm_and_ps(x, abs_mask), one);
+            __m128i alpha_i = _mm_cvtps_epi32(_mm_mul_ps(alpha, max_alpha));
+            alpha_i = _mm_packs_epi32(alpha_i, alpha_i);
+            alpha_i = _mm_packus_epi16(alpha_i, alpha_i);
+            i32 packed = _mm_cvtsi128_si32(alpha_i);
+            memcpy(row + i, &packed, sizeof(packed));
+        }
+        sum = _mm_cvtss_f32(carry);
+#endif
+        for(; i < width; ++i)
+        {
+            sum += deltas[i];
+            f32 alpha = MIN(fabsf(sum), 1.0f);
+            row[i] = (u8)lrintf(alpha*255.0f);
+        }
+    }
+}
+
+static void rasterize_coverage_bands(Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width, RasterBand *band)
+{
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+
+    // NOTE: Two extra columns: a line at the right edge of the last pixel
+    // pushes its remainder to the right, those columns are never summed
+    i32 stride = bitmap_width + 2;
+    i32 accumulation_count = band->rows*stride;
+    f32 *accumulation = (f32 *)arena_push_zero(temp.arena, accumulation_count*sizeof(f32));
+
+    // NOTE: The right edge of the last pixel, not its left one, or the area
+    // of that pixel would be lost
+    f32 max_x = (f32)bitmap_width;
+    u64 crossings = 0;
+
+    // NOTE: One band holds the whole bitmap (every glyph of
+    // rasterize_glyph_coverage, small glyphs as spans), every line goes
+    // straight into it without the buckets
+    if(band->rows >= bitmap_height)
+    {
+        for(i32 i = 0; i < lines_count; ++i)
+        {
+            v2f p0 = lines[i].p0;
+            v2f p1 = lines[i].p1;
+            p0.x = MIN(MAX(p0.x, 0.0f), max_x);
+            p1.x = MIN(MAX(p1.x, 0.0f), max_x);
+            crossings += accumulate_line(accumulation, stride, 0, bitmap_height, p0, p1);
+        }
+
+        accumulate_coverage(accumulation, stride, band->pixels, bitmap_width, bitmap_height);
+        if(band->emit_spans)
+        {
+            push_coverage_spans(band, 0, bitmap_height, bitmap_width);
+        }
+        finish_band_row(band, bitmap_height - 1, bitmap_height, bitmap_width, 0);
+
+        arena_end_temp(temp);
+        STAT_ADD(STAT_SCANLINES, bitmap_height);
+        STAT_ADD(STAT_SCANLINE_CROSSINGS, crossings);
+        return;
+    }
+
+    // NOTE: Lines are bucketed by the first band they reach, in order, and
+    // stay active until their last band. Lines only go through the rows of
+    // the current band
+    i32 band_count = (bitmap_height + band->rows - 1) / band->rows;
+    i32 *band_first_line = ARENA_PUSH_ARRAY(temp.arena, i32, band_count);
+    i32 *band_last_line = ARENA_PUSH_ARRAY(temp.arena, i32, band_count);
+    i32 *next_line = ARENA_PUSH_ARRAY(temp.arena, i32, lines_count);
+    i32 *line_last_band = ARENA_PUSH_ARRAY(temp.arena, i32, lines_count);
+    i32 *active = ARENA_PUSH_ARRAY(temp.arena, i32, lines_count);
+    for(i32 i = 0; i < band_count; ++i)
+    {
+        band_first_line[i] = -1;
+        band_last_line[i] = -1;
+    }
+    for(i32 i = 0; i < lines_count; ++i)
+    {
+        Line *line = lines + i;
+        if(line->p0.y == line->p1.y) continue;
+        i32 y_start = MAX((i32)MIN(line->p0.y, line->p1.y), 0);
+        i32 y_end = MIN((i32)ceilf(MAX(line->p0.y, line->p1.y)), bitmap_height) - 1;
+        if(y_start > y_end) continue;
+
+        i32 first_band = y_start / band->rows;
+        line_last_band[i] = y_end / band->rows;
+        next_line[i] = -1;
+        if(band_last_line[first_band] < 0) band_first_line[first_band] = i;
+        else next_line[band_last_line[first_band]] = i;
+        band_last_line[first_band] = i;
+    }
+
+    i32 active_count = 0;
+    for(i32 b = 0; b < band_count; ++b)
+    {
+        i32 band_y = b*band->rows;
+        i32 band_rows = MIN(band->rows, bitmap_height - band_y);
+
+        i32 kept = 0;
+        for(i32 i = 0; i < active_count; ++i)
+        {
+            if(line_last_band[active[i]] >= b)
+            {
+                active[kept++] = active[i];
+            }
+        }
+        active_count = kept;
+        for(i32 i = band_first_line[b]; i != -1; i = next_line[i])
+        {
+            active[active_count++] = i;
+        }
+
+        for(i32 i = 0; i < active_count; ++i)
+        {
+            v2f p0 = lines[active[i]].p0;
+            v2f p1 = lines[active[i]].p1;
+            p0.x = MIN(MAX(p0.x, 0.0f), max_x);
+            p1.x = MIN(MAX(p1.x, 0.0f), max_x);
+            crossings += accumulate_line(accumulation, stride, band_y, band_rows, p0, p1);
+        }
+
+        accumulate_coverage(accumulation, stride, band->pixels, bitmap_width, band_rows);
+        if(band->emit_spans)
+        {
+            push_coverage_spans(band, band_y, band_rows, bitmap_width);
+        }
+        finish_band_row(band, band_y + band_rows - 1, bitmap_height, bitmap_width, 0);
+        if(b + 1 < band_count)
+        {
+            memset(accumulation, 0, accumulation_count*sizeof(f32));
+        }
+    }
+
+    arena_end_temp(temp);
+    STAT_ADD(STAT_SCANLINES, bitmap_height);
+    STAT_ADD(STAT_SCANLINE_CROSSINGS, crossings);
+}
+
+u8 *rasterize_glyph_coverage(Arena *arena, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width)
+{
+    STAT_TIMER_BEGIN(STAT_STAGE_RASTER, timer);
+    u8 *result = ARENA_PUSH_ARRAY(arena, u8, bitmap_height*bitmap_width);
+    if(bitmap_height > 0)
+    {
+        RasterBand band = {};
+        band.pixels = result;
+        band.rows = bitmap_height;
+        rasterize_coverage_bands(lines, lines_count, bitmap_height, bitmap_width, &band);
+    }
+    STAT_TIMER_END(STAT_STAGE_RASTER, timer);
+    return result;
+}
+
+u8 *rasterize_glyph_mode(Arena *arena, RasterMode mode, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width)
+{
+    u8 *result = 0;
+    switch(mode)
+    {
+        case RASTER_BINARY:
+        {
+            result = rasterize_glyph(arena, lines, lines_count, bitmap_height, bitmap_width);
+        }break;
+        case RASTER_COVERAGE:
+        {
+            result = rasterize_glyph_coverage(arena, lines, lines_count, bitmap_height, bitmap_width);
+        }break;
+        case RASTER_FIXED:
+        {
+            ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+            i32 fixed_count = 0;
+            LineFixed *fixed_lines = snap_lines_fixed(temp.arena, lines, lines_count, &fixed_count);
+            result = rasterize_glyph_fixed(arena, fixed_lines, fixed_count, bitmap_height, bitmap_width);
+            if(arena != temp.arena)
+            {
+                arena_end_temp(temp);
+            }
+        }break;
+    }
+    return result;
+}
+
+// NOTE: Outline of a glyph as lines for a raster mode, 26.6 lines for
+// RASTER_FIXED and float lines for the others
+typedef struct
+{
+    Line *lines;
+    LineFixed *fixed_lines;
+    i32 line_count;
+} GlyphLines;
+
+static GlyphLines generate_glyph_lines_mode(Arena *arena, Glyph glyph, f32 scale, v2f offset, RasterMode mode)
+{
+    GlyphLines result = {};
+    i32 *contour_end_index = ARENA_PUSH_ARRAY(arena, i32, glyph.number_of_contours);
+    i32 point_count = 0;
+    if(mode == RASTER_FIXED)
+    {
+        i32 fixed_scale = get_fixed_scale(scale);
+        v2i fixed_offset = { (i32)lrintf(offset.x*FIXED_ONE), (i32)lrintf(offset.y*FIXED_ONE) };
+        v2i *points = ARENA_PUSH_ARRAY(arena, v2i, get_glyph_max_points_fixed(glyph, fixed_scale));
+        generate_glyph_points_fixed(glyph, points, &point_count, fixed_scale, fixed_offset, contour_end_index);
+        result.fixed_lines = generate_glyph_lines_fixed(arena, glyph, &result.line_count, points, contour_end_index);
+    }
+    else
+    {
+        v2f *points = ARENA_PUSH_ARRAY(arena, v2f, get_glyph_max_points(glyph, scale));
+        generate_glyph_points_offset(glyph, points, &point_count, scale, offset, contour_end_index);
+        result.lines = generate_glyph_lines(arena, glyph, &result.line_count, points, contour_end_index);
+    }
+    return result;
+}
+
+static void rasterize_band_mode(RasterMode mode, GlyphLines lines, i32 bitmap_height, i32 bitmap_width,
+                                RasterBand *band)
+{
+    switch(mode)
+    {
+        case RASTER_BINARY:
+        {
+            rasterize_scanline_bands(lines.lines, lines.line_count, bitmap_height, bitmap_width, band);
+        }break;
+        case RASTER_COVERAGE:
+        {
+            rasterize_coverage_bands(lines.lines, lines.line_count, bitmap_height, bitmap_width, band);
+        }break;
+        case RASTER_FIXED:
+        {
+            rasterize_scanline_bands_fixed(lines.fixed_lines, lines.line_count, bitmap_height, bitmap_width, band);
+        }break;
+    }
+}
+
+u8 *render_glyph_offset(Arena *arena, Glyph glyph, f32 scale, v2f offset, RasterMode mode, v2i *bitmap_size)
+{
+    *bitmap_size = get_glyph_bitmap_size_offset(glyph, scale, offset);
+    if(glyph.number_of_contours <= 0)
+    {
+        return 0;
+    }
+
+    // NOTE: When the result goes to another arena the intermediate outline
+    // is dropped here, in the scratch arena it lives until the next reset
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    u8 *result = 0;
+    GlyphLines lines = generate_glyph_lines_mode(scratch, glyph, scale, offset, mode);
+    if(mode == RASTER_FIXED)
+    {
+        result = rasterize_glyph_fixed(arena, lines.fixed_lines, lines.line_count, bitmap_size->y, bitmap_size->x);
+    }
+    else
+    {
+        result = rasterize_glyph_mode(arena, mode, lines.lines, lines.line_count, bitmap_size->y, bitmap_size->x);
+    }
+
+    if(arena != scratch)
+    {
+        arena_end_temp(temp);
+    }
+    return result;
+}
+
+u8 *render_glyph(Arena *arena, Glyph glyph, f32 scale, RasterMode mode, v2i *bitmap_size)
+{
+    v2f offset = {};
+    return render_glyph_offset(arena, glyph, scale, offset, mode, bitmap_size);
+}
+
+static void rasterize_bands(RasterMode mode, GlyphLines lines, i32 bitmap_height, i32 bitmap_width,
+                            i32 band_rows, RasterBandSink *sink, void *user_data)
+{
+    if(bitmap_height <= 0 || bitmap_width <= 0)
+    {
+        return;
+    }
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    RasterBand band = {};
+    band.rows = CLAMP(band_rows, 1, bitmap_height);
+    band.pixels = (u8 *)arena_push_zero(scratch, band.rows*bitmap_width);
+    band.sink = sink;
+    band.user_data = user_data;
+    STAT_TIMER_BEGIN(STAT_STAGE_RASTER, timer);
+    rasterize_band_mode(mode, lines, bitmap_height, bitmap_width, &band);
+    STAT_TIMER_END(STAT_STAGE_RASTER, timer);
+
+    arena_end_temp(temp);
+}
+
+void rasterize_glyph_bands(RasterMode mode, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width,
+                           i32 band_rows, RasterBandSink *sink, void *user_data)
+{
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+    GlyphLines glyph_lines = {};
+    glyph_lines.lines = lines;
+    glyph_lines.line_count = lines_count;
+    if(mode == RASTER_FIXED)
+    {
+        glyph_lines.fixed_lines = snap_lines_fixed(temp.arena, lines, lines_count, &glyph_lines.line_count);
+    }
+    rasterize_bands(mode, glyph_lines, bitmap_height, bitmap_width, band_rows, sink, user_data);
+    arena_end_temp(temp);
+}
+
+v2i render_glyph_bands(Glyph glyph, f32 scale, RasterMode mode, i32 band_rows, RasterBandSink *sink, void *user_data)
+{
+    v2i result = get_glyph_bitmap_size(glyph, scale);
+    if(glyph.number_of_contours <= 0)
+    {
+        return result;
+    }
+
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    v2f offset = {};
+    GlyphLines lines = generate_glyph_lines_mode(scratch, glyph, scale, offset, mode);
+    rasterize_bands(mode, lines, result.y, result.x, band_rows, sink, user_data);
+
+    arena_end_temp(temp);
+    return result;
+}
+
+static i32 rasterize_spans(RasterMode mode, GlyphLines lines, i32 bitmap_height, i32 bitmap_width,
+                           RasterSpan *spans, i32 max_spans)
+{
+    if(bitmap_height <= 0 || bitmap_width <= 0)
+    {
+        return 0;
+    }
+    STAT_TIMER_BEGIN(STAT_STAGE_RASTER, timer);
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    // NOTE: Only the coverage rasterizer needs pixels, a few rows of them
+    RasterBand band = {};
+    band.emit_spans = 1;
+    band.spans = spans;
+    band.span_capacity = max_spans;
+    band.rows = bitmap_height;
+    if(mode == RASTER_COVERAGE)
+    {
+        band.rows = MIN(SPAN_BAND_ROWS, bitmap_height);
+        band.pixels = (u8 *)arena_push_zero(scratch, band.rows*bitmap_width);
+    }
+    rasterize_band_mode(mode, lines, bitmap_height, bitmap_width, &band);
+
+    arena_end_temp(temp);
+    STAT_TIMER_END(STAT_STAGE_RASTER, timer);
+    return band.span_count;
+}
+
+i32 rasterize_glyph_spans(RasterMode mode, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width,
+                          RasterSpan *spans, i32 max_spans)
+{
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+    GlyphLines glyph_lines = {};
+    glyph_lines.lines = lines;
+    glyph_lines.line_count = lines_count;
+    if(mode == RASTER_FIXED)
+    {
+        glyph_lines.fixed_lines = snap_lines_fixed(temp.arena, lines, lines_count, &glyph_lines.line_count);
+    }
+    i32 result = rasterize_spans(mode, glyph_lines, bitmap_height, bitmap_width, spans, max_spans);
+    arena_end_temp(temp);
+    return result;
+}
+
+i32 render_glyph_spans(Glyph glyph, f32 scale, v2f offset, RasterMode mode, RasterSpan *spans, i32 max_spans,
+                       v2i *bitmap_size)
+{
+    *bitmap_size = get_glyph_bitmap_size_offset(glyph, scale, offset);
+    if(glyph.number_of_contours <= 0)
+    {
+        return 0;
+    }
+
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+    GlyphLines lines = generate_glyph_lines_mode(temp.arena, glyph, scale, offset, mode);
+    i32 result = rasterize_spans(mode, lines, bitmap_size->y, bitmap_size->x, spans, max_spans);
+    arena_end_temp(temp);
+    return result;
+}
+
+void draw_spans(u8 *bitmap, i32 width, i32 height, i32 x, i32 y, RasterSpan *spans, i32 span_count)
+{
+    for(i32 i = 0; i < span_count; ++i)
+    {
+        RasterSpan *span = spans + i;
+        i32 row = y + span->y;
+        if(row < 0 || row >= height) continue;
+        i32 x_start = MAX(x + span->x_start, 0);
+        i32 x_end = MIN(x + span->x_end, width);
+        if(x_start < x_end)
+        {
+            memset(bitmap + (u64)row*width + x_start, span->coverage, x_end - x_start);
+        }
+    }
+}
+
+i32 prefer_span_output(RasterMode mode, v2i bitmap_size)
+{
+    return mode != RASTER_COVERAGE || bitmap_size.y <= SPAN_COVERAGE_MAX_HEIGHT;
+}
+
+static f32 line_distance_squared(Line *line, f32 x, f32 y)
+{
+    f32 dx = line->p1.x - line->p0.x;
+    f32 dy = line->p1.y - line->p0.y;
+    f32 px = x - line->p0.x;
+    f32 py = y - line->p0.y;
+    f32 length_squared = dx*dx + dy*dy;
+    f32 t = length_squared > 0.0f ? (px*dx + py*dy) / length_squared : 0.0f;
+    t = CLAMP(t, 0.0f, 1.0f);
+    f32 ex = px - t*dx;
+    f32 ey = py - t*dy;
+    return ex*ex + ey*ey;
+}
+
+SdfShape build_sdf_shape(Arena *arena, Glyph glyph, f32 scale, f32 spread)
+{
+    SdfShape result = {};
+    result.spread = spread;
+    result.padding = MAX((i32)ceilf(spread), 1);
+    v2i bitmap_size = get_glyph_bitmap_size(glyph, scale);
+    if(!bitmap_size.x)
+    {
+        return result;
+    }
+    result.width = bitmap_size.x + 2*result.padding;
+    result.height = bitmap_size.y + 2*result.padding;
+
+    v2f *points = ARENA_PUSH_ARRAY(arena, v2f, get_glyph_max_points(glyph, scale));
+    i32 *contour_end_index = ARENA_PUSH_ARRAY(arena, i32, glyph.number_of_contours);
+    i32 point_count = 0;
+    v2f offset = { (f32)result.padding, (f32)result.padding };
+    generate_glyph_points_offset(glyph, points, &point_count, scale, offset, contour_end_index);
+    result.lines = generate_glyph_lines(arena, glyph, &result.line_count, points, contour_end_index);
+
+    result.cells_x = (result.width + SDF_CELL_SIZE - 1) / SDF_CELL_SIZE;
+    result.cells_y = (result.height + SDF_CELL_SIZE - 1) / SDF_CELL_SIZE;
+    i32 cell_count = result.cells_x*result.cells_y;
+    result.cell_start = (i32 *)arena_push_zero(arena, (cell_count + 1)*sizeof(i32));
+
+    // NOTE: Two passes over the cells every line reaches, one to count and
+    // one to fill. A line reaches the cells its bounds grown by spread touch
+    for(i32 pass = 0; pass < 2; ++pass)
+    {
+        i32 *cursor = 0;
+        ArenaTemp temp = {};
+        if(pass)
+        {
+            for(i32 i = 0; i < cell_count; ++i)
+            {
+                result.cell_start[i + 1] += result.cell_start[i];
+            }
+            result.cell_lines = ARENA_PUSH_ARRAY(arena, i32, result.cell_start[cell_count]);
+            temp = arena_begin_temp(arena);
+            cursor = ARENA_PUSH_ARRAY(arena, i32, cell_count);
+            memcpy(cursor, result.cell_start, cell_count*sizeof(i32));
+        }
+
+        for(i32 i = 0; i < result.line_count; ++i)
+        {
+            Line *line = result.lines + i;
+            i32 x0 = (i32)((MIN(line->p0.x, line->p1.x) - spread) / SDF_CELL_SIZE);
+            i32 x1 = (i32)((MAX(line->p0.x, line->p1.x) + spread) / SDF_CELL_SIZE);
+            i32 y0 = (i32)((MIN(line->p0.y, line->p1.y) - spread) / SDF_CELL_SIZE);
+            i32 y1 = (i32)((MAX(line->p0.y, line->p1.y) + spread) / SDF_CELL_SIZE);
+            x0 = MAX(x0, 0);
+            y0 = MAX(y0, 0);
+            x1 = MIN(x1, result.cells_x - 1);
+            y1 = MIN(y1, result.cells_y - 1);
+            for(i32 y = y0; y <= y1; ++y)
+            {
+                for(i32 x = x0; x <= x1; ++x)
+                {
+                    i32 cell = y*result.cells_x + x;
+                    if(pass) result.cell_lines[cursor[cell]++] = i;
+                    else ++result.cell_start[cell + 1];
+                }
+            }
+        }
+
+        if(pass)
+        {
+            arena_end_temp(temp);
+        }
+    }
+    return result;
+}
+
+typedef struct
+{
+    f32 x;
+    i32 winding;
+} SdfCrossing;
+
+void generate_sdf_rows(SdfShape *shape, u8 *output, i32 row_begin, i32 row_end)
+{
+    STAT_TIMER_BEGIN(STAT_STAGE_SDF, timer);
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+    SdfCrossing *crossings = ARENA_PUSH_ARRAY(temp.arena, SdfCrossing, shape->line_count);
+    f32 max_distance_squared = shape->spread*shape->spread;
+    f32 value_scale = (255 - SDF_EDGE_VALUE) / shape->spread;
+
+    for(i32 y = row_begin; y < row_end; ++y)
+    {
+        // NOTE: Inside or outside comes from the nonzero winding of the lines
+        // that cross the row left of the pixel center
+        f32 sample_y = y + 0.5f;
+        i32 crossing_count = 0;
+        for(i32 i = 0; i < shape->line_count; ++i)
+        {
+            Line *line = shape->lines + i;
+            if((line->p0.y <= sample_y) == (line->p1.y <= sample_y)) continue;
+
+            SdfCrossing crossing;
+            crossing.x = line->p0.x + (sample_y - line->p0.y)*(line->p1.x - line->p0.x)/(line->p1.y - line->p0.y);
+            crossing.winding = line->p1.y > line->p0.y ? 1 : -1;
+            i32 j = crossing_count++;
+            while(j > 0 && crossings[j - 1].x > crossing.x)
+            {
+                crossings[j] = crossings[j - 1];
+                --j;
+            }
+            crossings[j] = crossing;
+        }
+
+        u8 *row = output + y*shape->width;
+        i32 *cell_row_start = shape->cell_start + (y / SDF_CELL_SIZE)*shape->cells_x;
+        i32 next_crossing = 0;
+        i32 winding = 0;
+        for(i32 x = 0; x < shape->width; ++x)
+        {
+            f32 sample_x = x + 0.5f;
+            while(next_crossing < crossing_count && crossings[next_crossing].x < sample_x)
+            {
+                winding += crossings[next_crossing++].winding;
+            }
+
+            i32 *cell = cell_row_start + x / SDF_CELL_SIZE;
+            f32 distance_squared = max_distance_squared;
+            for(i32 i = cell[0]; i < cell[1]; ++i)
+            {
+                f32 d = line_distance_squared(shape->lines + shape->cell_lines[i], sample_x, sample_y);
+                distance_squared = MIN(distance_squared, d);
+            }
+
+            f32 distance = sqrtf(distance_squared);
+            f32 value = winding ? SDF_EDGE_VALUE + distance*value_scale : SDF_EDGE_VALUE - distance*value_scale;
+            row[x] = (u8)CLAMP(value + 0.5f, 0.0f, 255.0f);
+        }
+    }
+    arena_end_temp(temp);
+    STAT_TIMER_END(STAT_STAGE_SDF, timer);
+}
+
+SdfBitmap push_sdf_bitmap(Arena *arena, SdfShape *shape, Glyph glyph, f32 scale)
+{
+    SdfBitmap result = {};
+    result.width = shape->width;
+    result.height = shape->height;
+    result.padding = shape->padding;
+    result.spread = shape->spread;
+    result.scale = scale;
+    result.x_extent = glyph.x_max - glyph.x_min;
+    result.y_extent = glyph.y_max - glyph.y_min;
+    if(shape->width)
+    {
+        result.pixels = ARENA_PUSH_ARRAY(arena, u8, shape->width*shape->height);
+    }
+    return result;
+}
+
+SdfBitmap render_glyph_sdf(Arena *arena, Glyph glyph, f32 scale, f32 spread)
+{
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    SdfShape shape = build_sdf_shape(scratch, glyph, scale, spread);
+    SdfBitmap result = push_sdf_bitmap(arena, &shape, glyph, scale);
+    if(result.pixels)
+    {
+        generate_sdf_rows(&shape, result.pixels, 0, shape.height);
+    }
+
+    if(arena != scratch)
+    {
+        arena_end_temp(temp);
+    }
+    return result;
+}
+
+u8 *render_sdf_alpha(Arena *arena, SdfBitmap sdf, f32 scale, v2i *bitmap_size)
+{
+    v2i size = {};
+    if(!sdf.pixels)
+    {
+        *bitmap_size = size;
+        return 0;
+    }
+    size.x = (i32)(scale*sdf.x_extent) + 1;
+    size.y = (i32)(scale*sdf.y_extent) + 1;
+    *bitmap_size = size;
+    u8 *result = ARENA_PUSH_ARRAY(arena, u8, size.x*size.y);
+
+    // NOTE: Output pixel centers mapped to field coordinates, where pixel
+    // centers sit at +0.5, and field distances converted to output pixels
+    f32 ratio = sdf.scale / scale;
+    f32 distance_scale = (sdf.spread / (255 - SDF_EDGE_VALUE)) / ratio;
+
+    // NOTE: Every row samples the same columns
+    ArenaTemp temp = arena_begin_temp(get_scratch_arena());
+    i32 *column = ARENA_PUSH_ARRAY(temp.arena, i32, size.x);
+    f32 *column_fraction = ARENA_PUSH_ARRAY(temp.arena, f32, size.x);
+    for(i32 x = 0; x < size.x; ++x)
+    {
+        f32 u = (x + 0.5f)*ratio + sdf.padding - 0.5f;
+        u = CLAMP(u, 0.0f, (f32)(sdf.width - 2));
+        column[x] = (i32)u;
+        column_fraction[x] = u - column[x];
+    }
+
+    for(i32 y = 0; y < size.y; ++y)
+    {
+        f32 v = (y + 0.5f)*ratio + sdf.padding - 0.5f;
+        v = CLAMP(v, 0.0f, (f32)(sdf.height - 1));
+        i32 y0 = (i32)v;
+        i32 y1 = MIN(y0 + 1, sdf.height - 1);
+        f32 fy = v - y0;
+        u8 *row0 = sdf.pixels + y0*sdf.width;
+        u8 *row1 = sdf.pixels + y1*sdf.width;
+        u8 *output = result + y*size.x;
+        for(i32 x = 0; x < size.x; ++x)
+        {
+            i32 x0 = column[x];
+            f32 fx = column_fraction[x];
+            f32 top = row0[x0] + fx*(row0[x0 + 1] - row0[x0]);
+            f32 bottom = row1[x0] + fx*(row1[x0 + 1] - row1[x0]);
+            f32 value = top + fy*(bottom - top);
+            f32 alpha = 0.5f + (value - SDF_EDGE_VALUE)*distance_scale;
+            output[x] = (u8)(CLAMP(alpha, 0.0f, 1.0f)*255.0f + 0.5f);
+        }
+    }
+    arena_end_temp(temp);
+    return result;
+}
+
+// NOTE: Reads the directory of the face at offset and rejects faces whose
+// tables do not fit, every table pointer after this is trusted
+static i32 load_font_face(FontFile file, u32 offset, Font *font)
+{
+    Font result = {};
+    result.file = file;
+    // NOTE: The directory is sorted and searched as it loads, the whole of it
+    // has to be in the file before that
+    i32 valid = (u64)offset + 12 <= file.size &&
+                (u64)offset + 12 + (u32)(u16)GET_16(file.data + offset + 4)*16 <= file.size;
+    if(valid)
+    {
+        load_font_directory(file.data, offset, &result.font_dir);
+    }
+    for(i32 i = 0; valid && i < result.font_dir.offset_sub.num_tables; ++i)
+    {
+        TableDirectory table_dir = get_table_directory(result.font_dir, i);
+        valid = (u64)table_dir.offset + table_dir.length <= file.size;
+    }
+    valid = valid && result.font_dir.cmap_ptr && result.font_dir.head_ptr &&
+            result.font_dir.loca_ptr && result.font_dir.glyf_ptr &&
+            result.font_dir.hhea_ptr && result.font_dir.hmtx_ptr;
+    if(!valid)
+    {
+        return 0;
+    }
+    *font = result;
+    return 1;
+}
+
+static i32 load_collection_header(FontFile file, FontCollection *collection)
+{
+    FontCollection result = {};
+    result.file = file;
+    if(file.size >= 12 && (u32)GET_32(file.data) == TTCF_TAG)
+    {
+        result.face_count = GET_32(file.data + 8);
+        result.face_offsets = file.data + 12;
+        if((u64)12 + (u64)result.face_count*4 > file.size)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        // NOTE: A plain font file is a collection of one face at offset 0
+        result.face_count = 1;
+    }
+    *collection = result;
+    return 1;
+}
+
+static u32 get_face_offset(FontCollection *collection, u32 face_index)
+{
+    return collection->face_offsets ? (u32)GET_32(collection->face_offsets + face_index*4) : 0;
+}
+
+i32 open_font(const char *file_path, Font *font)
+{
+    Font result = {};
+    FontFile file = {};
+    FontCollection collection = {};
+    if(!open_font_file(file_path, &file))
+    {
+        *font = result;
+        return 0;
+    }
+    if(!load_collection_header(file, &collection) || !collection.face_count ||
+       !load_font_face(file, get_face_offset(&collection, 0), &result))
+    {
+        close_font_file(&file);
+        *font = result;
+        return 0;
+    }
+
+    *font = result;
+    return 1;
+}
+
+i32 open_font_collection(const char *file_path, FontCollection *collection)
+{
+    FontCollection result = {};
+    FontFile file = {};
+    if(!open_font_file(file_path, &file))
+    {
+        *collection = result;
+        return 0;
+    }
+    if(!load_collection_header(file, &result))
+    {
+        close_font_file(&file);
+        FontCollection zero = {};
+        *collection = zero;
+        return 0;
+    }
+    *collection = result;
+    return 1;
+}
+
+void close_font_collection(FontCollection *collection)
+{
+    close_font_file(&collection->file);
+    FontCollection zero = {};
+    *collection = zero;
+}
+
+i32 open_collection_face(FontCollection *collection, u32 face_index, Font *font)
+{
+    Font result = {};
+    if(face_index >= collection->face_count ||
+       !load_font_face(collection->file, get_face_offset(collection, face_index), &result))
+    {
+        *font = result;
+        return 0;
+    }
+    result.shared_file = 1;
+    *font = result;
+    return 1;
+}
+
+static void *resize_array(void *array, u32 count, u32 capacity, size_t element_size)
+{
+    void *result = font_alloc(capacity*element_size);
+    if(count)
+    {
+        memcpy(result, array, count*element_size);
+    }
+    font_free(array);
+    return result;
+}
+
+static void reserve_outline_store(OutlineStore *store, u32 point_count, u32 contour_count,
+                                  u32 *point_capacity, u32 *contour_capacity)
+{
+    if(point_count > *point_capacity)
+    {
+        u32 capacity = MAX(*point_capacity*2, point_count);
+        store->x_coords = (i16 *)resize_array(store->x_coords, store->point_count, capacity, sizeof(i16));
+        store->y_coords = (i16 *)resize_array(store->y_coords, store->point_count, capacity, sizeof(i16));
+        store->flags = (OutlineFlag *)resize_array(store->flags, store->point_count, capacity, sizeof(OutlineFlag));
+        *point_capacity = capacity;
+    }
+    if(contour_count > *contour_capacity)
+    {
+        u32 capacity = MAX(*contour_capacity*2, contour_count);
+        store->end_pts_of_contours = (u16 *)resize_array(store->end_pts_of_contours, store->contour_count,
+                                                         capacity, sizeof(u16));
+        *contour_capacity = capacity;
+    }
+}
+
+OutlineStore load_outline_store(FontDirectory font_dir, GlyphCache *cache)
+{
+    OutlineStore result = {};
+    result.glyph_count = get_glyph_count(font_dir);
+    if(!result.glyph_count)
+    {
+        return result;
+    }
+    result.glyphs = (OutlineStoreGlyph *)font_alloc(result.glyph_count*sizeof(OutlineStoreGlyph));
+
+    // NOTE: Start with a guess of the average glyph and grow from there
+    u32 point_capacity = 0;
+    u32 contour_capacity = 0;
+    reserve_outline_store(&result, result.glyph_count*32, result.glyph_count*2, &point_capacity, &contour_capacity);
+
+    Arena *scratch = get_scratch_arena();
+    for(u32 i = 0; i < result.glyph_count; ++i)
+    {
+        ArenaTemp temp = arena_begin_temp(scratch);
+        Glyph glyph = decode_glyph(scratch, font_dir, (u16)i, cache, 0);
+
+        OutlineStoreGlyph *entry = result.glyphs + i;
+        entry->point_offset = result.point_count;
+        entry->contour_offset = result.contour_count;
+        entry->number_of_contours = MAX(glyph.number_of_contours, 0);
+        entry->x_min = glyph.x_min;
+        entry->y_min = glyph.y_min;
+        entry->x_max = glyph.x_max;
+        entry->y_max = glyph.y_max;
+
+        u32 point_count = (u32)get_glyph_point_count(glyph);
+        u32 contour_count = (u32)entry->number_of_contours;
+        reserve_outline_store(&result, result.point_count + point_count, result.contour_count + contour_count,
+                              &point_capacity, &contour_capacity);
+
+        if(point_count)
+        {
+            memcpy(result.x_coords + result.point_count, glyph.x_coords, point_count*sizeof(i16));
+            memcpy(result.y_coords + result.point_count, glyph.y_coords, point_count*sizeof(i16));
+            for(u32 j = 0; j < point_count; ++j)
+            {
+                result.flags[result.point_count + j].flag = glyph.flags[j].flag & 1;
+            }
+            memcpy(result.end_pts_of_contours + result.contour_count, glyph.end_pts_of_contours,
+                   contour_count*sizeof(u16));
+            result.point_count += point_count;
+            result.contour_count += contour_count;
+        }
+
+        arena_end_temp(temp);
+    }
+
+    // NOTE: The store lives as long as the font, give back what the growth left
+    u32 point_count = MAX(result.point_count, 1);
+    u32 contour_count = MAX(result.contour_count, 1);
+    result.x_coords = (i16 *)resize_array(result.x_coords, result.point_count, point_count, sizeof(i16));
+    result.y_coords = (i16 *)resize_array(result.y_coords, result.point_count, point_count, sizeof(i16));
+    result.flags = (OutlineFlag *)resize_array(result.flags, result.point_count, point_count, sizeof(OutlineFlag));
+    result.end_pts_of_contours = (u16 *)resize_array(result.end_pts_of_contours, result.contour_count,
+                                                     contour_count, sizeof(u16));
+    return result;
+}
+
+void free_outline_store(OutlineStore *store)
+{
+    font_free(store->glyphs);
+    font_free(store->x_coords);
+    font_free(store->y_coords);
+    font_free(store->flags);
+    font_free(store->end_pts_of_contours);
+    OutlineStore zero = {};
+    *store = zero;
+}
+
+Glyph get_outline_store_glyph(OutlineStore *store, u16 glyph_index)
+{
+    Glyph result = {};
+    if(glyph_index >= store->glyph_count)
+    {
+        return result;
+    }
+    OutlineStoreGlyph *entry = store->glyphs + glyph_index;
+    result.number_of_contours = entry->number_of_contours;
+    result.x_min = entry->x_min;
+    result.y_min = entry->y_min;
+    result.x_max = entry->x_max;
+    result.y_max = entry->y_max;
+    result.end_pts_of_contours = store->end_pts_of_contours + entry->contour_offset;
+    result.flags = store->flags + entry->point_offset;
+    result.x_coords = store->x_coords + entry->point_offset;
+    result.y_coords = store->y_coords + entry->point_offset;
+    return result;
+}
+
+i32 load_font_outlines(Font *font)
+{
+    if(!(font->loaded & FONT_LOADED_OUTLINES))
+    {
+        font->outlines = load_outline_store(font->font_dir, &font->component_cache);
+        if(!font->outlines.glyph_count)
+        {
+            return 0;
+        }
+        font->loaded |= FONT_LOADED_OUTLINES;
+        // NOTE: Composites come flattened from the store from now on
+        free_glyph_cache(&font->component_cache);
+    }
+    return 1;
+}
+
+Glyph get_font_glyph(Arena *arena, Font *font, u16 glyph_index)
+{
+    if(font->loaded & FONT_LOADED_OUTLINES)
+    {
+        return get_outline_store_glyph(&font->outlines, glyph_index);
+    }
+    STAT_TIMER_BEGIN(STAT_STAGE_DECODE, timer);
+    Glyph result = decode_glyph(arena, font->font_dir, glyph_index, &font->component_cache, 0);
+    STAT_TIMER_END(STAT_STAGE_DECODE, timer);
+    return result;
+}
+
+// NOTE: Reads the info of one glyph from its header. Simple glyphs only
+// walk the flags to count the off curve points, composites add up their
+// components with the same depth limit as decode_composite_glyph. A glyph
+// whose components never hit the limit has the same info at every depth and
+// is kept, the ones cut by the limit are read again from every depth they
+// are reached like decode_glyph does, so the info is never less than the
+// outline decoded from any depth
+static GlyphInfo read_glyph_info(GlyphInfoTable *table, u8 *loaded, FontDirectory font_dir, u16 glyph_index,
+                                 i32 depth, i32 *truncated)
+{
+    GlyphInfo result = {};
+    if(glyph_index >= table->glyph_count)
+    {
+        return result;
+    }
+    if(loaded[glyph_index])
+    {
+        return table->glyphs[glyph_index];
+    }
+
+    i32 result_truncated = 0;
+    u32 glyph_offset = get_glyph_offset(font_dir, glyph_index);
+    if(glyph_offset != get_glyph_offset(font_dir, glyph_index + 1))
+    {
+        u8 *glyph_ptr = (u8 *)font_dir.glyf_ptr + glyph_offset;
+        i16 number_of_contours = GET_16_MOVE(glyph_ptr);
+        result.x_min = GET_16_MOVE(glyph_ptr);
+        result.y_min = GET_16_MOVE(glyph_ptr);
+        result.x_max = GET_16_MOVE(glyph_ptr);
+        result.y_max = GET_16_MOVE(glyph_ptr);
+
+        if(number_of_contours > 0)
+        {
+            result.number_of_contours = number_of_contours;
+            result.point_count = GET_16(glyph_ptr + (number_of_contours - 1)*2) + 1;
+            MOVE_P(glyph_ptr, number_of_contours*2);
+            u16 instruction_length = GET_16_MOVE(glyph_ptr);
+            MOVE_P(glyph_ptr, instruction_length);
+            i32 point_count = (i32)result.point_count;
+            for(i32 i = 0; i < point_count;)
+            {
+                u8 flag = *glyph_ptr++;
+                i32 run = 1;
+                if(flag & FLAG_REPEAT)
+                {
+                    run += MIN(*glyph_ptr, point_count - 1 - i);
+                    glyph_ptr++;
+                }
+                if(!(flag & FLAG_ON_CURVE))
+                {
+                    result.curve_count += run;
+                }
+                i += run;
+            }
+        }
+        else if(number_of_contours < 0 && depth >= GLYPH_MAX_COMPONENT_DEPTH)
+        {
+            result_truncated = 1;
+        }
+        else if(number_of_contours < 0)
+        {
+            i32 contour_count = 0;
+            u16 flags = 0;
+            do
+            {
+                flags = GET_16(glyph_ptr);
+                u16 component_index = GET_16(glyph_ptr + 2);
+                glyph_ptr += 4;
+                glyph_ptr += (flags & COMPONENT_ARG_1_AND_2_ARE_WORDS) ? 4 : 2;
+                if(flags & COMPONENT_WE_HAVE_A_SCALE) glyph_ptr += 2;
+                else if(flags & COMPONENT_WE_HAVE_AN_X_AND_Y_SCALE) glyph_ptr += 4;
+                else if(flags & COMPONENT_WE_HAVE_A_TWO_BY_TWO) glyph_ptr += 8;
+
+                GlyphInfo component = read_glyph_info(table, loaded, font_dir, component_index, depth + 1,
+                                                      &result_truncated);
+                if(component.number_of_contours > 0)
+                {
+                    contour_count += component.number_of_contours;
+                    result.point_count += component.point_count;
+                    result.curve_count += component.curve_count;
+                }
+            } while(flags & COMPONENT_MORE_COMPONENTS);
+            if(contour_count > 0)
+            {
+                result.number_of_contours = (i16)contour_count;
+            }
+        }
+    }
+
+    if(!result_truncated)
+    {
+        table->glyphs[glyph_index] = result;
+        loaded[glyph_index] = 1;
+    }
+    *truncated |= result_truncated;
+    return result;
+}
+
+GlyphInfoTable load_glyph_info_table(FontDirectory font_dir)
+{
+    GlyphInfoTable result = {};
+    result.glyph_count = get_glyph_count(font_dir);
+    if(!result.glyph_count)
+    {
+        return result;
+    }
+    result.glyphs = (GlyphInfo *)font_alloc(result.glyph_count*sizeof(GlyphInfo));
+
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+    u8 *loaded = (u8 *)arena_push_zero(scratch, result.glyph_count);
+    for(u32 i = 0; i < result.glyph_count; ++i)
+    {
+        // NOTE: From depth 0 a cut glyph gets the most it can decode to
+        i32 truncated = 0;
+        result.glyphs[i] = read_glyph_info(&result, loaded, font_dir, (u16)i, 0, &truncated);
+    }
+    arena_end_temp(temp);
+    return result;
+}
+
+void free_glyph_info_table(GlyphInfoTable *table)
+{
+    font_free(table->glyphs);
+    GlyphInfoTable zero = {};
+    *table = zero;
+}
+
+GlyphInfo get_glyph_info(GlyphInfoTable *table, u16 glyph_index)
+{
+    GlyphInfo result = {};
+    if(glyph_index < table->glyph_count)
+    {
+        result = table->glyphs[glyph_index];
+    }
+    return result;
+}
+
+void free_glyph_cache(GlyphCache *cache)
+{
+    arena_free(&cache->arena);
+    font_free(cache->slots);
+    font_free(cache->glyphs);
+    GlyphCache zero = {};
+    *cache = zero;
+}
+
+void close_font(Font *font)
+{
+    free_glyph_cache(&font->component_cache);
+    if(font->loaded & FONT_LOADED_OUTLINES)
+    {
+        free_outline_store(&font->outlines);
+    }
+    if(font->loaded & FONT_LOADED_CHAR_MAP)
+    {
+        free_char_map(&font->char_map);
+    }
+    if(font->loaded & FONT_LOADED_GLYPH_INFO)
+    {
+        free_glyph_info_table(&font->glyph_info);
+    }
+    if(!font->shared_file)
+    {
+        close_font_file(&font->file);
+    }
+    Font zero = {};
+    *font = zero;
+}
+
+Hhead *get_font_hhea(Font *font)
+{
+    if(!(font->loaded & FONT_LOADED_HHEA))
+    {
+        font->hhea = load_hhea_table(font->font_dir);
+        font->loaded |= FONT_LOADED_HHEA;
+    }
+    return &font->hhea;
+}
+
+Hmtx *get_font_hmtx(Font *font)
+{
+    if(!(font->loaded & FONT_LOADED_HMTX))
+    {
+        font->hmtx = load_hmtx_table(font->font_dir);
+        font->loaded |= FONT_LOADED_HMTX;
+    }
+    return &font->hmtx;
+}
+
+Kern *get_font_kern(Font *font)
+{
+    if(!(font->loaded & FONT_LOADED_KERN))
+    {
+        font->kern = load_kern_table(font->font_dir);
+        font->loaded |= FONT_LOADED_KERN;
+    }
+    return &font->kern;
+}
+
+CharMap *get_font_char_map(Font *font)
+{
+    if(!(font->loaded & FONT_LOADED_CHAR_MAP))
+    {
+        font->char_map = load_char_map(font->font_dir);
+        font->loaded |= FONT_LOADED_CHAR_MAP;
+    }
+    return &font->char_map;
+}
+
+GlyphInfo get_font_glyph_info(Font *font, u16 glyph_index)
+{
+    if(!(font->loaded & FONT_LOADED_GLYPH_INFO))
+    {
+        font->glyph_info = load_glyph_info_table(font->font_dir);
+        font->loaded |= FONT_LOADED_GLYPH_INFO;
+    }
+    return get_glyph_info(&font->glyph_info, glyph_index);
+}
+
+TextRun layout_text(Arena *arena, Font *font, const char *text, f32 pixel_size)
+{
+    TextRun result = {};
+    Hhead *hhea = get_font_hhea(font);
+    Hmtx hmtx = *get_font_hmtx(font);
+    Kern kern = *get_font_kern(font);
+    CharMap *char_map = get_font_char_map(font);
+
+    result.scale = scale_pixel_height(*hhea, pixel_size);
+    result.line_height = result.scale*(hhea->ascent - hhea->descent + hhea->line_gap);
+
+    // NOTE: Every byte is at most one glyph
+    i32 capacity = (i32)strlen(text);
+    result.glyphs = ARENA_PUSH_ARRAY(arena, LayoutGlyph, MAX(capacity, 1));
+
+    f32 pen_x = 0.0f;
+    f32 pen_y = 0.0f;
+    u16 previous_glyph = 0;
+    u32 code_point = 0;
+    i32 length = 0;
+    while((length = utf8_decode(text, &code_point)))
+    {
+        text += length;
+        if(code_point == '\n')
+        {
+            result.width = MAX(result.width, pen_x);
+            pen_x = 0.0f;
+            pen_y -= result.line_height;
+            previous_glyph = 0;
+            continue;
+        }
+
+        u16 glyph_index = char_map_lookup(char_map, code_point);
+        if(previous_glyph && kern.pair_count)
+        {
+            pen_x += result.scale*get_kern_advance(kern, previous_glyph, glyph_index);
+        }
+
+        LongHorMetric metric = get_glyph_h_metric(hmtx, glyph_index);
+        LayoutGlyph *glyph = result.glyphs + result.glyph_count++;
+        glyph->glyph_index = glyph_index;
+        glyph->code_point = code_point;
+        glyph->x = pen_x;
+        glyph->y = pen_y;
+        glyph->bearing_x = result.scale*metric.left_side_bearing;
+        glyph->advance = result.scale*metric.advance_width;
+
+        pen_x += glyph->advance;
+        previous_glyph = glyph_index;
+    }
+    result.width = MAX(result.width, pen_x);
+    return result;
+}
+
+u8 *render_text_run(Arena *arena, Font *font, TextRun run, RasterMode mode, v2i *bitmap_size, v2f *origin)
+{
+    v2i zero_size = {};
+    v2f zero_origin = {};
+    *bitmap_size = zero_size;
+    *origin = zero_origin;
+
+    Arena *scratch = get_scratch_arena();
+    ArenaTemp temp = arena_begin_temp(scratch);
+
+    // NOTE: First pass finds the box of the run and sizes the buffers from
+    // the glyph info, nothing is decoded yet
+    f32 min_x = 0.0f, min_y = 0.0f, max_x = 0.0f, max_y = 0.0f;
+    i32 max_points = 0;
+    i32 max_contours = 0;
+    i32 line_capacity = 0;
+    i32 outline_count = 0;
+    for(i32 i = 0; i < run.glyph_count; ++i)
+    {
+        LayoutGlyph *layout = run.glyphs + i;
+        GlyphInfo info = get_font_glyph_info(font, layout->glyph_index);
+        if(info.number_of_contours <= 0) continue;
+
+        f32 left = layout->x + layout->bearing_x;
+        f32 bottom = layout->y + run.scale*info.y_min;
+        f32 right = left + run.scale*(info.x_max - info.x_min);
+        f32 top = layout->y + run.scale*info.y_max;
+        if(!outline_count)
+        {
+            min_x = left; min_y = bottom; max_x = right; max_y = top;
+        }
+        min_x = MIN(min_x, left);
+        min_y = MIN(min_y, bottom);
+        max_x = MAX(max_x, right);
+        max_y = MAX(max_y, top);
+        i32 glyph_max_points = get_glyph_info_max_points(info, run.scale);
+        max_points = MAX(max_points, glyph_max_points);
+        max_contours = MAX(max_contours, info.number_of_contours);
+        line_capacity += glyph_max_points;
+        ++outline_count;
+    }
+    if(!outline_count)
+    {
+        arena_end_temp(temp);
+        return 0;
+    }
+
+    min_x = floorf(min_x);
+    min_y = floorf(min_y);
+    bitmap_size->x = (i32)(max_x - min_x) + 1;
+    bitmap_size->y = (i32)(max_y - min_y) + 1;
+    origin->x = -min_x;
+    origin->y = -min_y;
+
+    // NOTE: Second pass decodes and flattens every outline at its pen
+    // position into one line list, the rasterizer runs once for the whole
+    // run. Only one decoded glyph is alive at a time
+    v2f *points = ARENA_PUSH_ARRAY(scratch, v2f, max_points);
+    i32 *contour_end_index = ARENA_PUSH_ARRAY(scratch, i32, max_contours);
+    Line *lines = ARENA_PUSH_ARRAY(scratch, Line, line_capacity);
+    i32 line_count = 0;
+    for(i32 i = 0; i < run.glyph_count; ++i)
+    {
+        LayoutGlyph *layout = run.glyphs + i;
+        if(get_font_glyph_info(font, layout->glyph_index).number_of_contours <= 0) continue;
+
+        ArenaTemp glyph_temp = arena_begin_temp(scratch);
+        Glyph glyph = get_font_glyph(scratch, font, layout->glyph_index);
+        v2f offset = { layout->x + layout->bearing_x - min_x, layout->y + run.scale*glyph.y_min - min_y };
+        i32 point_count = 0;
+        generate_glyph_points(glyph, points, &point_count, run.scale, contour_end_index);
+
+        i32 contour_start = 0;
+        for(i32 c = 0; c < glyph.number_of_contours; ++c)
+        {
+            for(i32 j = contour_start; j < contour_end_index[c] - 1; ++j)
+            {
+                Line *line = lines + line_count++;
+                line->p0.x = points[j].x + offset.x;
+                line->p0.y = points[j].y + offset.y;
+                line->p1.x = points[j + 1].x + offset.x;
+                line->p1.y = points[j + 1].y + offset.y;
+            }
+            contour_start = contour_end_index[c];
+        }
+        arena_end_temp(glyph_temp);
+    }
+
+    u8 *result = rasterize_glyph_mode(arena, mode, lines, line_count, bitmap_size->y, bitmap_size->x);
+    if(arena != scratch)
+    {
+        arena_end_temp(temp);
+    }
+    return result;
+}
@@ -0,0 +1,854 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stddef.h>
+
+typedef unsigned long long u64;
+typedef unsigned int u32;
+typedef unsigned short u16;
+typedef unsigned char u8;
+
+typedef long long i64;
+typedef int i32;
+typedef short i16;
+typedef char i8;
+
+typedef float f32;
+typedef double f64;
+
+typedef struct
+{
+    f32 x, y;
+} v2f;
+
+typedef struct
+{
+    i32 x, y;
+} v2i;
+
+// NOTE(tomi): This macros are use to manipulate the file contents
+// ttf files are in big endian so we need to change its memory order
+#define GET_16(mem) ((((u8 *)(mem))[0] << 8) | (((u8 *)(mem))[1] << 0))
+
+#define GET_32(mem) ((((u8 *)(mem))[0] << 24) | (((u8 *)(mem))[1] << 16) | \
+                     (((u8 *)(mem))[2] << 8 ) | (((u8 *)(mem))[3] << 0 ))
+
+#define MOVE_P(mem, count) ((mem) += (count))
+
+#define GET_16_MOVE(mem) GET_16(mem); MOVE_P(mem, 2)
+#define GET_32_MOVE(mem) GET_32(mem); MOVE_P(mem, 4)
+
+// NOTE(tomi): Tags to find the different types of tables
+#define TAG(a, b, c, d) ((a) << 24 | (b) << 16 | (c) << 8 | (d) << 0)
+#define CMAP_TAG TAG('c', 'm', 'a', 'p')
+#define HEAD_TAG TAG('h', 'e', 'a', 'd')
+#define LOCA_TAG TAG('l', 'o', 'c', 'a')
+#define GLYF_TAG TAG('g', 'l', 'y', 'f')
+#define HHEA_TAG TAG('h', 'h', 'e', 'a')
+#define HMTX_TAG TAG('h', 'm', 't', 'x')
+#define MAXP_TAG TAG('m', 'a', 'x', 'p')
+#define KERN_TAG TAG('k', 'e', 'r', 'n')
+#define TTCF_TAG TAG('t', 't', 'c', 'f')
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define CLAMP(x, a, b) MIN(MAX(x, a), b)
+
+// NOTE: Every allocation done by the library goes through font_alloc so
+// the tools can report how many bytes the pipeline is asking for
+extern u64 font_allocated_bytes;
+extern u64 font_allocation_count;
+
+void *font_alloc(size_t size);
+void font_free(void *memory);
+
+// NOTE: Linear allocator used by the glyph pipeline. Memory is only given
+// back all at once with arena_reset (or up to a mark with ArenaTemp). A zero
+// initialized Arena is ready to use
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_BLOCK_SIZE (256*1024)
+
+#ifdef _MSC_VER
+#define FONT_THREAD_LOCAL __declspec(thread)
+#else
+#define FONT_THREAD_LOCAL _Thread_local
+#endif
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *prev;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock *current;
+    ArenaBlock *spare;
+    size_t minimum_block_size;
+} Arena;
+
+typedef struct
+{
+    Arena *arena;
+    ArenaBlock *block;
+    size_t used;
+} ArenaTemp;
+
+void *arena_push(Arena *arena, size_t size);
+void *arena_push_zero(Arena *arena, size_t size);
+#define ARENA_PUSH_ARRAY(arena, type, count) ((type *)arena_push((arena), (count)*sizeof(type)))
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+ArenaTemp arena_begin_temp(Arena *arena);
+void arena_end_temp(ArenaTemp temp);
+
+// NOTE: Per thread arena for the temporary memory of one glyph. Reset it
+// after every glyph, cached results belong in a persistent arena instead
+Arena *get_scratch_arena(void);
+void free_scratch_arena(void);
+
+// NOTE: Monotonic clock used by the tools to time the pipeline
+u64 get_time_ns(void);
+
+// NOTE: Pipeline statistics. Counters and per stage latency histograms are
+// kept per thread, so updating them is a plain add, and summed into a
+// snapshot on request. Every stage call is counted but only one call in
+// STAT_SAMPLE_INTERVAL reads the clock, which costs more than most counters.
+// Build with -DFONT_STATS=0 and the STAT_ macros compile to nothing, the
+// snapshot is then all zeros
+#ifndef FONT_STATS
+#define FONT_STATS 1
+#endif
+#ifndef STAT_SAMPLE_INTERVAL
+#define STAT_SAMPLE_INTERVAL 8
+#endif
+
+typedef enum
+{
+    STAT_GLYPHS_DECODED,
+    STAT_POINTS_GENERATED,
+    STAT_LINES_EMITTED,
+    STAT_SCANLINES,
+    // NOTE: Edges crossed by the scanlines, the active edges of every row
+    // for the scanline fill and the rows of every line for coverage
+    STAT_SCANLINE_CROSSINGS,
+    STAT_COMPONENT_CACHE_HITS,
+    STAT_COMPONENT_CACHE_MISSES,
+    STAT_ATLAS_HITS,
+    STAT_ATLAS_MISSES,
+    STAT_BYTES_ALLOCATED,
+    STAT_ALLOCATIONS,
+    STAT_PIXELS_COMPOSITED,
+    STAT_DISK_CACHE_HITS,
+    STAT_DISK_CACHE_MISSES,
+    STAT_COUNTER_COUNT,
+} StatCounter;
+
+typedef enum
+{
+    STAT_STAGE_DECODE,
+    STAT_STAGE_POINTS,
+    STAT_STAGE_LINES,
+    STAT_STAGE_RASTER,
+    STAT_STAGE_SDF,
+    STAT_STAGE_COMPOSITE,
+    STAT_STAGE_COUNT,
+} StatStage;
+
+// NOTE: Bucket i counts the samples in [2^i, 2^(i+1)) ns, the last one
+// everything above
+#define STAT_HISTOGRAM_BUCKETS 32
+
+typedef struct
+{
+    u64 calls;
+    // NOTE: Timed calls, total_ns and the buckets only cover these
+    u64 samples;
+    u64 total_ns;
+    u64 max_ns;
+    u64 buckets[STAT_HISTOGRAM_BUCKETS];
+} StatHistogram;
+
+typedef struct
+{
+    u64 counters[STAT_COUNTER_COUNT];
+    StatHistogram stages[STAT_STAGE_COUNT];
+} FontStats;
+
+#if FONT_STATS
+// NOTE: Stats of the calling thread, the block is registered the first time
+// a thread counts something and lives until the process exits
+extern FONT_THREAD_LOCAL FontStats *font_thread_stats;
+FontStats *create_thread_stats(void);
+void stat_record(StatStage stage, u64 ns);
+
+static inline FontStats *get_thread_stats(void)
+{
+    FontStats *result = font_thread_stats;
+    if(!result) result = create_thread_stats();
+    return result;
+}
+
+// NOTE: Only the owner thread writes its block, the relaxed load and store
+// keep the snapshot reads from other threads well defined without a locked add
+static inline void stat_add(u64 *value, u64 amount)
+{
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+// NOTE: Start time of a sampled call, 0 for the calls that are not timed
+static inline u64 stat_timer_begin(StatStage stage)
+{
+    StatHistogram *histogram = get_thread_stats()->stages + stage;
+    stat_add(&histogram->calls, 1);
+    return (histogram->calls % STAT_SAMPLE_INTERVAL) ? 0 : get_time_ns();
+}
+
+#define STAT_ADD(counter, value) stat_add(get_thread_stats()->counters + (counter), (u64)(value))
+#define STAT_TIMER_BEGIN(stage, timer) u64 timer = stat_timer_begin(stage)
+#define STAT_TIMER_END(stage, timer) ((timer) ? stat_record(stage, get_time_ns() - (timer)) : (void)0)
+#else
+#define STAT_ADD(counter, value)
+#define STAT_TIMER_BEGIN(stage, timer)
+#define STAT_TIMER_END(stage, timer)
+#endif
+
+void get_font_stats(FontStats *snapshot);
+// NOTE: Only exact while no other thread is rendering
+void reset_font_stats(void);
+// NOTE: Writes the snapshot as one JSON object, snprintf style: returns the
+// length the whole object needs even when the buffer is too small
+i32 format_font_stats_json(FontStats *stats, char *buffer, i32 buffer_size);
+
+char *read_entire_file(const char *file_path, u32 *file_size);
+
+// NOTE: Read only view of a file. Memory mapped when the platform allows it
+// so processes that open the same font share the page cache
+typedef struct
+{
+    char *data;
+    u32 size;
+    i32 mapped;
+} FontFile;
+
+i32 open_font_file(const char *file_path, FontFile *file);
+void close_font_file(FontFile *file);
+// NOTE: Hash of the whole file, tells fonts (and versions of one font) apart
+u64 hash_font_file(FontFile *file);
+
+// NOTE: Decodes one UTF-8 sequence from text, returns the number of bytes
+// consumed (0 at the end of the string). Invalid bytes decode as U+FFFD
+i32 utf8_decode(const char *text, u32 *code_point);
+
+// NOTE(tomi): Font Directory code
+typedef struct
+{
+    u32 scaler_type;
+    u16 num_tables;
+    u16 search_range;
+    u16 entry_selector;
+    u16 range_shift;
+} OffsetSubtable;
+
+typedef struct
+{
+    u32 tag;
+    u32 check_sum;
+    u32 offset;
+    u32 length;
+} TableDirectory;
+
+typedef struct
+{
+    // NOTE: search_range, entry_selector and range_shift are checked against
+    // num_tables on load, search_range is 0 if the entries are not sorted
+    OffsetSubtable offset_sub;
+    // NOTE: Raw big endian entries inside the file, see get_table_directory
+    char *table_dir_ptr;
+    // NOTE: Start of the file, table offsets are relative to it
+    char *start;
+
+    char *cmap_ptr;
+    char *head_ptr;
+    char *loca_ptr;
+    char *glyf_ptr;
+    char *hhea_ptr;
+    char *hmtx_ptr;
+    char *maxp_ptr;
+    char *kern_ptr;
+} FontDirectory;
+
+// NOTE: offset is where the face directory starts, 0 for a plain font file
+void load_font_directory(char *file, u32 offset, FontDirectory *font_dir);
+TableDirectory get_table_directory(FontDirectory font_dir, i32 index);
+// NOTE: Binary search over the tag sorted directory
+i32 find_table(FontDirectory font_dir, u32 tag, TableDirectory *table_dir);
+void print_font_directory(FontDirectory font_dir);
+
+// NOTE(tomi): CMap table code
+typedef struct
+{
+    u16 platform_id;
+    u16 platform_specific_id;
+    u32 offset;
+} Subtable;
+
+typedef struct
+{
+    u16 version;
+    u16 num_subtables;
+    Subtable *subtables;
+
+} CMap;
+
+CMap load_cmap_table(FontDirectory font_dir);
+void print_cmap_table(CMap cmap);
+
+typedef struct
+{
+    u16 format;
+    u16 length;
+    u16 language;
+    u16 seg_count_x2;
+    u16 search_range;
+    u16 entry_selector;
+    u16 range_shift;
+
+    // NOTE(tomi) The format dont take into account the size of this pointers
+    u16 *end_code;
+    u16 reserved_pad;
+
+    u16 *start_code;
+    u16 *id_delta;
+    u16 *id_range_offset;
+    u16 *glyph_index_array;
+} Format4;
+
+Format4 load_format4(FontDirectory font_dir, CMap cmap);
+void print_format4(Format4 format);
+u16 get_glyph_index(Format4 format, u16 char_code);
+
+// NOTE: Index of the best unicode subtable with this format (0 for any of
+// the supported ones: 12 or 4), -1 if there is none
+i32 find_cmap_subtable(FontDirectory font_dir, CMap cmap, u16 format);
+
+// NOTE: Codepoint to glyph index map built from the best unicode subtable
+// (format 12 or 4). Codepoints are stored as sorted runs of consecutive
+// glyphs, BMP blocks with enough mapped codepoints also get a flat table
+#define CHAR_MAP_PAGE_SIZE 256
+#define CHAR_MAP_PAGE_COUNT (0x10000 / CHAR_MAP_PAGE_SIZE)
+#define CHAR_MAP_DENSE_THRESHOLD 16
+
+typedef struct
+{
+    u32 start_code;
+    u32 end_code;
+    u32 start_glyph;
+} CharMapGroup;
+
+typedef struct
+{
+    u16 format;
+    CharMapGroup *groups;
+    i32 group_count;
+
+    // NOTE: CHAR_MAP_PAGE_COUNT entries, 0 for blocks that use the binary
+    // search over groups. Allocated with the map so an unloaded map is small
+    u16 **bmp_pages;
+    u16 *dense_pages;
+    i32 dense_page_count;
+} CharMap;
+
+CharMap load_char_map(FontDirectory font_dir);
+void free_char_map(CharMap *map);
+u16 char_map_lookup(CharMap *map, u32 code_point);
+// NOTE: Maps a UTF-8 string to glyph indices, returns the number written
+i32 char_map_utf8(CharMap *map, const char *text, u16 *glyph_indices, i32 max_glyphs);
+
+i16 get_loca_version(FontDirectory font_dir);
+u32 get_glyph_offset(FontDirectory font_dir, u16 glyp_index);
+
+typedef union
+{
+    struct
+    {
+        u8 on_curver : 1;
+        u8 x_short: 1;
+        u8 y_short: 1;
+        u8 repeat: 1;
+        u8 pos_x_short: 1;
+        u8 pos_y_short: 1;
+        u8 reserved1: 1;
+        u8 reserved2: 1;
+    };
+    u8 flag;
+} OutlineFlag;
+
+#define FLAG_ON_CURVE (1 << 0)
+#define FLAG_X_SHORT (1 << 1)
+#define FLAG_Y_SHORT (1 << 2)
+#define FLAG_REPEAT (1 << 3)
+#define FLAG_X_SAME (1 << 4)
+#define FLAG_Y_SAME (1 << 5)
+
+typedef struct
+{
+    i16 number_of_contours;
+    i16 x_min;
+    i16 y_min;
+    i16 x_max;
+    i16 y_max;
+
+    u16 *end_pts_of_contours;
+    u16 instruction_length;
+    u8 *instructions;
+    OutlineFlag *flags;
+    i16 *x_coords;
+    i16 *y_coords;
+}Glyph;
+
+// NOTE: Composite glyph component flags
+#define COMPONENT_ARG_1_AND_2_ARE_WORDS (1 << 0)
+#define COMPONENT_ARGS_ARE_XY_VALUES (1 << 1)
+#define COMPONENT_ROUND_XY_TO_GRID (1 << 2)
+#define COMPONENT_WE_HAVE_A_SCALE (1 << 3)
+#define COMPONENT_MORE_COMPONENTS (1 << 5)
+#define COMPONENT_WE_HAVE_AN_X_AND_Y_SCALE (1 << 6)
+#define COMPONENT_WE_HAVE_A_TWO_BY_TWO (1 << 7)
+#define COMPONENT_WE_HAVE_INSTRUCTIONS (1 << 8)
+#define COMPONENT_USE_MY_METRICS (1 << 9)
+#define COMPONENT_OVERLAP_COMPOUND (1 << 10)
+#define COMPONENT_SCALED_COMPONENT_OFFSET (1 << 11)
+#define COMPONENT_UNSCALED_COMPONENT_OFFSET (1 << 12)
+
+#define GLYPH_MAX_COMPONENT_DEPTH 8
+
+// NOTE: Decoded outlines of the glyphs used as components of composite
+// glyphs ('e', 'a', combining accents...), shared by every composite that
+// references them. slots has one entry per glyph index, 0 means not decoded
+typedef struct
+{
+    Arena arena;
+    i32 *slots;
+    u16 glyph_count;
+    Glyph *glyphs;
+    i32 count;
+    i32 capacity;
+
+    u64 hits;
+    u64 misses;
+} GlyphCache;
+
+u16 get_glyph_count(FontDirectory font_dir);
+
+// NOTE: The outline arrays are pushed into the arena. Composite glyphs come
+// back as one flattened outline with the component transforms applied
+Glyph get_glyph(Arena *arena, FontDirectory font_dir, Format4 format, u16 char_code);
+Glyph get_glyph_by_index(Arena *arena, FontDirectory font_dir, u16 glyph_index);
+void free_glyph_cache(GlyphCache *cache);
+void print_glyph(Glyph glyph, char char_code);
+// NOTE: Decodes the coordinates of a simple glyph with the SSSE3 decoder and
+// with the scalar one. Returns the number of coordinates they disagree on, one
+// more for every axis they stop reading at different bytes. vector_count is
+// how many coordinates the SSSE3 decoder did before the scalar tail, without
+// SSSE3 nothing is compared
+i32 compare_glyph_coordinate_decoders(FontDirectory font_dir, u16 glyph_index, i32 *vector_count);
+
+typedef struct
+{
+    i32 version;
+
+    i16 ascent;
+    i16 descent;
+    i16 line_gap;
+
+    u16 advance_width_max;
+
+    i16 min_left_side_bearing;
+    i16 min_right_side_bearing;
+
+    i16 x_max_extent;
+
+    i16 caret_slope_rise;
+    i16 caret_slope_run;
+
+    i16 care_offset;
+
+    i16 reserved1;
+    i16 reserved2;
+    i16 reserved3;
+    i16 reserved4;
+
+    i16 metric_data_format;
+
+    u16 num_of_long_hormetrics;
+
+} Hhead;
+
+Hhead load_hhea_table(FontDirectory font_dir);
+
+typedef struct
+{
+    u16 advance_width;
+    i16 left_side_bearing;
+} LongHorMetric;
+
+typedef struct
+{
+    char *hmtx_ptr;
+    i32 metric_count;
+} Hmtx;
+
+Hmtx load_hmtx_table(FontDirectory font_dir);
+LongHorMetric get_glyph_h_metric(Hmtx hmtx, u16 glyph_index);
+
+// NOTE: Legacy kern table, only the first horizontal format 0 subtable. The
+// pairs are read in place, 6 big endian bytes each (left, right, value)
+// sorted by left and right glyph index
+typedef struct
+{
+    char *pairs;
+    u32 pair_count;
+} Kern;
+
+Kern load_kern_table(FontDirectory font_dir);
+// NOTE: Adjustment in font units of the advance between two glyphs
+i16 get_kern_advance(Kern kern, u16 left_glyph, u16 right_glyph);
+
+typedef struct
+{
+    v2f p0;
+    v2f p1;
+} Line;
+
+// NOTE: Maximum distance in pixels between a flattened curve and the real one
+#define BEZIER_TOLERANCE 0.2f
+#define BEZIER_MAX_SEGMENTS 64
+
+// NOTE: Number of lines needed to flatten the curve at this scale
+i32 get_bezier_segment_count(v2f p0, v2f p1, v2f p2, f32 scale);
+void generate_bezier_points(v2f *output, i32 *output_size, v2f p0, v2f p1, v2f p2, f32 scale);
+// NOTE: Upper bound of points generate_glyph_points can write for this glyph
+// at this scale
+i32 get_glyph_max_points(Glyph glyph, f32 scale);
+i32 get_glyph_point_count(Glyph glyph);
+// NOTE: Off curve points, every curve of the outline starts at one of them
+i32 get_glyph_curve_count(Glyph glyph);
+void generate_glyph_points(Glyph glyph, v2f *output, i32 *output_size, f32 scale, i32 *contour_end_index);
+// NOTE: Same but the outline is moved by offset pixels inside the bitmap, for
+// glyphs placed at a fraction of a pixel. offset is in [0, 1)
+void generate_glyph_points_offset(Glyph glyph, v2f *output, i32 *output_size, f32 scale, v2f offset, i32 *contour_end_index);
+Line *generate_glyph_lines(Arena *arena, Glyph glyph, i32 *line_count, v2f *glyph_points, i32 *contour_end_index);
+
+f32 scale_pixel_height(Hhead hhea, f32 height);
+// NOTE: Size of the bitmap that holds the glyph bounding box at this scale
+v2i get_glyph_bitmap_size(Glyph glyph, f32 scale);
+v2i get_glyph_bitmap_size_offset(Glyph glyph, f32 scale, v2f offset);
+
+typedef enum
+{
+    RASTER_BINARY,   // NOTE: 0 or 255 per pixel, scanline fill (rasterize_glyph)
+    RASTER_COVERAGE, // NOTE: 8-bit alpha from the exact area covered by the outline
+    RASTER_FIXED,    // NOTE: RASTER_BINARY in 26.6 fixed point (rasterize_glyph_fixed)
+} RasterMode;
+
+// NOTE: The bitmap is pushed into the arena, the temporary memory of the
+// rasterizer comes from the scratch arena
+u8 *rasterize_glyph(Arena *arena, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width);
+u8 *rasterize_glyph_coverage(Arena *arena, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width);
+u8 *rasterize_glyph_mode(Arena *arena, RasterMode mode, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width);
+
+// NOTE: Fixed point pipeline behind RASTER_FIXED. The scale is rounded once
+// to 16.16, the outline is scaled into 26.6 device coordinates, flattened and
+// filled with integer math only, so the bitmap is the same bit for bit with
+// every compiler and set of flags. Same fill rule and sample rows as
+// rasterize_glyph. Float lines given to the RASTER_FIXED rasterizers are
+// rounded to 26.6 first
+#define FIXED_SHIFT 6
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+typedef struct
+{
+    v2i p0;
+    v2i p1;
+} LineFixed;
+
+i32 get_fixed_scale(f32 scale);
+i32 get_glyph_max_points_fixed(Glyph glyph, i32 fixed_scale);
+// NOTE: offset is in 26.6
+void generate_glyph_points_fixed(Glyph glyph, v2i *output, i32 *output_size, i32 fixed_scale, v2i offset,
+                                 i32 *contour_end_index);
+// NOTE: Horizontal lines are dropped
+LineFixed *generate_glyph_lines_fixed(Arena *arena, Glyph glyph, i32 *line_count, v2i *glyph_points,
+                                      i32 *contour_end_index);
+LineFixed *snap_lines_fixed(Arena *arena, Line *lines, i32 lines_count, i32 *line_count);
+u8 *rasterize_glyph_fixed(Arena *arena, LineFixed *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width);
+
+// NOTE: Streaming rasterization. The bitmap is produced in bands of
+// band_rows rows from the bottom up and every band goes to the sink as soon
+// as it is done, the memory in use is one band plus the lines no matter how
+// big the glyph is. rows holds row_count rows of width pixels, the first one
+// is row row_begin of the bitmap, and is reused after the sink returns
+typedef void RasterBandSink(void *user_data, u8 *rows, i32 row_begin, i32 row_count, i32 width);
+
+void rasterize_glyph_bands(RasterMode mode, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width,
+                           i32 band_rows, RasterBandSink *sink, void *user_data);
+
+// NOTE: Span output. Every row of the bitmap becomes runs of pixels with the
+// same coverage, [x_start, x_end) on row y (y up, like the bitmaps), sorted
+// by y and then x. Empty pixels are not written and nothing the size of the
+// bitmap is ever allocated: the binary rasterizers emit their fills as they
+// are found and the coverage one run length codes SPAN_BAND_ROWS rows at a
+// time. Writes at most max_spans spans and returns how many the glyph needs,
+// call again with a bigger buffer if it is more
+#define SPAN_BAND_ROWS 16
+
+typedef struct
+{
+    u16 y;
+    u16 x_start;
+    u16 x_end;
+    u8 coverage;
+    u8 reserved;
+} RasterSpan;
+
+i32 rasterize_glyph_spans(RasterMode mode, Line *lines, i32 lines_count, i32 bitmap_height, i32 bitmap_width,
+                          RasterSpan *spans, i32 max_spans);
+// NOTE: Writes the spans into a bitmap of width x height with span (0, 0) at
+// (x, y), clipped to the bitmap
+void draw_spans(u8 *bitmap, i32 width, i32 height, i32 x, i32 y, RasterSpan *spans, i32 span_count);
+// NOTE: Whether spans or the dense bitmap are cheaper for a glyph of this
+// size. Binary spans come straight from the scanline fills and always win.
+// Coverage spans are run length coded from the dense rows, one more pass and
+// a span for every edge pixel, which only pays off on glyphs that fit in one
+// band of SPAN_BAND_ROWS, above that render the bitmap instead
+#define SPAN_COVERAGE_MAX_HEIGHT SPAN_BAND_ROWS
+i32 prefer_span_output(RasterMode mode, v2i bitmap_size);
+
+// NOTE: Every outline of the font decoded once into flat arrays. Points of a
+// glyph are contiguous and its contour ends are relative to its first point,
+// so a glyph of the store is a Glyph that points into the arrays. Flags only
+// keep the on curve bit and composites are already flattened
+typedef struct
+{
+    u32 point_offset;
+    u32 contour_offset;
+    i16 number_of_contours;
+    i16 x_min;
+    i16 y_min;
+    i16 x_max;
+    i16 y_max;
+} OutlineStoreGlyph;
+
+typedef struct
+{
+    u16 glyph_count;
+    OutlineStoreGlyph *glyphs;
+
+    u32 point_count;
+    u32 contour_count;
+    i16 *x_coords;
+    i16 *y_coords;
+    OutlineFlag *flags;
+    u16 *end_pts_of_contours;
+} OutlineStore;
+
+OutlineStore load_outline_store(FontDirectory font_dir, GlyphCache *cache);
+void free_outline_store(OutlineStore *store);
+// NOTE: The outline arrays of the result belong to the store
+Glyph get_outline_store_glyph(OutlineStore *store, u16 glyph_index);
+
+// NOTE: What the pipeline needs to size a glyph before decoding it, read
+// from the glyf headers of every glyph in one pass. Composites get the
+// flattened counts of their components and their own box, like the outline
+// get_glyph gives back. curve_count is the off curve points, only those can
+// start a curve, so the max points bound what the flattening writes without
+// counting a whole curve for every point
+typedef struct
+{
+    // NOTE: 0 for glyphs without outline
+    i16 number_of_contours;
+    i16 x_min;
+    i16 y_min;
+    i16 x_max;
+    i16 y_max;
+    u32 point_count;
+    u32 curve_count;
+} GlyphInfo;
+
+typedef struct
+{
+    u16 glyph_count;
+    GlyphInfo *glyphs;
+} GlyphInfoTable;
+
+GlyphInfoTable load_glyph_info_table(FontDirectory font_dir);
+void free_glyph_info_table(GlyphInfoTable *table);
+// NOTE: A zero info for indices outside the font
+GlyphInfo get_glyph_info(GlyphInfoTable *table, u16 glyph_index);
+GlyphInfo get_glyph_outline_info(Glyph glyph);
+// NOTE: Same results as get_glyph_max_points, get_glyph_max_points_fixed and
+// get_glyph_bitmap_size_offset give for the decoded glyph
+i32 get_glyph_info_max_points(GlyphInfo info, f32 scale);
+i32 get_glyph_info_max_points_fixed(GlyphInfo info, i32 fixed_scale);
+v2i get_glyph_info_bitmap_size(GlyphInfo info, f32 scale, v2f offset);
+
+// NOTE: An open font. Only the table directory is read when the font is
+// opened, the other tables are decoded the first time they are asked for
+#define FONT_LOADED_HHEA (1 << 0)
+#define FONT_LOADED_HMTX (1 << 1)
+#define FONT_LOADED_CHAR_MAP (1 << 2)
+#define FONT_LOADED_OUTLINES (1 << 3)
+#define FONT_LOADED_KERN (1 << 4)
+#define FONT_LOADED_GLYPH_INFO (1 << 5)
+
+typedef struct
+{
+    FontFile file;
+    FontDirectory font_dir;
+    // NOTE: The file belongs to a FontCollection and is not closed with the font
+    i32 shared_file;
+
+    u32 loaded;
+    Hhead hhea;
+    Hmtx hmtx;
+    Kern kern;
+    CharMap char_map;
+    GlyphCache component_cache;
+    OutlineStore outlines;
+    GlyphInfoTable glyph_info;
+} Font;
+
+// NOTE: Opens the first face of a collection file
+i32 open_font(const char *file_path, Font *font);
+void close_font(Font *font);
+
+// NOTE: Font collection (.ttc). The file is mapped once and every face opened
+// from it points into the same mapping, a face only costs its Font and the
+// tables it decodes. A plain font file opens as a collection of one face.
+// The faces have to be closed before the collection
+typedef struct
+{
+    FontFile file;
+    u32 face_count;
+    // NOTE: Raw big endian face directory offsets, 0 for a plain font file
+    char *face_offsets;
+} FontCollection;
+
+i32 open_font_collection(const char *file_path, FontCollection *collection);
+void close_font_collection(FontCollection *collection);
+i32 open_collection_face(FontCollection *collection, u32 face_index, Font *font);
+Hhead *get_font_hhea(Font *font);
+Hmtx *get_font_hmtx(Font *font);
+Kern *get_font_kern(Font *font);
+CharMap *get_font_char_map(Font *font);
+// NOTE: The info table is built for the whole font the first time
+GlyphInfo get_font_glyph_info(Font *font, u16 glyph_index);
+// NOTE: Optional, decodes every glyph of the font into the outline store.
+// Worth it when the same font is rendered at many sizes
+i32 load_font_outlines(Font *font);
+// NOTE: Same as get_glyph_by_index but composite glyphs reuse the components
+// already decoded in the font component cache. With the outlines loaded
+// nothing is decoded or pushed into the arena, the result points into the
+// outline store
+Glyph get_font_glyph(Arena *arena, Font *font, u16 glyph_index);
+
+// NOTE: Runs generate_glyph_points -> generate_glyph_lines -> rasterize for one
+// glyph, returns 0 for glyphs without outline
+u8 *render_glyph(Arena *arena, Glyph glyph, f32 scale, RasterMode mode, v2i *bitmap_size);
+// NOTE: Same pipeline streamed to a band sink, returns the bitmap size
+v2i render_glyph_bands(Glyph glyph, f32 scale, RasterMode mode, i32 band_rows, RasterBandSink *sink, void *user_data);
+// NOTE: Same pipeline into spans, see rasterize_glyph_spans
+i32 render_glyph_spans(Glyph glyph, f32 scale, v2f offset, RasterMode mode, RasterSpan *spans, i32 max_spans,
+                       v2i *bitmap_size);
+u8 *render_glyph_offset(Arena *arena, Glyph glyph, f32 scale, v2f offset, RasterMode mode, v2i *bitmap_size);
+
+// NOTE: Signed distance fields. Every pixel stores the distance from its
+// center to the closest outline line, SDF_EDGE_VALUE on the outline, higher
+// inside and clamped at spread pixels. The field keeps padding pixels around
+// the glyph bitmap so the outside falloff fits. One field rendered at a
+// medium size can be sampled into alpha at any other size
+#define SDF_EDGE_VALUE 128
+// NOTE: Side of the grid cells the lines are bucketed into, in pixels
+#define SDF_CELL_SIZE 8
+
+// NOTE: The lines of a glyph (in field pixels) and a grid where every cell
+// lists the lines closer than spread to any point of the cell, so a pixel
+// only measures the lines of its own cell. Read only once built, rows can be
+// generated from several threads
+typedef struct
+{
+    Line *lines;
+    i32 line_count;
+    i32 width;
+    i32 height;
+    i32 padding;
+    f32 spread;
+
+    i32 cells_x;
+    i32 cells_y;
+    // NOTE: Lines of cell i are cell_lines[cell_start[i]..cell_start[i + 1]]
+    i32 *cell_start;
+    i32 *cell_lines;
+} SdfShape;
+
+typedef struct
+{
+    u8 *pixels;
+    i32 width;
+    i32 height;
+    i32 padding;
+    f32 spread;
+    // NOTE: Scale the field was generated at and the outline size in font
+    // units, enough to size the bitmap at another scale
+    f32 scale;
+    i32 x_extent;
+    i32 y_extent;
+} SdfBitmap;
+
+// NOTE: Everything is pushed into the arena, width is 0 for glyphs without
+// outline
+SdfShape build_sdf_shape(Arena *arena, Glyph glyph, f32 scale, f32 spread);
+void generate_sdf_rows(SdfShape *shape, u8 *output, i32 row_begin, i32 row_end);
+// NOTE: The field bitmap of a shape, pixels are left for generate_sdf_rows
+SdfBitmap push_sdf_bitmap(Arena *arena, SdfShape *shape, Glyph glyph, f32 scale);
+SdfBitmap render_glyph_sdf(Arena *arena, Glyph glyph, f32 scale, f32 spread);
+// NOTE: Bilinear samples the field into a coverage bitmap the size
+// render_glyph gives at this scale, 0 for glyphs without outline
+u8 *render_sdf_alpha(Arena *arena, SdfBitmap sdf, f32 scale, v2i *bitmap_size);
+
+// NOTE: Text runs. Pen positions are in pixels, x to the right and y up from
+// the baseline of the first line. bearing_x is the distance from the pen to
+// the left of the outline (the hmtx left side bearing)
+typedef struct
+{
+    u16 glyph_index;
+    u32 code_point;
+    f32 x;
+    f32 y;
+    f32 bearing_x;
+    f32 advance;
+} LayoutGlyph;
+
+typedef struct
+{
+    f32 scale;
+    f32 line_height;
+    LayoutGlyph *glyphs;
+    i32 glyph_count;
+    // NOTE: Widest line
+    f32 width;
+} TextRun;
+
+// NOTE: UTF-8 in, glyph indices and pen positions out. Advances come from
+// hmtx plus the kern pair adjustments, '\n' starts a new line. The glyphs are
+// pushed into the arena
+TextRun layout_text(Arena *arena, Font *font, const char *text, f32 pixel_size);
+// NOTE: Rasterizes the whole run in one pass into a bitmap as tight as the
+// union of the glyph boxes, the outlines of every glyph go to the same line
+// list. origin is where the pen started inside the bitmap (y up), returns 0
+// if no glyph of the run has an outline
+u8 *render_text_run(Arena *arena, Font *font, TextRun run, RasterMode mode, v2i *bitmap_size, v2f *origin);
+
+#endif // FONT_H
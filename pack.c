@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pack.h"
+
+#define PACK_ALIGN(offset) (((offset) + PACK_ALIGNMENT - 1) & ~(u32)(PACK_ALIGNMENT - 1))
+
+static int compare_u16(const void *a, const void *b)
+{
+    return (i32)*(const u16 *)a - (i32)*(const u16 *)b;
+}
+
+i32 bake_font_pack(const char *file_path, Font *font, u32 *code_points, i32 code_point_count,
+                   u16 *pixel_sizes, i32 size_count, RasterMode mode, i32 page_size, i32 max_pages)
+{
+    CharMap *char_map = get_font_char_map(font);
+    Hhead hhea = *get_font_hhea(font);
+    Hmtx hmtx = *get_font_hmtx(font);
+    u16 font_glyph_count = get_glyph_count(font->font_dir);
+
+    // NOTE: Codepoints that share a glyph are baked once
+    u16 *glyph_indices = (u16 *)font_alloc((code_point_count + 1)*sizeof(u16));
+    i32 glyph_count = 0;
+    glyph_indices[glyph_count++] = 0;
+    for(i32 i = 0; i < code_point_count; ++i)
+    {
+        glyph_indices[glyph_count++] = char_map_lookup(char_map, code_points[i]);
+    }
+    qsort(glyph_indices, glyph_count, sizeof(u16), compare_u16);
+    i32 unique_count = 0;
+    for(i32 i = 0; i < glyph_count; ++i)
+    {
+        if(!unique_count || glyph_indices[unique_count - 1] != glyph_indices[i])
+        {
+            glyph_indices[unique_count++] = glyph_indices[i];
+        }
+    }
+    glyph_count = unique_count;
+
+    Atlas atlas = atlas_create(page_size, page_size, max_pages, glyph_count*size_count, mode, 1, 1);
+    PackGlyph *glyphs = (PackGlyph *)font_alloc(glyph_count*size_count*sizeof(PackGlyph));
+    i32 result = 1;
+    for(i32 s = 0; s < size_count && result; ++s)
+    {
+        for(i32 i = 0; i < glyph_count; ++i)
+        {
+            AtlasKey key = { glyph_indices[i], pixel_sizes[s], 0 };
+            AtlasEntry *entry = atlas_get(&atlas, font, key);
+            // NOTE: An evicted page would lose glyphs that are already baked
+            if(!entry || atlas.evicted_pages)
+            {
+                result = 0;
+                break;
+            }
+            PackGlyph *glyph = glyphs + s*glyph_count + i;
+            glyph->glyph_index = glyph_indices[i];
+            glyph->page = entry->page == ATLAS_NIL ? PACK_NO_PAGE : (u16)entry->page;
+            glyph->x = (u16)entry->x;
+            glyph->y = (u16)entry->y;
+            glyph->width = (u16)entry->width;
+            glyph->height = (u16)entry->height;
+            glyph->bearing_x = (i16)entry->bearing_x;
+            glyph->bearing_y = (i16)entry->bearing_y;
+        }
+    }
+
+    if(result)
+    {
+        PackHeader header = {};
+        header.magic = PACK_MAGIC;
+        header.version = PACK_VERSION;
+        header.source_size = font->file.size;
+        header.source_hash = hash_font_file(&font->file);
+        header.ascent = hhea.ascent;
+        header.descent = hhea.descent;
+        header.line_gap = hhea.line_gap;
+        header.glyph_count = font_glyph_count;
+        header.mode = (u32)mode;
+        header.group_count = char_map->group_count;
+        header.size_count = size_count;
+        header.page_width = page_size;
+        header.page_height = page_size;
+        header.page_count = atlas.page_count;
+
+        u32 offset = PACK_ALIGN((u32)sizeof(PackHeader));
+        header.group_offset = offset;
+        offset = PACK_ALIGN(offset + header.group_count*(u32)sizeof(CharMapGroup));
+        header.metric_offset = offset;
+        offset = PACK_ALIGN(offset + header.glyph_count*(u32)sizeof(LongHorMetric));
+        header.size_offset = offset;
+        offset = PACK_ALIGN(offset + size_count*(u32)sizeof(PackSize));
+        u32 glyph_offset = offset;
+        offset = PACK_ALIGN(offset + glyph_count*size_count*(u32)sizeof(PackGlyph));
+        header.page_offset = offset;
+        offset += header.page_count*header.page_width*header.page_height;
+        header.file_size = offset;
+
+        u8 *data = (u8 *)font_alloc(header.file_size);
+        memset(data, 0, header.file_size);
+        memcpy(data, &header, sizeof(header));
+        memcpy(data + header.group_offset, char_map->groups, header.group_count*sizeof(CharMapGroup));
+        LongHorMetric *metrics = (LongHorMetric *)(data + header.metric_offset);
+        for(u32 i = 0; i < header.glyph_count; ++i)
+        {
+            metrics[i] = get_glyph_h_metric(hmtx, (u16)i);
+        }
+        PackSize *sizes = (PackSize *)(data + header.size_offset);
+        for(i32 s = 0; s < size_count; ++s)
+        {
+            sizes[s].pixel_size = pixel_sizes[s];
+            sizes[s].glyph_count = glyph_count;
+            sizes[s].glyph_offset = glyph_offset + s*glyph_count*(u32)sizeof(PackGlyph);
+        }
+        memcpy(data + glyph_offset, glyphs, glyph_count*size_count*sizeof(PackGlyph));
+        for(i32 i = 0; i < atlas.page_count; ++i)
+        {
+            memcpy(data + header.page_offset + i*header.page_width*header.page_height,
+                   atlas.pages[i].pixels, header.page_width*header.page_height);
+        }
+
+        FILE *file = fopen(file_path, "wb");
+        result = file && fwrite(data, 1, header.file_size, file) == header.file_size;
+        if(file)
+        {
+            result = !fclose(file) && result;
+        }
+        font_free(data);
+    }
+
+    atlas_destroy(&atlas);
+    font_free(glyphs);
+    font_free(glyph_indices);
+    return result;
+}
+
+static i32 section_fits(PackHeader *header, u32 offset, u64 size)
+{
+    return offset % PACK_ALIGNMENT == 0 && (u64)offset + size <= header->file_size;
+}
+
+i32 open_font_pack(const char *file_path, FontFile *source, FontPack *pack)
+{
+    FontPack result = {};
+    if(!open_font_file(file_path, &result.file))
+    {
+        *pack = result;
+        return 0;
+    }
+
+    PackHeader *header = (PackHeader *)result.file.data;
+    i32 valid = result.file.size >= sizeof(PackHeader);
+    valid = valid && header->magic == PACK_MAGIC && header->version == PACK_VERSION;
+    valid = valid && header->file_size == result.file.size;
+    valid = valid && section_fits(header, header->group_offset, (u64)header->group_count*sizeof(CharMapGroup));
+    valid = valid && section_fits(header, header->metric_offset, (u64)header->glyph_count*sizeof(LongHorMetric));
+    valid = valid && section_fits(header, header->size_offset, (u64)header->size_count*sizeof(PackSize));
+    valid = valid && section_fits(header, header->page_offset,
+                                  (u64)header->page_count*header->page_width*header->page_height);
+    for(u32 i = 0; valid && i < header->size_count; ++i)
+    {
+        PackSize *size = (PackSize *)(result.file.data + header->size_offset) + i;
+        valid = section_fits(header, size->glyph_offset, (u64)size->glyph_count*sizeof(PackGlyph));
+        PackGlyph *glyphs = (PackGlyph *)(result.file.data + size->glyph_offset);
+        for(u32 j = 0; valid && j < size->glyph_count; ++j)
+        {
+            PackGlyph *glyph = glyphs + j;
+            valid = glyph->page == PACK_NO_PAGE ||
+                (glyph->page < header->page_count &&
+                 (u32)glyph->x + glyph->width <= header->page_width &&
+                 (u32)glyph->y + glyph->height <= header->page_height);
+        }
+    }
+    if(valid && source)
+    {
+        valid = header->source_size == source->size && header->source_hash == hash_font_file(source);
+    }
+
+    if(!valid)
+    {
+        close_font_file(&result.file);
+        FontPack zero = {};
+        *pack = zero;
+        return 0;
+    }
+
+    result.header = header;
+    result.groups = (CharMapGroup *)(result.file.data + header->group_offset);
+    result.metrics = (LongHorMetric *)(result.file.data + header->metric_offset);
+    result.sizes = (PackSize *)(result.file.data + header->size_offset);
+    result.pages = (u8 *)(result.file.data + header->page_offset);
+    *pack = result;
+    return 1;
+}
+
+void close_font_pack(FontPack *pack)
+{
+    close_font_file(&pack->file);
+    FontPack zero = {};
+    *pack = zero;
+}
+
+u16 pack_glyph_index(FontPack *pack, u32 code_point)
+{
+    i32 low = 0;
+    i32 high = (i32)pack->header->group_count - 1;
+    while(low <= high)
+    {
+        i32 middle = (low + high) / 2;
+        CharMapGroup *group = pack->groups + middle;
+        if(code_point < group->start_code)
+        {
+            high = middle - 1;
+        }
+        else if(code_point > group->end_code)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return (u16)(group->start_glyph + (code_point - group->start_code));
+        }
+    }
+    return 0;
+}
+
+LongHorMetric pack_glyph_metric(FontPack *pack, u16 glyph_index)
+{
+    LongHorMetric result = {};
+    if(glyph_index < pack->header->glyph_count)
+    {
+        result = pack->metrics[glyph_index];
+    }
+    return result;
+}
+
+PackGlyph *pack_find_glyph(FontPack *pack, u32 pixel_size, u16 glyph_index)
+{
+    for(u32 s = 0; s < pack->header->size_count; ++s)
+    {
+        PackSize *size = pack->sizes + s;
+        if(size->pixel_size != pixel_size) continue;
+
+        PackGlyph *glyphs = (PackGlyph *)(pack->file.data + size->glyph_offset);
+        i32 low = 0;
+        i32 high = (i32)size->glyph_count - 1;
+        while(low <= high)
+        {
+            i32 middle = (low + high) / 2;
+            if(glyph_index < glyphs[middle].glyph_index) high = middle - 1;
+            else if(glyph_index > glyphs[middle].glyph_index) low = middle + 1;
+            else return glyphs + middle;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+u8 *pack_page(FontPack *pack, i32 page)
+{
+    return pack->pages + (u64)page*pack->header->page_width*pack->header->page_height;
+}
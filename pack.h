@@ -0,0 +1,98 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include "font.h"
+#include "atlas.h"
+
+// NOTE: Baked font pack. One flat file with everything a renderer needs for
+// a fixed set of codepoints and pixel sizes: the codepoint runs of the char
+// map, the hhea/hmtx metrics of every glyph and the atlas pages with the
+// glyphs already rasterized. Every section sits at an aligned offset from the
+// start of the file in native byte order, so a mapped pack is used in place
+// with no parsing or relocation. The header keeps a hash of the source font
+// file, a pack baked from another font (or version of it) can be told apart
+// without parsing the font
+
+#define PACK_MAGIC TAG('F', 'P', 'A', 'K')
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 16
+#define PACK_NO_PAGE 0xFFFF
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 file_size;
+    u32 source_size;
+    u64 source_hash;
+
+    i16 ascent;
+    i16 descent;
+    i16 line_gap;
+    u16 glyph_count;
+    // NOTE: RasterMode the pages were rendered with
+    u32 mode;
+
+    // NOTE: Offsets from the start of the file
+    u32 group_count;
+    u32 group_offset;
+    u32 metric_offset;
+    u32 size_count;
+    u32 size_offset;
+    u32 page_width;
+    u32 page_height;
+    u32 page_count;
+    u32 page_offset;
+} PackHeader;
+
+// NOTE: Glyphs of one pixel size, sorted by glyph index
+typedef struct
+{
+    u32 pixel_size;
+    u32 glyph_count;
+    u32 glyph_offset;
+} PackSize;
+
+typedef struct
+{
+    u16 glyph_index;
+    // NOTE: PACK_NO_PAGE for glyphs without pixels
+    u16 page;
+    u16 x, y;
+    u16 width, height;
+    // NOTE: Same as AtlasEntry, whole pixels from the pen to the bitmap
+    // origin (bottom left, y up)
+    i16 bearing_x;
+    i16 bearing_y;
+} PackGlyph;
+
+typedef struct
+{
+    FontFile file;
+    PackHeader *header;
+    CharMapGroup *groups;
+    // NOTE: One per glyph of the font
+    LongHorMetric *metrics;
+    PackSize *sizes;
+    u8 *pages;
+} FontPack;
+
+// NOTE: Rasterizes every codepoint at every size into atlas pages of
+// page_size x page_size and writes the pack. Fails if the glyphs need more
+// than max_pages pages
+i32 bake_font_pack(const char *file_path, Font *font, u32 *code_points, i32 code_point_count,
+                   u16 *pixel_sizes, i32 size_count, RasterMode mode, i32 page_size, i32 max_pages);
+
+// NOTE: Maps the pack and checks the header and that every section is inside
+// the file. With a source font file the pack also has to be baked from it
+i32 open_font_pack(const char *file_path, FontFile *source, FontPack *pack);
+void close_font_pack(FontPack *pack);
+
+// NOTE: 0 (the missing glyph) for codepoints the pack does not map
+u16 pack_glyph_index(FontPack *pack, u32 code_point);
+LongHorMetric pack_glyph_metric(FontPack *pack, u16 glyph_index);
+// NOTE: 0 if the glyph was not baked at this size
+PackGlyph *pack_find_glyph(FontPack *pack, u32 pixel_size, u16 glyph_index);
+u8 *pack_page(FontPack *pack, i32 page);
+
+#endif // PACK_H